@@ -0,0 +1,179 @@
+#include "AllocationCounter.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+std::atomic<int> activeCounters(0);
+std::atomic<int64_t> allocations(0);
+
+}
+
+namespace contourtree {
+
+AllocationCounter::AllocationCounter() {
+    activeCounters ++;
+    start = allocations;
+}
+
+AllocationCounter::~AllocationCounter() {
+    activeCounters --;
+}
+
+int64_t AllocationCounter::count() const {
+    return allocations - start;
+}
+
+}
+
+#ifndef NDEBUG
+
+namespace {
+
+void* allocate(size_t size) {
+    if(activeCounters > 0) {
+        allocations ++;
+    }
+    void *p = malloc(size == 0 ? 1 : size);
+    if(p == NULL) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+}
+
+void* operator new(size_t size) {
+    return allocate(size);
+}
+
+void* operator new[](size_t size) {
+    return allocate(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t &) noexcept {
+    try {
+        return allocate(size);
+    } catch(const std::bad_alloc &) {
+        return NULL;
+    }
+}
+
+void* operator new[](size_t size, const std::nothrow_t &) noexcept {
+    try {
+        return allocate(size);
+    } catch(const std::bad_alloc &) {
+        return NULL;
+    }
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept {
+    free(p);
+}
+
+#if defined (__cpp_sized_deallocation)
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept {
+    free(p);
+}
+#endif
+
+#if defined (__cpp_aligned_new)
+namespace {
+
+void* allocateAligned(size_t size, std::align_val_t alignment) {
+    if(activeCounters > 0) {
+        allocations ++;
+    }
+    size_t align = static_cast<size_t>(alignment);
+#if defined (WIN32)
+    void *p = _aligned_malloc(size == 0 ? 1 : size, align);
+#else
+    void *p = NULL;
+    if(posix_memalign(&p, align < sizeof(void *) ? sizeof(void *) : align, size == 0 ? 1 : size) != 0) {
+        p = NULL;
+    }
+#endif
+    if(p == NULL) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void freeAligned(void *p) {
+#if defined (WIN32)
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+    return allocateAligned(size, alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+    return allocateAligned(size, alignment);
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+    try {
+        return allocateAligned(size, alignment);
+    } catch(const std::bad_alloc &) {
+        return NULL;
+    }
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+    try {
+        return allocateAligned(size, alignment);
+    } catch(const std::bad_alloc &) {
+        return NULL;
+    }
+}
+
+void operator delete(void *p, std::align_val_t) noexcept {
+    freeAligned(p);
+}
+
+void operator delete[](void *p, std::align_val_t) noexcept {
+    freeAligned(p);
+}
+
+void operator delete(void *p, size_t, std::align_val_t) noexcept {
+    freeAligned(p);
+}
+
+void operator delete[](void *p, size_t, std::align_val_t) noexcept {
+    freeAligned(p);
+}
+
+void operator delete(void *p, std::align_val_t, const std::nothrow_t &) noexcept {
+    freeAligned(p);
+}
+
+void operator delete[](void *p, std::align_val_t, const std::nothrow_t &) noexcept {
+    freeAligned(p);
+}
+#endif
+
+#endif // NDEBUG
@@ -0,0 +1,31 @@
+#ifndef ALLOCATIONCOUNTER_HPP
+#define ALLOCATIONCOUNTER_HPP
+
+#include <stdint.h>
+
+namespace contourtree {
+
+/**
+ * Counts the heap allocations of the process while it exists. The global allocation
+ * functions that do the counting are replaced in AllocationCounter.cpp in debug builds
+ * only, so with NDEBUG the count is always 0.
+ */
+class AllocationCounter
+{
+public:
+    AllocationCounter();
+    ~AllocationCounter();
+
+    int64_t count() const;
+
+private:
+    int64_t start;
+
+private:
+    AllocationCounter(const AllocationCounter &);
+    AllocationCounter &operator=(const AllocationCounter &);
+};
+
+}
+
+#endif // ALLOCATIONCOUNTER_HPP
@@ -0,0 +1,51 @@
+#ifndef COMPONENTSET_HPP
+#define COMPONENTSET_HPP
+
+#include <vector>
+#include <cassert>
+
+namespace contourtree {
+
+/*
+ * Set of the distinct components in the link of a vertex. The capacity is fixed
+ * to the maximum degree of the function when the set is created, so clearing and
+ * refilling it for every vertex does not allocate. With at most a few tens of
+ * elements, a linear scan is cheaper than hashing.
+ */
+template <class T>
+class ComponentSet
+{
+public:
+    ComponentSet() : count(0) {}
+    ComponentSet(int capacity) : comps(capacity), count(0) {}
+
+    inline void clear() {
+        count = 0;
+    }
+
+    inline void insert(const T& comp) {
+        for(int i = 0;i < count;i ++) {
+            if(comps[i] == comp) {
+                return;
+            }
+        }
+        assert(count < (int)comps.size());
+        comps[count ++] = comp;
+    }
+
+    inline int size() const {
+        return count;
+    }
+
+    inline const T& operator [](int i) const {
+        return comps[i];
+    }
+
+private:
+    std::vector<T> comps;
+    int count;
+};
+
+} // namespace
+
+#endif // COMPONENTSET_HPP
@@ -1,7 +1,8 @@
 #include "ContourTree.hpp"
 #include "MergeTree.hpp"
+#include "ContourTreeData.hpp"
 #include <vector>
-#include <deque>
+#include <algorithm>
 #include <cassert>
 #include <QDebug>
 #include <fstream>
@@ -10,108 +11,242 @@
 
 namespace contourtree {
 
-ContourTree::ContourTree() {}
+template <class T>
+ContourTree<T>::ContourTree() {}
 
-void ContourTree::setup(const MergeTree *tree) {
+namespace {
+    // state of a vertex during the pruning
+    const char UNPRUNED = 0;
+    const char UPPER = 1;
+    const char LOWER = 2;
+
+    // rounds with fewer leaves than this are not worth a parallel pass
+    const int64_t MIN_PARALLEL_LEAVES = 4096;
+}
+
+template <class T>
+void ContourTree<T>::setup(const MergeTree<T> *tree) {
     qDebug() << "setting up merge process";
     this->tree = tree;
     nv = tree->data->getVertexCount();
-    nodesJoin.resize(nv);
-    nodesSplit.resize(nv);
-    ctNodes.resize(nv);
+    down = tree->prev;
+    up = tree->next;
+    upXor.assign(nv, 0);
+    downXor.assign(nv, 0);
+    noUp.assign(nv, 0);
+    noDown.assign(nv, 0);
+#pragma omp parallel for
     for(int64_t i = 0;i < nv;i ++) {
-        // init
-        nodesJoin[i].v = i;
-        nodesSplit[i].v = i;
-        ctNodes[i].v = i;
-
         // add join arcs
-        int64_t to = i;
-        int64_t from = tree->prev[to];
-        if(from != -1) {
-            nodesSplit[from].next.push_back(to);
-            nodesSplit[to].prev.push_back(from);
+        T from = down[i];
+        if(from != (T)(-1)) {
+#pragma omp atomic
+            noUp[from] ++;
+#pragma omp atomic
+            upXor[from] ^= (T)i;
         }
 
         // add split arcs
-        to = tree->next[i];
-        from = i;
-        if(to != -1) {
-            nodesJoin[from].next.push_back(to);
-            nodesJoin[to].prev.push_back(from);
+        T to = up[i];
+        if(to != (T)(-1)) {
+#pragma omp atomic
+            noDown[to] ++;
+#pragma omp atomic
+            downXor[to] ^= (T)i;
         }
     }
 }
 
-void ContourTree::computeCT() {
-    qDebug() << "merging join and split trees";
-    std::deque<int64_t> q;
-    for(int64_t v = 0;v < nv;v ++) {
-        Node &jn = nodesJoin[v];
-        Node &sn = nodesSplit[v];
-        if(sn.next.size() + jn.prev.size() == 1) {
-            q.push_back(v);
+template <class T>
+bool ContourTree<T>::isLeaf(T v) const {
+    return (pruned[v] == UNPRUNED && noUp[v] + noDown[v] == 1);
+}
+
+/**
+ * Removes a vertex with at most one child from a tree, connecting its child to its parent.
+ * Updates of the parent are atomic since it can be shared by several vertices pruned in parallel.
+ */
+template <class T>
+void ContourTree<T>::remove(T xi, std::vector<T> &parent, std::vector<T> &childXor, std::vector<uint16_t> &noChildren) {
+    T p = parent[xi];
+    if(noChildren[xi] == 1) {
+        T c = childXor[xi];
+        parent[c] = p;
+        if(p != (T)(-1)) {
+#pragma omp atomic
+            childXor[p] ^= (T)(xi ^ c);
+        }
+    } else {
+        assert(noChildren[xi] == 0);
+        if(p != (T)(-1)) {
+#pragma omp atomic
+            noChildren[p] --;
+#pragma omp atomic
+            childXor[p] ^= xi;
         }
     }
+}
 
-    while(q.size() > 0) {
-        int xi = q.front();
-        q.pop_front();
-        Node &jn = nodesJoin[xi];
-        Node &sn = nodesSplit[xi];
-        if(sn.next.size() == 0 && sn.prev.size() == 0) {
-            assert((jn.next.size() == 0 && jn.prev.size() == 0));
-            continue;
+/**
+ * Prunes a leaf and records its arc.
+ *
+ * @return the other end of the arc
+ */
+template <class T>
+T ContourTree<T>::pruneLeaf(T xi) {
+    T xj;
+    if(noUp[xi] == 0) {
+        // upper leaf, the arc goes down the join tree
+        xj = down[xi];
+        pruned[xi] = UPPER;
+    } else {
+        // lower leaf, the arc goes up the split tree
+        xj = up[xi];
+        pruned[xi] = LOWER;
+    }
+    assert(xj != (T)(-1) && xj < nv);
+    remove(xi, down, upXor, noUp);
+    remove(xi, up, downXor, noDown);
+    partner[xi] = xj;
+    return xj;
+}
+
+/**
+ * A leaf can be pruned in parallel with the other leaves of its round if none of
+ * its neighbours in the two trees is a leaf of the round with a smaller id.
+ */
+template <class T>
+bool ContourTree<T>::isIndependent(T xi, const std::vector<char> &inRound) const {
+    T nbrs[4] = {down[xi], up[xi], (T)(-1), (T)(-1)};
+    if(noUp[xi] == 1) {
+        nbrs[2] = upXor[xi];
+    }
+    if(noDown[xi] == 1) {
+        nbrs[3] = downXor[xi];
+    }
+    for(int i = 0;i < 4;i ++) {
+        if(nbrs[i] != (T)(-1) && nbrs[i] < xi && inRound[nbrs[i]]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <class T>
+void ContourTree<T>::computeCT(bool parallel) {
+    qDebug() << "merging join and split trees";
+    partner.assign(nv, -1);
+    pruned.assign(nv, UNPRUNED);
+
+    std::vector<T> leaves;
+    for(int64_t v = 0;v < nv;v ++) {
+        if(isLeaf(v)) {
+            leaves.push_back(v);
         }
+    }
 
-        if(sn.next.size() == 0) {
-            if(sn.prev.size() > 1) {
-                qDebug() << "Can this happen too???";
-                assert(false);
+    if(parallel) {
+        // prune the leaves in rounds of independent leaves, as long as there are enough of them
+        std::vector<char> inRound(nv, 0);
+        std::vector<char> selected;
+        while((int64_t)leaves.size() >= MIN_PARALLEL_LEAVES) {
+            int64_t noLeaves = leaves.size();
+            selected.assign(noLeaves, 0);
+#pragma omp parallel for
+            for(int64_t i = 0;i < noLeaves;i ++) {
+                inRound[leaves[i]] = 1;
             }
-            int xj = sn.prev[0];
-            remove(xi, nodesJoin);
-            remove(xi, nodesSplit);
-
-            int fr = xj;
-            int to = xi;
-            assert(fr < nv && to < nv);
-            addArc(fr, to);
-            if(nodesSplit[xj].next.size() + nodesJoin[xj].prev.size() == 1) {
-                q.push_back(xj);
+#pragma omp parallel for
+            for(int64_t i = 0;i < noLeaves;i ++) {
+                selected[i] = isIndependent(leaves[i], inRound);
             }
-        } else {
-            if(jn.next.size() > 1) {
-                qDebug() << "Can this happen too???";
-                assert(false);
+#pragma omp parallel for
+            for(int64_t i = 0;i < noLeaves;i ++) {
+                if(selected[i]) {
+                    pruneLeaf(leaves[i]);
+                }
+                inRound[leaves[i]] = 0;
             }
-            int xj = jn.next[0];
-            remove(xi, nodesJoin);
-            remove(xi, nodesSplit);
 
-            int fr = xi;
-            int to = xj;
-            assert(fr < nv && to < nv);
-            addArc(fr, to);
-
-            if(nodesSplit[xj].next.size() + nodesJoin[xj].prev.size() == 1) {
-                q.push_back(xj);
+            // the next round has the deferred leaves and the new ones
+            std::vector<T> next;
+            for(int64_t i = 0;i < noLeaves;i ++) {
+                T v = selected[i] ? partner[leaves[i]] : leaves[i];
+                if(isLeaf(v) && !inRound[v]) {
+                    inRound[v] = 1;
+                    next.push_back(v);
+                }
+            }
+            for(size_t i = 0;i < next.size();i ++) {
+                inRound[next[i]] = 0;
             }
+            leaves.swap(next);
+        }
+    }
+
+    while(leaves.size() > 0) {
+        T xi = leaves.back();
+        leaves.pop_back();
+        if(!isLeaf(xi)) {
+            continue;
+        }
+        T xj = pruneLeaf(xi);
+        if(isLeaf(xj)) {
+            leaves.push_back(xj);
         }
     }
+
+    // saving some memory
+    down = std::vector<T>();
+    up = std::vector<T>();
+    upXor = std::vector<T>();
+    downXor = std::vector<T>();
+    noUp = std::vector<uint16_t>();
+    noDown = std::vector<uint16_t>();
 }
 
-void ContourTree::output(QString fileName) {
+template <class T>
+void ContourTree<T>::output(QString fileName) {
     qDebug() << "removing deg-2 nodes and computing segmentation";
 
-    // saving some memory
-    nodesJoin.clear();
-    nodesJoin.shrink_to_fit();
-    nodesSplit.clear();
-    nodesSplit.shrink_to_fit();
+    // the contour tree in CSR form. The arcs going up from v are adj[offsets[v]] to
+    // adj[offsets[v + 1] - 1], sorted by vertex id so that the output does not depend
+    // on the order in which the leaves were pruned
+    std::vector<T> offsets(nv + 1, 0);
+    std::vector<uint16_t> noCtDown(nv, 0);
+    for(int64_t v = 0;v < nv;v ++) {
+        if(pruned[v] == UPPER) {
+            offsets[partner[v] + 1] ++;
+            noCtDown[v] ++;
+        } else if(pruned[v] == LOWER) {
+            offsets[v + 1] ++;
+            noCtDown[partner[v]] ++;
+        }
+    }
+    for(int64_t v = 0;v < nv;v ++) {
+        offsets[v + 1] += offsets[v];
+    }
+    std::vector<T> adj(offsets[nv]);
+    for(int64_t v = 0;v < nv;v ++) {
+        if(pruned[v] == UPPER) {
+            adj[offsets[partner[v]] ++] = v;
+        } else if(pruned[v] == LOWER) {
+            adj[offsets[v] ++] = partner[v];
+        }
+    }
+    for(int64_t v = nv;v > 0;v --) {
+        offsets[v] = offsets[v - 1];
+    }
+    offsets[0] = 0;
+    partner = std::vector<T>();
+    pruned = std::vector<char>();
+#pragma omp parallel for
+    for(int64_t v = 0;v < nv;v ++) {
+        std::sort(adj.begin() + offsets[v], adj.begin() + offsets[v + 1]);
+    }
 
     std::vector<int64_t> nodeids;
-    std::vector<unsigned char> nodefns;
+    std::vector<float> nodefns;
     std::vector<char> nodeTypes;
     std::vector<int64_t> arcs;
 
@@ -122,7 +257,7 @@ void ContourTree::output(QString fileName) {
         // go in sorted order
         int64_t v = tree->sv[i];
         // process only regular vertices
-        if(ctNodes[v].prev.size() == 1 && ctNodes[v].next.size() == 1) {
+        if(offsets[v + 1] - offsets[v] == 1 && noCtDown[v] == 1) {
             continue;
         }
         nodeids.push_back(v);
@@ -132,12 +267,12 @@ void ContourTree::output(QString fileName) {
         // create an arc for which this critical point is the source of the arc
         // traverse up for each of its arcs
         int64_t from = v;
-        for(int i = 0;i < ctNodes[v].next.size();i ++) {
-            int64_t vv = ctNodes[v].next[i];
-            while(ctNodes[vv].prev.size() == 1 && ctNodes[vv].next.size() == 1) {
+        for(T a = offsets[v];a < offsets[v + 1];a ++) {
+            int64_t vv = adj[a];
+            while(offsets[vv + 1] - offsets[vv] == 1 && noCtDown[vv] == 1) {
                 // regular
                 arcMap[vv] = arcNo;
-                vv = ctNodes[vv].next[0];
+                vv = adj[offsets[vv]];
             }
             arcMap[v] = arcNo;
             arcMap[vv] = arcNo;
@@ -157,22 +292,15 @@ void ContourTree::output(QString fileName) {
 
     // write meta data
     qDebug() << "Writing meta data";
-    {
-        QFile pr(fileName + ".rg.dat");
-        if(!pr.open(QFile::WriteOnly | QIODevice::Text)) {
-            qDebug() << "could not write to file" << fileName + ".rg.dat";
-        }
-        QTextStream text(&pr);
-        text << nodeids.size() << "\n";
-        text << arcNo << "\n";
-        pr.close();
-    }
+    float minVal, maxVal;
+    tree->getValueRange(minVal, maxVal);
+    ContourTreeData::writeMetaData(fileName, nodeids.size(), arcNo, tree->data->getValueType(), minVal, maxVal);
 
     qDebug() << "writing tree output";
     QString rgFile = fileName + ".rg.bin";
     std::ofstream of(rgFile.toStdString(),std::ios::binary);
     of.write((char *)nodeids.data(),nodeids.size() * sizeof(int64_t));
-    of.write((char *)nodefns.data(),nodeids.size());
+    ContourTreeData::writeFunctionValues(of, nodefns, tree->data->getValueType());
     of.write((char *)nodeTypes.data(),nodeids.size());
     of.write((char *)arcs.data(),arcs.size() * sizeof(int64_t));
     of.close();
@@ -184,57 +312,7 @@ void ContourTree::output(QString fileName) {
     of.close();
 }
 
-void ContourTree::remove(int64_t xi, std::vector<ContourTree::Node> &nodeArray) {
-    Node &jn = nodeArray[xi];
-
-    if(jn.prev.size() == 1 && jn.next.size() == 1) {
-        int64_t p = jn.prev[0];
-        int64_t n = jn.next[0];
-        Node &pn = nodeArray[p];
-        Node &nn = nodeArray[n];
-
-        removeAndAdd(pn.next, xi, nn.v);
-        removeAndAdd(nn.prev, xi, pn.v);
-    } else if(jn.prev.size() == 0 && jn.next.size() == 1) {
-        int n = jn.next[0];
-        Node &nn = nodeArray[n];
-        remove(nn.prev, xi);
-    } else if(jn.prev.size() == 1 && jn.next.size() == 0) {
-        int p = jn.prev[0];
-        Node &pn = nodeArray[p];
-        remove(pn.next, xi);
-    } else {
-        assert(false);
-    }
-}
-
-void ContourTree::removeAndAdd(std::vector<int64_t> &arr, int64_t rem, int64_t add) {
-    for(int i = 0;i < arr.size();i ++) {
-        if(arr[i] == rem) {
-            arr[i] = add;
-            return;
-        }
-    }
-    assert(false);
-}
-
-void ContourTree::remove(std::vector<int64_t> &arr, int64_t xi) {
-    for(int i = 0;i < arr.size();i ++) {
-        if(arr[i] == xi) {
-            if(i != arr.size() - 1) {
-                arr[i] = arr[arr.size() - 1];
-            }
-            arr.pop_back();
-            return;
-        }
-    }
-    assert(false);
-}
-
-void ContourTree::addArc(int64_t from, int64_t to) {
-    ctNodes[from].next.push_back(to);
-    ctNodes[to].prev.push_back(from);
-}
-
+template class ContourTree<int64_t>;
+template class ContourTree<uint32_t>;
 
 }
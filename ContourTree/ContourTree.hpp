@@ -3,38 +3,54 @@
 
 #include <QString>
 #include <vector>
+#include <stdint.h>
 
 namespace contourtree {
 
-class MergeTree;
-
+template <class T> class MergeTree;
+
+/**
+ * Merges the join and split trees of a MergeTree into the contour tree by pruning leaves.
+ *
+ * Both trees are stored with one pointer to the parent per vertex, the number of children,
+ * and the xor of the ids of the children, which is the child itself when there is only one.
+ * That is all the pruning needs to contract a vertex. Pruning a vertex creates exactly one
+ * arc of the contour tree, so the arcs are stored as the other end of the arc of every
+ * pruned vertex.
+ */
+template <class T>
 class ContourTree
 {
-public:
-    struct Node {
-        int64_t v;
-        std::vector<int64_t> next;
-        std::vector<int64_t> prev;
-    };
-
 public:
     ContourTree();
 
-    void setup(const MergeTree * tree);
-    void computeCT();
+    void setup(const MergeTree<T> * tree);
+    void computeCT(bool parallel = false);
     void output(QString fileName);
 
 private:
-    void remove(int64_t xi, std::vector<Node>& nodeArray);
-    void removeAndAdd(std::vector<int64_t> &arr, int64_t rem, int64_t add);
-    void remove(std::vector<int64_t> &arr, int64_t xi);
-    void addArc(int64_t from, int64_t to);
+    bool isLeaf(T v) const;
+    T pruneLeaf(T xi);
+    void remove(T xi, std::vector<T> &parent, std::vector<T> &childXor, std::vector<uint16_t> &noChildren);
+    bool isIndependent(T xi, const std::vector<char> &inRound) const;
 
 public:
-    const MergeTree * tree;
-    std::vector<Node> nodesJoin;
-    std::vector<Node> nodesSplit;
-    std::vector<Node> ctNodes;
+    const MergeTree<T> * tree;
+
+    // join tree, where down[v] is the vertex below v
+    std::vector<T> down;
+    std::vector<T> upXor;
+    std::vector<uint16_t> noUp;
+
+    // split tree, where up[v] is the vertex above v
+    std::vector<T> up;
+    std::vector<T> downXor;
+    std::vector<uint16_t> noDown;
+
+    // contour tree arc of every pruned vertex
+    std::vector<T> partner;
+    std::vector<char> pruned;
+
     std::vector<uint32_t> arcMap;
 
     int64_t nv;
@@ -12,19 +12,28 @@ SOURCES += main.cpp \
     MergeTree.cpp \
     Grid3D.cpp \
     SimplifyCT.cpp \
+    SimplificationHierarchy.cpp \
     ContourTreeData.cpp \
     Persistence.cpp \
     TriMesh.cpp \
     TopologicalFeatures.cpp \
     HyperVolume.cpp \
-    ContourTree.cpp
+    ContourTree.cpp \
+    StreamingMergeTree.cpp \
+    MappedFile.cpp \
+    ContourTreeFile.cpp \
+    PartitionFile.cpp \
+    AllocationCounter.cpp
 
 HEADERS += \
     DisjointSets.hpp \
+    ComponentSet.hpp \
+    IndexedHeap.hpp \
     MergeTree.hpp \
     ScalarFunction.hpp \
     Grid3D.hpp \
     SimplifyCT.hpp \
+    SimplificationHierarchy.hpp \
     ContourTreeData.hpp \
     constants.h \
     SimFunction.hpp \
@@ -33,6 +42,12 @@ HEADERS += \
     TopologicalFeatures.hpp \
     HyperVolume.hpp \
     ContourTree.hpp \
+    StreamingMergeTree.hpp \
+    MappedFile.hpp \
+    ContourTreeFile.hpp \
+    PartitionFile.hpp \
+    AllocationCounter.hpp \
+    Feathering.hpp \
     test.hpp
 
 # Unix configuration
@@ -45,6 +60,7 @@ unix:!macx{
 
 win32{
     CONFIG += console
+    QMAKE_CXXFLAGS += -openmp
     INCLUDEPATH += "$$(BOOST_PATH)"
     INCLUDEPATH += "$$(UniversalCRT_IncludePath)"
 
@@ -4,17 +4,58 @@
 #include <QTextStream>
 #include <fstream>
 #include <cassert>
+#include <algorithm>
 #include <QDebug>
 #include "constants.h"
+#include "ContourTreeFile.hpp"
 
 namespace contourtree {
 
-ContourTreeData::ContourTreeData() {
+namespace {
+    /**
+     * LSD radix sort of non-negative keys by bytes, moving vals along with them. Bytes
+     * that are the same in all keys are skipped, so vertex ids below 2^32 need at most
+     * four passes.
+     */
+    void radixSort(std::vector<int64_t> &keys, std::vector<uint32_t> &vals) {
+        size_t n = keys.size();
+        std::vector<int64_t> tmpKeys(n);
+        std::vector<uint32_t> tmpVals(n);
+        for(int shift = 0;shift < 64;shift += 8) {
+            size_t count[257] = {0};
+            for(size_t i = 0;i < n;i ++) {
+                count[((uint64_t)keys[i] >> shift & 0xFF) + 1] ++;
+            }
+            bool constant = false;
+            for(int d = 0;d < 256;d ++) {
+                constant = constant || (count[d + 1] == n);
+                count[d + 1] += count[d];
+            }
+            if(constant) {
+                continue;
+            }
+            for(size_t i = 0;i < n;i ++) {
+                size_t pos = count[(uint64_t)keys[i] >> shift & 0xFF] ++;
+                tmpKeys[pos] = keys[i];
+                tmpVals[pos] = vals[i];
+            }
+            keys.swap(tmpKeys);
+            vals.swap(tmpVals);
+        }
+    }
+}
+
+ContourTreeData::ContourTreeData() :
+    noNodes(0), noArcs(0), valueType(TypeUInt8), minVal(0), maxVal(255)
+{
 
 }
 
 void ContourTreeData::loadBinFile(QString fileName) {
     // read meta data
+    valueType = TypeUInt8;
+    double low = 0;
+    double high = 255;
     {
         QFile ip(fileName + ".rg.dat");
         if(!ip.open(QFile::ReadOnly | QIODevice::Text)) {
@@ -24,12 +65,25 @@ void ContourTreeData::loadBinFile(QString fileName) {
         noNodes = text.readLine().toLongLong();
         noArcs = text.readLine().toLongLong();
         assert(noNodes == noArcs + 1);
+        // optional for unsigned char data
+        QStringList line = text.readLine().split(" ");
+        if(line.size() == 3) {
+            if(line[0] == "uint16") {
+                valueType = TypeUInt16;
+            } else if(line[0] == "float") {
+                valueType = TypeFloat;
+            }
+            low = line[1].toDouble();
+            high = line[2].toDouble();
+        }
         ip.close();
     }
+    minVal = low;
+    maxVal = high;
     qDebug() << noNodes << noArcs;
 
     std::vector<int64_t> nodeids(noNodes);
-    std::vector<unsigned char> nodefns(noNodes);
+    std::vector<float> nodefns(noNodes);
     std::vector<char> nodeTypes(noNodes);
     std::vector<int64_t> arcs(noArcs * 2);
 
@@ -37,11 +91,26 @@ void ContourTreeData::loadBinFile(QString fileName) {
     QString rgFile = fileName + ".rg.bin";
     std::ifstream ip(rgFile.toStdString(), std::ios::binary);
     ip.read((char *)nodeids.data(),nodeids.size() * sizeof(int64_t));
-    ip.read((char *)nodefns.data(),nodeids.size());
+    if(valueType == TypeUInt8) {
+        std::vector<unsigned char> fns(noNodes);
+        ip.read((char *)fns.data(),fns.size());
+        std::copy(fns.begin(), fns.end(), nodefns.begin());
+    } else if(valueType == TypeUInt16) {
+        std::vector<uint16_t> fns(noNodes);
+        ip.read((char *)fns.data(),fns.size() * sizeof(uint16_t));
+        std::copy(fns.begin(), fns.end(), nodefns.begin());
+    } else {
+        ip.read((char *)nodefns.data(),nodefns.size() * sizeof(float));
+    }
     ip.read((char *)nodeTypes.data(),nodeids.size());
     ip.read((char *)arcs.data(),arcs.size() * sizeof(int64_t));
     ip.close();
 
+    double range = (high > low) ? (high - low) : 1;
+    for(size_t i = 0;i < noNodes;i ++) {
+        nodefns[i] = (float)((nodefns[i] - low) / range);
+    }
+
     qDebug() << "finished reading data";
     this->loadData(nodeids,nodefns,nodeTypes,arcs);
 }
@@ -56,9 +125,12 @@ void ContourTreeData::loadTxtFile(QString fileName) {
     QStringList line = text.readLine().split(" ");
     noNodes = QString(line[0]).toInt();
     noArcs = QString(line[1]).toInt();
+    valueType = TypeUInt8;
+    minVal = 0;
+    maxVal = 255;
 
     std::vector<int64_t> nodeids(noNodes);
-    std::vector<unsigned char> nodefns(noNodes);
+    std::vector<float> nodefns(noNodes);
     std::vector<char> nodeTypes(noNodes);
     std::vector<int64_t> arcs(noArcs * 2);
 
@@ -77,7 +149,7 @@ void ContourTreeData::loadTxtFile(QString fileName) {
             t = REGULAR;
         }
         nodeids[i] = v;
-        nodefns[i] = (unsigned char)(fn);
+        nodefns[i] = (float)((unsigned char)(fn) / 255.);
         nodeTypes[i] = t;
     }
     for(size_t i = 0;i < noArcs;i ++) {
@@ -92,28 +164,147 @@ void ContourTreeData::loadTxtFile(QString fileName) {
     this->loadData(nodeids,nodefns, nodeTypes,arcs);
 }
 
-void ContourTreeData::loadData(const std::vector<int64_t> &nodeids, const std::vector<unsigned char> &nodefns, const std::vector<char> &nodeTypes, const std::vector<int64_t> &iarcs) {
-    nodes.resize(noNodes);
-    nodeVerts.resize(noNodes);
-    fnVals.resize(noNodes);
-    type.resize(noNodes);
-    arcs.resize(noArcs);
+void ContourTreeData::writeMetaData(QString fileName, uint32_t noNodes, uint32_t noArcs, ValueType valueType, float minVal, float maxVal) {
+    QFile pr(fileName + ".rg.dat");
+    if(!pr.open(QFile::WriteOnly | QIODevice::Text)) {
+        qDebug() << "could not write to file" << fileName + ".rg.dat";
+    }
+    QTextStream text(&pr);
+    text << noNodes << "\n";
+    text << noArcs << "\n";
+    // the value range is used to normalize the function values when loading
+    if(valueType == TypeUInt16) {
+        text << "uint16 " << minVal << " " << maxVal << "\n";
+    } else if(valueType == TypeFloat) {
+        text.setRealNumberPrecision(9);
+        text << "float " << minVal << " " << maxVal << "\n";
+    }
+    pr.close();
+}
 
+void ContourTreeData::writeFunctionValues(std::ofstream &of, const std::vector<float> &nodefns, ValueType valueType) {
+    if(valueType == TypeUInt8) {
+        std::vector<unsigned char> fns(nodefns.begin(), nodefns.end());
+        of.write((char *)fns.data(),fns.size());
+    } else if(valueType == TypeUInt16) {
+        std::vector<uint16_t> fns(nodefns.begin(), nodefns.end());
+        of.write((char *)fns.data(),fns.size() * sizeof(uint16_t));
+    } else {
+        of.write((char *)nodefns.data(),nodefns.size() * sizeof(float));
+    }
+}
+
+/**
+ * Uses the tree stored in a container file in place, which stays mapped as long as
+ * any copy of this data refers to it.
+ *
+ * @return false if the file does not contain a complete tree
+ */
+bool ContourTreeData::loadTreeFile(const std::shared_ptr<const ContourTreeFile> &file) {
+    uint64_t noVerts, noFns, noTypes, noTreeArcs;
+    const int64_t *fileVerts = file->section<int64_t>(SectionNodeVerts, noVerts);
+    const float *fileFns = file->section<float>(SectionFnVals, noFns);
+    const char *fileTypes = file->section<char>(SectionNodeTypes, noTypes);
+    const Arc *fileArcs = file->section<Arc>(SectionArcs, noTreeArcs);
+    noNodes = file->header.noNodes;
+    noArcs = file->header.noArcs;
+    if(fileVerts == NULL || fileFns == NULL || fileTypes == NULL || fileArcs == NULL
+            || noVerts != noNodes || noFns != noNodes || noTypes != noNodes || noTreeArcs != noArcs) {
+        qDebug() << "incomplete contour tree file";
+        noNodes = noArcs = 0;
+        return false;
+    }
+    valueType = (ValueType)file->header.valueType;
+    minVal = file->header.minVal;
+    maxVal = file->header.maxVal;
+
+    nodeVerts.assign(fileVerts, noNodes, file);
+    fnVals.assign(fileFns, noNodes, file);
+    type.assign(fileTypes, noNodes, file);
+    arcs.assign(fileArcs, noArcs, file);
+    if(!buildAdjacency()) {
+        qDebug() << "contour tree file has arcs between nodes that do not exist";
+        noNodes = noArcs = 0;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Maps the vertex ids of the arcs to node indices by sorting both the nodes and the arc
+ * end points by vertex id and merging the two lists, which takes linear time.
+ * The input vectors are consumed.
+ */
+void ContourTreeData::loadData(std::vector<int64_t> &nodeids, std::vector<float> &nodefns, std::vector<char> &nodeTypes, std::vector<int64_t> &iarcs) {
+    std::vector<int64_t> sortedVerts(nodeids);
+    std::vector<uint32_t> sortedNodes(noNodes);
     for(uint32_t i = 0;i < noNodes;i ++) {
-        nodeVerts[i] = nodeids[i];
-        // TODO hard coding again.
-        fnVals[i] = (float)(nodefns[i]) / 255.;
-        type[i] = nodeTypes[i];
-        nodeMap[nodeVerts[i]] = i;
+        sortedNodes[i] = i;
     }
+    radixSort(sortedVerts, sortedNodes);
 
+    // end point e is the start of arc e / 2 if e is even, and its end otherwise
+    std::vector<uint32_t> ends(noArcs * 2);
+    for(uint32_t e = 0;e < noArcs * 2;e ++) {
+        ends[e] = e;
+    }
+    radixSort(iarcs, ends);
+
+    std::vector<Arc> treeArcs(noArcs);
+    uint32_t n = 0;
+    for(uint32_t e = 0;e < noArcs * 2;e ++) {
+        while(n + 1 < noNodes && sortedVerts[n] < iarcs[e]) {
+            n ++;
+        }
+        assert(sortedVerts[n] == iarcs[e]);
+        Arc &arc = treeArcs[ends[e] / 2];
+        if(ends[e] % 2 == 0) {
+            arc.from = sortedNodes[n];
+        } else {
+            arc.to = sortedNodes[n];
+        }
+    }
+    for(uint32_t i = 0;i < noArcs;i ++) {
+        treeArcs[i].id = i;
+    }
+
+    nodeVerts.assign(nodeids);
+    fnVals.assign(nodefns);
+    type.assign(nodeTypes);
+    arcs.assign(treeArcs);
+    buildAdjacency();
+}
+
+/**
+ * Builds the CSR adjacency in two passes over the arcs, keeping the arcs of every node
+ * in the order of their ids.
+ *
+ * @return false if an arc refers to a node that does not exist, which can only happen
+ * for arcs that were mapped from a damaged file
+ */
+bool ContourTreeData::buildAdjacency() {
+    nextOffsets.assign(noNodes + 1, 0);
+    prevOffsets.assign(noNodes + 1, 0);
+    for(uint32_t i = 0;i < noArcs;i ++) {
+        if(arcs[i].from >= noNodes || arcs[i].to >= noNodes) {
+            return false;
+        }
+        nextOffsets[arcs[i].from + 1] ++;
+        prevOffsets[arcs[i].to + 1] ++;
+    }
+    for(uint32_t n = 0;n < noNodes;n ++) {
+        nextOffsets[n + 1] += nextOffsets[n];
+        prevOffsets[n + 1] += prevOffsets[n];
+    }
+    nextArcs.resize(noArcs);
+    prevArcs.resize(noArcs);
+    std::vector<uint32_t> nextPos(nextOffsets.begin(), nextOffsets.end() - 1);
+    std::vector<uint32_t> prevPos(prevOffsets.begin(), prevOffsets.end() - 1);
     for(uint32_t i = 0;i < noArcs;i ++) {
-        arcs[i].from = nodeMap[iarcs[i * 2 + 0]];
-        arcs[i].to = nodeMap[iarcs[i * 2 + 1]];
-        arcs[i].id = i;
-        nodes[arcs[i].from].next << i;
-        nodes[arcs[i].to].prev << i;
+        nextArcs[nextPos[arcs[i].from] ++] = i;
+        prevArcs[prevPos[arcs[i].to] ++] = i;
     }
+    return true;
 }
 
 } // namespace
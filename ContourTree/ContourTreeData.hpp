@@ -2,22 +2,58 @@
 #define CONTOURTREEDATA_HPP
 
 #include <stdint.h>
-#include <QVector>
-#include <QHash>
+#include <QString>
+#include <vector>
+#include <fstream>
+#include <memory>
+#include "constants.h"
 
 namespace contourtree {
 
-struct Node {
-    QVector<uint32_t> next;
-    QVector<uint32_t> prev;
-};
-
 struct Arc {
     uint32_t from;
     uint32_t to;
     uint32_t id;
 };
 
+/**
+ * Read-only array that either owns its elements or points into a mapped file.
+ * Copies share the storage, which is released with the last copy.
+ */
+template <class T>
+class SharedArray
+{
+public:
+    SharedArray() : ptr(NULL), count(0) {}
+
+    // takes over the elements of vals
+    void assign(std::vector<T> &vals) {
+        std::shared_ptr<std::vector<T> > store = std::make_shared<std::vector<T> >();
+        store->swap(vals);
+        ptr = store->data();
+        count = store->size();
+        storage = store;
+    }
+
+    // refers to elements owned by storage
+    void assign(const T *vals, size_t size, const std::shared_ptr<const void> &storage) {
+        ptr = vals;
+        count = size;
+        this->storage = storage;
+    }
+
+    const T &operator[](size_t i) const { return ptr[i]; }
+    const T *data() const { return ptr; }
+    size_t size() const { return count; }
+
+private:
+    const T *ptr;
+    size_t count;
+    std::shared_ptr<const void> storage;
+};
+
+class ContourTreeFile;
+
 class ContourTreeData
 {
 public:
@@ -25,21 +61,40 @@ public:
 
     void loadBinFile(QString fileName);
     void loadTxtFile(QString fileName);
+    bool loadTreeFile(const std::shared_ptr<const ContourTreeFile> &file);
+
+    // used by the tree computations to write the .rg.dat file and the function values in .rg.bin
+    static void writeMetaData(QString fileName, uint32_t noNodes, uint32_t noArcs, ValueType valueType, float minVal, float maxVal);
+    static void writeFunctionValues(std::ofstream &of, const std::vector<float> &nodefns, ValueType valueType);
 
 protected:
-    void loadData(const std::vector<int64_t>& nodeids, const std::vector<unsigned char>& nodefns, const std::vector<char>& nodeTypes, const std::vector<int64_t>& iarcs);
+    void loadData(std::vector<int64_t>& nodeids, std::vector<float>& nodefns, std::vector<char>& nodeTypes, std::vector<int64_t>& iarcs);
 
 public:
     uint32_t noNodes;
     uint32_t noArcs;
 
-    QVector<Node> nodes;
-    QVector<Arc> arcs;
-    QVector<float> fnVals;
-    QVector<char> type;
-    QVector<int64_t> nodeVerts;
+    // the arrays are used in place when loaded from a .ctree file
+    SharedArray<Arc> arcs;
+    // function values normalized to [0, 1] using the value range of the input
+    SharedArray<float> fnVals;
+    SharedArray<char> type;
+    SharedArray<int64_t> nodeVerts;
 
-    QHash<int64_t, uint32_t> nodeMap;
+    // storage type and value range of the input
+    ValueType valueType;
+    float minVal;
+    float maxVal;
+
+    // adjacency in CSR form, the arcs going up from node n are
+    // nextArcs[nextOffsets[n]] to nextArcs[nextOffsets[n + 1] - 1], and likewise going down
+    std::vector<uint32_t> nextOffsets;
+    std::vector<uint32_t> nextArcs;
+    std::vector<uint32_t> prevOffsets;
+    std::vector<uint32_t> prevArcs;
+
+protected:
+    bool buildAdjacency();
 };
 
 } // namespace contourtree
@@ -0,0 +1,186 @@
+#include "ContourTreeFile.hpp"
+#include "ContourTreeData.hpp"
+#include "SimplificationHierarchy.hpp"
+
+#include <fstream>
+#include <cstring>
+#include <QDebug>
+
+namespace contourtree {
+
+namespace {
+    const char MAGIC[8] = {'C', 'T', 'R', 'E', 'E', 'B', 'I', 'N'};
+    const uint32_t ENDIAN_MARK = 0x01020304;
+
+    struct SectionData {
+        SectionId id;
+        uint32_t elementSize;
+        uint64_t count;
+        const char *data;
+    };
+
+    uint64_t align(uint64_t offset) {
+        return (offset + ContourTreeFile::ALIGNMENT - 1) / ContourTreeFile::ALIGNMENT * ContourTreeFile::ALIGNMENT;
+    }
+
+    uint64_t headerChecksum(FileHeader header) {
+        header.headerChecksum = 0;
+        return ContourTreeFile::checksum((const char *)&header, sizeof(FileHeader));
+    }
+}
+
+ContourTreeFile::ContourTreeFile() : table(NULL) {
+    memset(&header, 0, sizeof(FileHeader));
+}
+
+/**
+ * 64 bit FNV-1a hash.
+ */
+uint64_t ContourTreeFile::checksum(const char *data, uint64_t size) {
+    uint64_t hash = 14695981039346656037ULL;
+    for(uint64_t i = 0;i < size;i ++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+bool ContourTreeFile::write(QString fileName, const ContourTreeData &data, const std::vector<uint32_t> &order, const std::vector<float> &wts,
+                            const SimplificationHierarchy *hierarchy) {
+    std::vector<SectionData> sections;
+    SectionData sd;
+    sd.id = SectionNodeVerts; sd.elementSize = sizeof(int64_t); sd.count = data.noNodes; sd.data = (const char *)data.nodeVerts.data();
+    sections.push_back(sd);
+    sd.id = SectionFnVals; sd.elementSize = sizeof(float); sd.count = data.noNodes; sd.data = (const char *)data.fnVals.data();
+    sections.push_back(sd);
+    sd.id = SectionNodeTypes; sd.elementSize = sizeof(char); sd.count = data.noNodes; sd.data = (const char *)data.type.data();
+    sections.push_back(sd);
+    sd.id = SectionArcs; sd.elementSize = sizeof(Arc); sd.count = data.noArcs; sd.data = (const char *)data.arcs.data();
+    sections.push_back(sd);
+    sd.id = SectionOrder; sd.elementSize = sizeof(uint32_t); sd.count = order.size(); sd.data = (const char *)order.data();
+    sections.push_back(sd);
+    sd.id = SectionWeights; sd.elementSize = sizeof(float); sd.count = wts.size(); sd.data = (const char *)wts.data();
+    sections.push_back(sd);
+    if(hierarchy != NULL && !hierarchy->isEmpty()) {
+        sd.id = SectionHierarchy; sd.elementSize = sizeof(HierarchyBranch); sd.count = hierarchy->branches.size(); sd.data = (const char *)hierarchy->branches.data();
+        sections.push_back(sd);
+        sd.id = SectionHierarchyChildren; sd.elementSize = sizeof(HierarchyChild); sd.count = hierarchy->children.size(); sd.data = (const char *)hierarchy->children.data();
+        sections.push_back(sd);
+        sd.id = SectionHierarchyLayout; sd.elementSize = sizeof(uint32_t); sd.count = hierarchy->layout.size(); sd.data = (const char *)hierarchy->layout.data();
+        sections.push_back(sd);
+    }
+
+    std::vector<SectionEntry> entries(sections.size());
+    uint64_t offset = align(sizeof(FileHeader) + entries.size() * sizeof(SectionEntry));
+    for(size_t i = 0;i < sections.size();i ++) {
+        entries[i].id = sections[i].id;
+        entries[i].elementSize = sections[i].elementSize;
+        entries[i].offset = offset;
+        entries[i].count = sections[i].count;
+        entries[i].checksum = checksum(sections[i].data, sections[i].count * sections[i].elementSize);
+        offset = align(offset + sections[i].count * sections[i].elementSize);
+    }
+
+    FileHeader header;
+    memset(&header, 0, sizeof(FileHeader));
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.byteOrder = ENDIAN_MARK;
+    header.noNodes = data.noNodes;
+    header.noArcs = data.noArcs;
+    header.valueType = data.valueType;
+    header.minVal = data.minVal;
+    header.maxVal = data.maxVal;
+    header.noSections = entries.size();
+    header.tableChecksum = checksum((const char *)entries.data(), entries.size() * sizeof(SectionEntry));
+    header.headerChecksum = headerChecksum(header);
+
+    std::ofstream of(fileName.toStdString(), std::ios::binary);
+    if(!of.is_open()) {
+        qDebug() << "could not write to file" << fileName;
+        return false;
+    }
+    of.write((const char *)&header, sizeof(FileHeader));
+    of.write((const char *)entries.data(), entries.size() * sizeof(SectionEntry));
+    const char padding[ALIGNMENT] = {0};
+    uint64_t pos = sizeof(FileHeader) + entries.size() * sizeof(SectionEntry);
+    for(size_t i = 0;i < sections.size();i ++) {
+        of.write(padding, entries[i].offset - pos);
+        of.write(sections[i].data, sections[i].count * sections[i].elementSize);
+        pos = entries[i].offset + sections[i].count * sections[i].elementSize;
+    }
+    of.close();
+    return !of.fail();
+}
+
+/**
+ * Maps the file and checks its header and section table, and with verify set also the
+ * checksums of all the sections.
+ *
+ * @return false if the file could not be mapped or is not a valid container
+ */
+bool ContourTreeFile::open(QString fileName, bool verify) {
+    table = NULL;
+    if(!file.map(fileName)) {
+        return false;
+    }
+    uint64_t size = file.size();
+    if(size < sizeof(FileHeader)) {
+        qDebug() << "not a contour tree file" << fileName;
+        file.unmap();
+        return false;
+    }
+    memcpy(&header, file.data(), sizeof(FileHeader));
+    if(memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.byteOrder != ENDIAN_MARK) {
+        qDebug() << "not a contour tree file" << fileName;
+        file.unmap();
+        return false;
+    }
+    if(header.version != VERSION) {
+        qDebug() << "unsupported version" << header.version << "of" << fileName;
+        file.unmap();
+        return false;
+    }
+    if(header.headerChecksum != headerChecksum(header)
+            || size < sizeof(FileHeader) + uint64_t(header.noSections) * sizeof(SectionEntry)) {
+        qDebug() << "corrupt header in" << fileName;
+        file.unmap();
+        return false;
+    }
+    const SectionEntry *entries = (const SectionEntry *)(file.data() + sizeof(FileHeader));
+    if(header.tableChecksum != checksum((const char *)entries, header.noSections * sizeof(SectionEntry))) {
+        qDebug() << "corrupt section table in" << fileName;
+        file.unmap();
+        return false;
+    }
+    for(uint32_t i = 0;i < header.noSections;i ++) {
+        const SectionEntry &entry = entries[i];
+        if(entry.offset % ALIGNMENT != 0 || entry.offset > size
+                || (entry.elementSize > 0 && entry.count > (size - entry.offset) / entry.elementSize)) {
+            qDebug() << "section" << entry.id << "out of bounds in" << fileName;
+            file.unmap();
+            return false;
+        }
+        if(verify && entry.checksum != checksum(file.data() + entry.offset, entry.count * entry.elementSize)) {
+            qDebug() << "checksum mismatch in section" << entry.id << "of" << fileName;
+            file.unmap();
+            return false;
+        }
+    }
+    table = entries;
+    return true;
+}
+
+const SectionEntry *ContourTreeFile::findSection(SectionId id) const {
+    if(table == NULL) {
+        return NULL;
+    }
+    for(uint32_t i = 0;i < header.noSections;i ++) {
+        if(table[i].id == (uint32_t)id) {
+            return &table[i];
+        }
+    }
+    return NULL;
+}
+
+}
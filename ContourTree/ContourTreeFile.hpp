@@ -0,0 +1,107 @@
+#ifndef CONTOURTREEFILE_HPP
+#define CONTOURTREEFILE_HPP
+
+#include "MappedFile.hpp"
+#include <QString>
+#include <stdint.h>
+#include <vector>
+
+namespace contourtree {
+
+class ContourTreeData;
+class SimplificationHierarchy;
+
+enum SectionId {
+    SectionNodeVerts = 1,   // int64_t vertex id of every node
+    SectionFnVals = 2,      // float function value of every node, normalized to [0, 1]
+    SectionNodeTypes = 3,   // char type of every node
+    SectionArcs = 4,        // Arc between node indices
+    SectionOrder = 5,       // uint32_t branch order of the simplification
+    SectionWeights = 6,     // float normalized weight of every branch in the order
+    SectionHierarchy = 7,           // HierarchyBranch of every branch
+    SectionHierarchyChildren = 8,   // HierarchyChild of every join
+    SectionHierarchyLayout = 9      // uint32_t branches in the order of the hierarchy
+};
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    // written as 0x01020304 to detect files from machines with another byte order
+    uint32_t byteOrder;
+    uint32_t noNodes;
+    uint32_t noArcs;
+    uint32_t valueType;
+    // value range of the input that the function values were normalized with
+    float minVal;
+    float maxVal;
+    uint32_t noSections;
+    uint64_t tableChecksum;
+    // checksum of the header with this field set to 0
+    uint64_t headerChecksum;
+    uint64_t reserved;
+};
+
+struct SectionEntry {
+    uint32_t id;
+    uint32_t elementSize;
+    uint64_t offset;
+    uint64_t count;
+    uint64_t checksum;
+};
+
+/**
+ * Single file container (.ctree) for a contour tree and its branch order, replacing
+ * the .rg.dat, .rg.bin, .order.dat and .order.bin files.
+ *
+ * The file has a header, a table of sections and the sections, each one array in native
+ * byte order aligned to 64 bytes. The file is opened with a read-only mapping and the
+ * arrays are used in place, so opening it only reads the header and the table.
+ * The header and the table are always checked, the sections only on request since
+ * that reads the whole file.
+ */
+class ContourTreeFile
+{
+public:
+    static const uint32_t VERSION = 1;
+    static const uint64_t ALIGNMENT = 64;
+
+    ContourTreeFile();
+
+    static bool write(QString fileName, const ContourTreeData &data, const std::vector<uint32_t> &order, const std::vector<float> &wts,
+                      const SimplificationHierarchy *hierarchy = NULL);
+    static uint64_t checksum(const char *data, uint64_t size);
+
+    bool open(QString fileName, bool verify = false);
+
+    template <class T>
+    const T *section(SectionId id, uint64_t &count) const;
+
+protected:
+    const SectionEntry *findSection(SectionId id) const;
+
+public:
+    FileHeader header;
+
+protected:
+    MappedFile file;
+    const SectionEntry *table;
+};
+
+/**
+ * @return the array stored in the section, or NULL if there is no such section or its
+ * elements are not of type T
+ */
+template <class T>
+const T *ContourTreeFile::section(SectionId id, uint64_t &count) const {
+    const SectionEntry *entry = findSection(id);
+    if(entry == NULL || entry->elementSize != sizeof(T)) {
+        count = 0;
+        return NULL;
+    }
+    count = entry->count;
+    return (const T *)(file.data() + entry->offset);
+}
+
+}
+
+#endif // CONTOURTREEFILE_HPP
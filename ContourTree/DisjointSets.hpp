@@ -4,17 +4,21 @@
 #include <stdint.h>
 #include <vector>
 #include <cassert>
+#include <atomic>
+#include <algorithm>
 
 namespace contourtree {
 
 /*
- * Assumes signed primitives
+ * Works with signed and unsigned primitives. Roots are marked with (T)(-1),
+ * so unsigned types can address all but their largest value.
  */
 template <class T>
 class DisjointSets
 {
 public:
     std::vector<T> set;
+    std::vector<unsigned char> height;
 
 public:
     DisjointSets(){}
@@ -22,6 +26,7 @@ public:
 
     void merge(const T& ele1, const T& ele2);
     T find(const T& x);
+    void reset(const T& x);
 
 private:
     void mergeSet(const T& root1, const T& root2);
@@ -31,6 +36,7 @@ private:
 template <class T>
 DisjointSets<T>::DisjointSets(uint64_t size) {
     set.resize(size, (T)(-1));
+    height.resize(size, 0);
 }
 
 template<class T>
@@ -39,7 +45,8 @@ void DisjointSets<T>::merge(const T &ele1, const T &ele2) {
 }
 
 /**
- * Perform a find with path compression.
+ * Perform an iterative find with path halving, so that long chains such as
+ * monotone ramps do not exhaust the stack.
  *
  * @param x
  *            the element being searched for.
@@ -47,14 +54,28 @@ void DisjointSets<T>::merge(const T &ele1, const T &ele2) {
  */
 template<class T>
 T DisjointSets<T>::find(const T &x) {
-    T f = set[x];
-    if (f < 0) {
-        return x;
-    } else {
-        int xx = find(f);
-        set[x] = xx;
-        return xx;
+    T c = x;
+    T p = set[c];
+    while (p != (T)(-1)) {
+        T gp = set[p];
+        if (gp == (T)(-1)) {
+            return p;
+        }
+        // point to the grand parent and skip it
+        set[c] = gp;
+        c = gp;
+        p = set[c];
     }
+    return c;
+}
+
+/**
+ * Make x a singleton set again. Only valid if no other element refers to x.
+ */
+template<class T>
+void DisjointSets<T>::reset(const T &x) {
+    set[x] = (T)(-1);
+    height[x] = 0;
 }
 
 /**
@@ -71,24 +92,90 @@ void DisjointSets<T>::mergeSet(const T& root1, const T& root2) {
     if (root1 == root2)
         return;
 
-    int r1 = set[root1];
-    int r2 = set[root2];
+    unsigned char h1 = height[root1];
+    unsigned char h2 = height[root2];
 
-    if (r2 < r1) {
+    if (h2 > h1) {
         set[root1] = root2;
     } else {
-        if (r1 == r2) {
+        if (h1 == h2) {
             // Update height if same
-            r1--;
-            set[root1] = r1;
+            height[root1] = h1 + 1;
         }
         // Make root1 new root
         set[root2] = root1;
     }
 }
 
+/*
+ * Lock-free variant that can be shared by several threads. Roots are linked
+ * with a compare-and-swap under the root with the smaller index, so parents
+ * always have smaller indices than their children and no cycles can form.
+ * find uses path halving, where a failed update is harmless since it only
+ * means another thread already shortened the path.
+ */
+template <class T>
+class ConcurrentDisjointSets
+{
+public:
+    std::vector<std::atomic<T> > set;
+
+public:
+    ConcurrentDisjointSets(uint64_t size);
+
+    bool merge(T ele1, T ele2);
+    T find(T x);
+};
+
+template <class T>
+ConcurrentDisjointSets<T>::ConcurrentDisjointSets(uint64_t size) : set(size) {
+#pragma omp parallel for
+    for (int64_t i = 0; i < (int64_t)size; i++) {
+        set[i].store((T)(-1), std::memory_order_relaxed);
+    }
+}
+
+template <class T>
+T ConcurrentDisjointSets<T>::find(T x) {
+    while (true) {
+        T p = set[x].load(std::memory_order_acquire);
+        if (p == (T)(-1)) {
+            return x;
+        }
+        T gp = set[p].load(std::memory_order_acquire);
+        if (gp == (T)(-1)) {
+            return p;
+        }
+        set[x].compare_exchange_weak(p, gp, std::memory_order_release, std::memory_order_relaxed);
+        x = gp;
+    }
+}
+
+/**
+ * @return false if ele1 and ele2 were already in the same set.
+ */
+template <class T>
+bool ConcurrentDisjointSets<T>::merge(T ele1, T ele2) {
+    while (true) {
+        T root1 = find(ele1);
+        T root2 = find(ele2);
+        if (root1 == root2) {
+            return false;
+        }
+        if (root1 < root2) {
+            std::swap(root1, root2);
+        }
+        // root1 may have been linked by another thread in the meantime, then retry
+        T expected = (T)(-1);
+        if (set[root1].compare_exchange_strong(expected, root2, std::memory_order_acq_rel)) {
+            return true;
+        }
+        ele1 = root1;
+        ele2 = root2;
+    }
+}
+
 } // namespace
 
 
 #endif // DISJOINTSETS_HPP
-
@@ -0,0 +1,84 @@
+#ifndef FEATHERING_HPP
+#define FEATHERING_HPP
+
+#include <algorithm>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace contourtree {
+
+/**
+ * Dilates data, a volume of outer * n * inner entries, along its middle axis: an entry is
+ * set afterwards if any entry at most distance steps away along that axis was set. A
+ * forward and a backward pass count the steps to the last set entry, so the cost does not
+ * depend on distance. Whole rows of inner entries are handled at once, which keeps the
+ * memory accesses sequential for every axis.
+ */
+inline void dilateAxis(uint8_t *data, size_t outer, size_t n, size_t inner, size_t distance) {
+    const uint32_t far = (uint32_t)(std::min<size_t>(distance, 0xfffffffe) + 1);
+    std::vector<uint8_t> result(n * inner);
+
+    if(inner == 1) {
+        // along the lines themselves, where keeping a single counter is cheaper
+        for(size_t o = 0;o < outer;o ++) {
+            uint8_t *line = data + o * n;
+            uint32_t g = far;
+            for(size_t i = 0;i < n;i ++) {
+                g = line[i] ? 0 : std::min(g + 1, far);
+                result[i] = g < far;
+            }
+            g = far;
+            for(size_t i = n;i > 0;i --) {
+                g = line[i - 1] ? 0 : std::min(g + 1, far);
+                line[i - 1] = result[i - 1] | (g < far);
+            }
+        }
+        return;
+    }
+
+    std::vector<uint32_t> gap(inner);
+    for(size_t o = 0;o < outer;o ++) {
+        uint8_t *block = data + o * n * inner;
+
+        std::fill(gap.begin(), gap.end(), far);
+        for(size_t i = 0;i < n;i ++) {
+            const uint8_t *row = block + i * inner;
+            uint8_t *out = result.data() + i * inner;
+            for(size_t j = 0;j < inner;j ++) {
+                gap[j] = row[j] ? 0 : std::min(gap[j] + 1, far);
+                out[j] = gap[j] < far;
+            }
+        }
+
+        std::fill(gap.begin(), gap.end(), far);
+        for(size_t i = n;i > 0;i --) {
+            const uint8_t *row = block + (i - 1) * inner;
+            uint8_t *out = result.data() + (i - 1) * inner;
+            for(size_t j = 0;j < inner;j ++) {
+                gap[j] = row[j] ? 0 : std::min(gap[j] + 1, far);
+                out[j] |= gap[j] < far;
+            }
+        }
+
+        std::copy(result.begin(), result.end(), block);
+    }
+}
+
+/**
+ * Feathers mask, a volume of nx * ny * nz entries with x running fastest, by distance
+ * voxels: afterwards a voxel is set if any voxel of the (2 * distance + 1)^3 cube around
+ * it was set. The cube is separable into one dilation along each axis.
+ */
+inline void featherMask(std::vector<uint8_t> &mask, size_t nx, size_t ny, size_t nz, size_t distance) {
+    if(distance == 0 || mask.empty()) {
+        return;
+    }
+    dilateAxis(mask.data(), ny * nz, nx, 1, distance);
+    dilateAxis(mask.data(), nz, ny, nx, distance);
+    dilateAxis(mask.data(), 1, nz, nx * ny, distance);
+}
+
+}
+
+#endif // FEATHERING_HPP
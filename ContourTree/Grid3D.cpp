@@ -3,25 +3,35 @@
 #include <cassert>
 #include <fstream>
 #include <QString>
+#include <QDebug>
 
 namespace contourtree {
 
-Grid3D::Grid3D(int resx, int resy, int resz) :
-    dimx(resx), dimy(resy), dimz(resz)
+template <class V>
+Grid3D<V>::Grid3D(int resx, int resy, int resz) :
+    dimx(resx), dimy(resy), dimz(resz), values(NULL)
 {
-    nv = dimx * dimy * dimz;
+    nv = int64_t(dimx) * dimy * dimz;
     this->updateStars();
 }
 
-int Grid3D::getMaxDegree() {
+template <class V>
+Grid3D<V>::~Grid3D() {
+    unmapGrid();
+}
+
+template <class V>
+int Grid3D<V>::getMaxDegree() {
     return 14;
 }
 
-int Grid3D::getVertexCount() {
+template <class V>
+int64_t Grid3D<V>::getVertexCount() {
     return nv;
 }
 
-int Grid3D::getStar(int64_t v, QVector<int64_t> &star) {
+template <class V>
+int Grid3D<V>::getStar(int64_t v, QVector<int64_t> &star) {
     int z = v / (dimx * dimy);
     int rem = v % (dimx * dimy);
     int y = rem / dimx;
@@ -42,27 +52,78 @@ int Grid3D::getStar(int64_t v, QVector<int64_t> &star) {
     return ct;
 }
 
-bool Grid3D::lessThan(int64_t v1, int64_t v2) {
-    if(fnVals[v1] < fnVals[v2]) {
+template <class V>
+bool Grid3D<V>::lessThan(int64_t v1, int64_t v2) {
+    if(values[v1] < values[v2]) {
         return true;
-    } else if(fnVals[v1] == fnVals[v2]) {
+    } else if(values[v1] == values[v2]) {
         return (v1 < v2);
     }
     return false;
 }
 
-unsigned char Grid3D::getFunctionValue(int64_t v) {
-    return this->fnVals[v];
+template <class V>
+float Grid3D<V>::getFunctionValue(int64_t v) {
+    return this->values[v];
+}
+
+template <>
+ValueType Grid3D<unsigned char>::getValueType() {
+    return TypeUInt8;
+}
+
+template <>
+ValueType Grid3D<uint16_t>::getValueType() {
+    return TypeUInt16;
+}
+
+template <>
+ValueType Grid3D<float>::getValueType() {
+    return TypeFloat;
 }
 
-void Grid3D::loadGrid(QString fileName) {
+template <class V>
+const void* Grid3D<V>::getFunctionValues() {
+    return this->values;
+}
+
+template <class V>
+void Grid3D<V>::loadGrid(QString fileName, int64_t offset) {
     std::ifstream ip(fileName.toStdString(), std::ios::binary);
+    ip.seekg(offset);
     this->fnVals.resize(nv);
-    ip.read((char *)fnVals.data(),nv);
+    ip.read((char *)fnVals.data(),nv * sizeof(V));
     ip.close();
+    unmapGrid();
+    values = fnVals.data();
+}
+
+/**
+ * Maps the raw file read-only instead of copying it into memory, so that the data is
+ * shared with the page cache and with other processes reading the same file.
+ * The pages are read ahead since the vertices are first ordered in a linear pass.
+ *
+ * @return false if the file could not be mapped, in which case the grid is unchanged
+ */
+template <class V>
+bool Grid3D<V>::mapGrid(QString fileName, int64_t offset) {
+    if(!mapping.map(fileName, offset, nv * sizeof(V), true)) {
+        values = fnVals.data();
+        return false;
+    }
+    values = (const V *)mapping.data();
+    fnVals = std::vector<V>();
+    return true;
+}
+
+template <class V>
+void Grid3D<V>::unmapGrid() {
+    mapping.unmap();
+    values = fnVals.data();
 }
 
-void Grid3D::updateStars() {
+template <class V>
+void Grid3D<V>::updateStars() {
     int ordering [][3] = {
         {0,1,2},
         {0,2,1},
@@ -134,4 +195,8 @@ void Grid3D::updateStars() {
 
 }
 
+template class Grid3D<unsigned char>;
+template class Grid3D<uint16_t>;
+template class Grid3D<float>;
+
 } // namespace
@@ -2,6 +2,7 @@
 #define GRID3D_H
 
 #include "ScalarFunction.hpp"
+#include "MappedFile.hpp"
 #include <QSet>
 #include <stdint.h>
 #include <vector>
@@ -12,31 +13,50 @@ struct Tet {
     int64_t v[4];
 };
 
+/**
+ * Regular grid with function values of type V (unsigned char, uint16_t or float).
+ */
+template <class V>
 class Grid3D : public ScalarFunction
 {
 public:
     Grid3D(int resx, int resy, int resz);
+    ~Grid3D();
 
 public:
     int getMaxDegree();
-    int getVertexCount();
+    int64_t getVertexCount();
     int getStar(int64_t v, QVector<int64_t> &star);
     bool lessThan(int64_t v1, int64_t v2);
-    unsigned char getFunctionValue(int64_t v);
+    float getFunctionValue(int64_t v);
+    ValueType getValueType();
+    const void* getFunctionValues();
 
 public:
-    void loadGrid(QString fileName);
+    void loadGrid(QString fileName, int64_t offset = 0);
+    bool mapGrid(QString fileName, int64_t offset = 0);
+    void unmapGrid();
 
 protected:
     void updateStars();
 
 public:
     int dimx, dimy, dimz;
-    int nv;
+    int64_t nv;
     QVector<Tet> tets;
     int starin[14][3];
     int64_t star[14];
-    std::vector<unsigned char> fnVals;
+    // points either to fnVals or to the mapped file
+    const V *values;
+    std::vector<V> fnVals;
+
+protected:
+    // read-only mapping of the raw file, see mapGrid
+    MappedFile mapping;
+
+private:
+    Grid3D(const Grid3D &);
+    Grid3D &operator=(const Grid3D &);
 
 protected:
     inline int64_t index(int64_t x, int64_t y, int64_t z) {
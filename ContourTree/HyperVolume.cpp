@@ -1,6 +1,8 @@
 #include "HyperVolume.hpp"
+#include "PartitionFile.hpp"
 
 #include <fstream>
+#include <algorithm>
 #include <QDebug>
 #include <cassert>
 
@@ -9,19 +11,42 @@ namespace contourtree {
 HyperVolume::HyperVolume(const ContourTreeData &ctData, QString partFile) {
     fnVals = ctData.fnVals.data();
 
+    vol.resize(ctData.noArcs,0);
+    brVol.resize(ctData.noArcs,0);
+
+    if(partFile.endsWith(".brk")) {
+        // decode one brick at a time
+        PartitionFile part;
+        if(!part.open(partFile)) {
+            return;
+        }
+        std::vector<uint32_t> cols;
+        for(int64_t b = 0;b < (int64_t)part.header.noBricks;b ++) {
+            if(!part.readBrick(b, cols)) {
+                qDebug() << "damaged brick" << b << "in" << partFile;
+                std::fill(vol.begin(), vol.end(), 0);
+                return;
+            }
+            initVolumes(cols);
+        }
+        return;
+    }
+
     std::ifstream bin(partFile.toStdString(), std::ios::binary| std::ios::ate);
-    uint32_t size = bin.tellg();
+    uint64_t size = bin.tellg();
     qDebug() << "part size: " << size;
-    bin.close();
+    bin.seekg(0);
 
-    std::vector<uint32_t> cols(size / sizeof(uint32_t));
-    bin.open(partFile.toStdString(), std::ios::binary);
-    bin.read((char *)cols.data(),size);
+    // read the partition in chunks so that it never has to fit in memory as a whole
+    std::vector<uint32_t> cols;
+    uint64_t remaining = size / sizeof(uint32_t);
+    while(remaining > 0) {
+        cols.resize(std::min<uint64_t>(remaining, 1 << 24));
+        bin.read((char *)cols.data(),cols.size() * sizeof(uint32_t));
+        initVolumes(cols);
+        remaining -= cols.size();
+    }
     bin.close();
-
-    vol.resize(ctData.noArcs,0);
-    brVol.resize(ctData.noArcs,0);
-    initVolumes(cols);
 }
 
 void HyperVolume::initVolumes(const std::vector<uint32_t> &cols) {
@@ -33,40 +58,36 @@ void HyperVolume::initVolumes(const std::vector<uint32_t> &cols) {
     }
 }
 
-void HyperVolume::init(std::vector<float> &fn, std::vector<Branch> &br) {
+void HyperVolume::init(std::vector<float> &fn, Branches &br) {
     this->fn = fn.data();
     for(int i = 0;i < fn.size();i ++) {
+        brVol[i] = 0;
+        for(uint32_t a = br.firstArc(i);a != Branches::None;a = br.nextArc(a)) {
+            brVol[i] += vol[a];
+        }
         this->update(br,i);
     }
 }
 
-void HyperVolume::update(const std::vector<Branch> &br, uint32_t brNo) {
-    brVol[brNo] = 0;
-    for(int i = 0;i < br[brNo].arcs.size();i ++) {
-        brVol[brNo] += vol[br[brNo].arcs.at(i)];
-    }
-    for(int i = 0;i < br[brNo].children.size();i ++) {
-        int child = br[brNo].children.at(i);
-        brVol[brNo] += volume(br,child);
-    }
-    float fnDiff = fnVals[br[brNo].to] - fnVals[br[brNo].from];
+void HyperVolume::update(const Branches &br, uint32_t brNo) {
+    float fnDiff = fnVals[br.to[brNo]] - fnVals[br.from[brNo]];
     fn[brNo] = fnDiff * brVol[brNo];
 }
 
-float HyperVolume::volume(const std::vector<Branch> &br, int brNo) {
-    float val = 0;
-    for(int i = 0;i < br[brNo].arcs.size();i ++) {
-        val += vol[br[brNo].arcs.at(i)];
-    }
-    for(int i = 0;i < br[brNo].children.size();i ++) {
-        int child = br[brNo].children.at(i);
-        val = val + volume(br,child);
-    }
-    return val;
-}
+void HyperVolume::branchRemoved(Branches&, uint32_t, std::vector<bool>&) {
 
-void HyperVolume::branchRemoved(std::vector<Branch>&, uint32_t, std::vector<bool>&) {
+}
 
+/**
+ * Keeps brVol up to date as branches are merged, so that update does not have to walk
+ * the whole subtree of a branch. The removed branches never change after being merged,
+ * so their volumes are final.
+ */
+void HyperVolume::branchMerged(const Branches&, uint32_t brNo, uint32_t merged, const std::vector<uint32_t> &children) {
+    brVol[brNo] += brVol[merged];
+    for(size_t i = 0;i < children.size();i ++) {
+        brVol[brNo] += brVol[children[i]];
+    }
 }
 
 float HyperVolume::getBranchWeight(uint32_t brNo) {
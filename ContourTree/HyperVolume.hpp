@@ -11,19 +11,20 @@ class HyperVolume : public SimFunction
 public:
     HyperVolume(const ContourTreeData& ctData, QString partFile);
 
-    void init(std::vector<float> &fn, std::vector<Branch> &br);
-    void update(const std::vector<Branch> &br, uint32_t brNo);
-    void branchRemoved(std::vector<Branch>& br, uint32_t brNo, std::vector<bool>& invalid);
+    void init(std::vector<float> &fn, Branches &br);
+    void update(const Branches &br, uint32_t brNo);
+    void branchRemoved(Branches& br, uint32_t brNo, std::vector<bool>& invalid);
+    void branchMerged(const Branches& br, uint32_t brNo, uint32_t merged, const std::vector<uint32_t>& children);
     float getBranchWeight(uint32_t brNo);
 
 private:
-    float volume(const std::vector<Branch> &br, int brNo);
     void initVolumes(const std::vector<uint32_t> &cols);
 
 public:
     const float *fnVals;
     float *fn;
     std::vector<uint32_t> vol;
+    // volume of every branch including all the branches below it
     std::vector<uint32_t> brVol;
 };
 
@@ -0,0 +1,154 @@
+#ifndef INDEXEDHEAP_HPP
+#define INDEXEDHEAP_HPP
+
+#include <stdint.h>
+#include <vector>
+#include <cassert>
+#include <algorithm>
+
+namespace contourtree {
+
+/*
+ * D-ary heap of the ids 0 .. size - 1, each present at most once. The position of every
+ * id in the heap is kept, so an id can be removed or re-sorted after its key changed
+ * without leaving a stale entry behind. Keys are not stored in the heap, Compare reads
+ * them and has the same meaning as for std::priority_queue: compare(a, b) is true if a
+ * has to come out after b.
+ */
+template <class Compare, int D = 4>
+class IndexedHeap
+{
+public:
+    enum : uint32_t { NotInHeap = uint32_t(-1) };
+
+    IndexedHeap() : noPushes(0), noPops(0), noUpdates(0), noRemovals(0) {}
+    IndexedHeap(const Compare &compare) : compare(compare), noPushes(0), noPops(0), noUpdates(0), noRemovals(0) {}
+
+    // ids have to be smaller than size
+    void resize(size_t size) {
+        heap.clear();
+        heap.reserve(size);
+        pos.assign(size, NotInHeap);
+    }
+
+    // replaces the contents with ids, building the heap bottom up in linear time
+    void assign(const std::vector<uint32_t> &ids) {
+        for(size_t i = 0;i < heap.size();i ++) {
+            pos[heap[i]] = NotInHeap;
+        }
+        heap = ids;
+        noPushes += ids.size();
+        for(size_t i = 0;i < heap.size();i ++) {
+            pos[heap[i]] = (uint32_t)i;
+        }
+        for(size_t i = heap.size() / D + 1;i > 0;i --) {
+            if(i - 1 < heap.size()) {
+                siftDown((uint32_t)(i - 1));
+            }
+        }
+    }
+
+    bool empty() const { return heap.empty(); }
+    size_t size() const { return heap.size(); }
+    bool contains(uint32_t id) const { return pos[id] != NotInHeap; }
+    uint32_t top() const { return heap[0]; }
+
+    void push(uint32_t id) {
+        assert(!contains(id));
+        noPushes ++;
+        pos[id] = (uint32_t)heap.size();
+        heap.push_back(id);
+        siftUp(pos[id]);
+    }
+
+    void pop() {
+        noPops ++;
+        removeAt(0);
+    }
+
+    // re-sorts id after its key changed in either direction
+    void update(uint32_t id) {
+        assert(contains(id));
+        noUpdates ++;
+        uint32_t i = pos[id];
+        siftUp(i);
+        siftDown(pos[id]);
+    }
+
+    void remove(uint32_t id) {
+        assert(contains(id));
+        noRemovals ++;
+        removeAt(pos[id]);
+    }
+
+private:
+    void removeAt(uint32_t i) {
+        uint32_t id = heap[i];
+        uint32_t last = heap.back();
+        heap.pop_back();
+        pos[id] = NotInHeap;
+        if(i < heap.size()) {
+            heap[i] = last;
+            pos[last] = i;
+            siftUp(i);
+            siftDown(pos[last]);
+        }
+    }
+
+    void siftUp(uint32_t i) {
+        uint32_t id = heap[i];
+        while(i > 0) {
+            uint32_t p = (i - 1) / D;
+            if(!compare(heap[p], id)) {
+                break;
+            }
+            heap[i] = heap[p];
+            pos[heap[i]] = i;
+            i = p;
+        }
+        heap[i] = id;
+        pos[id] = i;
+    }
+
+    void siftDown(uint32_t i) {
+        uint32_t id = heap[i];
+        size_t n = heap.size();
+        while(true) {
+            size_t first = size_t(i) * D + 1;
+            if(first >= n) {
+                break;
+            }
+            size_t last = std::min(first + D, n);
+            size_t best = first;
+            for(size_t c = first + 1;c < last;c ++) {
+                if(compare(heap[best], heap[c])) {
+                    best = c;
+                }
+            }
+            if(!compare(id, heap[best])) {
+                break;
+            }
+            heap[i] = heap[best];
+            pos[heap[i]] = i;
+            i = (uint32_t)best;
+        }
+        heap[i] = id;
+        pos[id] = i;
+    }
+
+private:
+    Compare compare;
+    std::vector<uint32_t> heap;
+    std::vector<uint32_t> pos;
+
+public:
+    // operation counts, for comparing against other queues
+    uint64_t noPushes;
+    uint64_t noPops;
+    uint64_t noUpdates;
+    uint64_t noRemovals;
+};
+
+} // namespace
+
+#endif // INDEXEDHEAP_HPP
@@ -0,0 +1,121 @@
+#include "MappedFile.hpp"
+
+#include <QDebug>
+#include <algorithm>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace contourtree {
+
+MappedFile::MappedFile() :
+    mapping(NULL), mappingSize(0), start(NULL), length(0)
+{
+#ifdef WIN32
+    mapFile = NULL;
+    mapHandle = NULL;
+#endif
+}
+
+MappedFile::~MappedFile() {
+    unmap();
+}
+
+/**
+ * Maps size bytes of the file starting at offset, or the rest of the file if size is -1.
+ * With sequential set, the pages are read ahead for a linear pass over the data.
+ *
+ * @return false if the file could not be mapped, in which case nothing is mapped
+ */
+bool MappedFile::map(QString fileName, int64_t offset, int64_t size, bool sequential) {
+    unmap();
+#ifdef WIN32
+    HANDLE file = CreateFileA(fileName.toStdString().c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_ATTRIBUTE_NORMAL, NULL);
+    if(file == INVALID_HANDLE_VALUE) {
+        qDebug() << "could not open file" << fileName;
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    if(!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart < offset + std::max<int64_t>(size, 0)) {
+        qDebug() << "file is too small" << fileName;
+        CloseHandle(file);
+        return false;
+    }
+    if(size == -1) {
+        size = fileSize.QuadPart - offset;
+    }
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    int64_t begin = offset - offset % info.dwAllocationGranularity;
+    HANDLE handle = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    void *ptr = (handle == NULL) ? NULL : MapViewOfFile(handle, FILE_MAP_READ, DWORD(begin >> 32), DWORD(begin & 0xFFFFFFFF), SIZE_T(offset - begin + size));
+    if(ptr == NULL) {
+        qDebug() << "could not map file" << fileName;
+        if(handle != NULL) {
+            CloseHandle(handle);
+        }
+        CloseHandle(file);
+        return false;
+    }
+    mapFile = file;
+    mapHandle = handle;
+#else
+    int64_t pageSize = sysconf(_SC_PAGESIZE);
+    int64_t begin = offset - offset % pageSize;
+    int fd = open(fileName.toStdString().c_str(), O_RDONLY);
+    if(fd == -1) {
+        qDebug() << "could not open file" << fileName;
+        return false;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size < offset + std::max<int64_t>(size, 0)) {
+        qDebug() << "file is too small" << fileName;
+        close(fd);
+        return false;
+    }
+    if(size == -1) {
+        size = st.st_size - offset;
+    }
+    void *ptr = mmap(NULL, offset - begin + size, PROT_READ, MAP_SHARED, fd, begin);
+    // the mapping stays valid after closing the descriptor
+    close(fd);
+    if(ptr == MAP_FAILED) {
+        qDebug() << "could not map file" << fileName;
+        return false;
+    }
+    if(sequential) {
+        madvise(ptr, offset - begin + size, MADV_SEQUENTIAL);
+        madvise(ptr, offset - begin + size, MADV_WILLNEED);
+    }
+#endif
+    mapping = ptr;
+    mappingSize = offset - begin + size;
+    start = (const char *)ptr + (offset - begin);
+    length = size;
+    return true;
+}
+
+void MappedFile::unmap() {
+    if(mapping == NULL) {
+        return;
+    }
+#ifdef WIN32
+    UnmapViewOfFile(mapping);
+    CloseHandle(mapHandle);
+    CloseHandle(mapFile);
+#else
+    munmap(mapping, mappingSize);
+#endif
+    mapping = NULL;
+    mappingSize = 0;
+    start = NULL;
+    length = 0;
+}
+
+}
@@ -0,0 +1,42 @@
+#ifndef MAPPEDFILE_HPP
+#define MAPPEDFILE_HPP
+
+#include <QString>
+#include <stdint.h>
+
+namespace contourtree {
+
+/**
+ * Read-only memory mapping of a range of a file.
+ */
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    bool map(QString fileName, int64_t offset = 0, int64_t size = -1, bool sequential = false);
+    void unmap();
+
+    bool isMapped() const { return mapping != NULL; }
+    const char *data() const { return start; }
+    int64_t size() const { return length; }
+
+protected:
+    void *mapping;
+    int64_t mappingSize;
+    const char *start;
+    int64_t length;
+#ifdef WIN32
+    void *mapFile;
+    void *mapHandle;
+#endif
+
+private:
+    MappedFile(const MappedFile &);
+    MappedFile &operator=(const MappedFile &);
+};
+
+}
+
+#endif // MAPPEDFILE_HPP
@@ -1,23 +1,113 @@
 #include "MergeTree.hpp"
+#include "Grid3D.hpp"
+#include "ContourTreeData.hpp"
 
 #include <chrono>
 #include <QDebug>
 #include <QFile>
 #include <QTextStream>
 #include <fstream>
+#include <limits>
+#include <algorithm>
 
 #if !defined (WIN32)
 #include <parallel/algorithm>
 #endif
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 namespace contourtree {
 
-MergeTree::MergeTree()
+namespace {
+    // link state of a vertex w.r.t. its block, recorded while computing the local trees;
+    // BOUNDARY vertices have an upper (join tree) or lower (split tree) neighbour in another block
+    const char INTERIOR = 0;
+    const char BOUNDARY = 1;
+    const char ISOLATED = 2;
+    // added once for every level of the glue that the vertex is a key vertex at
+    const char KEY = 4;
+
+    // star and order queries through the virtual ScalarFunction interface
+    class FunctionSweep {
+    public:
+        FunctionSweep(ScalarFunction *data) : data(data) {}
+
+        inline int getStar(int64_t v, QVector<int64_t> &star) const {
+            return data->getStar(v, star);
+        }
+
+        inline bool lessThan(int64_t v1, int64_t v2) const {
+            return data->lessThan(v1, v2);
+        }
+
+    private:
+        ScalarFunction *data;
+    };
+
+    // inlined Grid3D queries. Only vertices on the boundary of the grid need bounds checks
+    template <class V>
+    class GridSweep {
+    public:
+        GridSweep(Grid3D<V> *grid) : fnVals(grid->values), dimx(grid->dimx), dimy(grid->dimy), dimz(grid->dimz) {
+            layer = int64_t(dimx) * dimy;
+            for(int i = 0;i < 14;i ++) {
+                offsets[i] = grid->star[i];
+                starin[i][0] = grid->starin[i][0];
+                starin[i][1] = grid->starin[i][1];
+                starin[i][2] = grid->starin[i][2];
+            }
+        }
+
+        inline int getStar(int64_t v, QVector<int64_t> &star) const {
+            int64_t z = v / layer;
+            int64_t rem = v - z * layer;
+            int64_t y = rem / dimx;
+            int64_t x = rem - y * dimx;
+            if(x > 0 && x < dimx - 1 && y > 0 && y < dimy - 1 && z > 0 && z < dimz - 1) {
+                for(int i = 0;i < 14;i ++) {
+                    star[i] = v + offsets[i];
+                }
+                return 14;
+            }
+            int ct = 0;
+            for(int i = 0;i < 14;i ++) {
+                int64_t _x = x + starin[i][0];
+                int64_t _y = y + starin[i][1];
+                int64_t _z = z + starin[i][2];
+                if(_x < 0 || _x >= dimx ||
+                   _y < 0 || _y >= dimy ||
+                   _z < 0 || _z >= dimz) {
+                    continue;
+                }
+                star[ct ++] = v + offsets[i];
+            }
+            return ct;
+        }
+
+        inline bool lessThan(int64_t v1, int64_t v2) const {
+            return (fnVals[v1] < fnVals[v2] || (fnVals[v1] == fnVals[v2] && v1 < v2));
+        }
+
+    private:
+        const V *fnVals;
+        int64_t dimx, dimy, dimz;
+        int64_t layer;
+        int64_t offsets[14];
+        int starin[14][3];
+    };
+}
+
+template <class T>
+MergeTree<T>::MergeTree()
 {
     newRoot = 0;
+    showProgress = true;
 }
 
-void MergeTree::computeTree(ScalarFunction* data, TreeType type) {
+template <class T>
+void MergeTree<T>::computeTree(ScalarFunction* data, TreeType type, bool parallel) {
     this->data = data;
     std::chrono::time_point<std::chrono::system_clock> ct, en;
     ct = std::chrono::system_clock::now();
@@ -25,19 +115,19 @@ void MergeTree::computeTree(ScalarFunction* data, TreeType type) {
     orderVertices();
     switch(type) {
     case TypeContourTree:
-        computeJoinTree();
-        nodes = DisjointSets<int64_t>(noVertices);
-        computeSplitTree();
+        parallel ? computeJoinTreeParallel() : computeJoinTree();
+        nodes = DisjointSets<T>(noVertices);
+        parallel ? computeSplitTreeParallel() : computeSplitTree();
         ctree.setup(this);
-        ctree.computeCT();
+        ctree.computeCT(parallel);
         break;
 
     case TypeSplitTree:
-        computeSplitTree();
+        parallel ? computeSplitTreeParallel() : computeSplitTree();
         break;
 
     case TypeJoinTree:
-        computeJoinTree();
+        parallel ? computeJoinTreeParallel() : computeJoinTree();
         break;
 
     default:
@@ -51,10 +141,12 @@ void MergeTree::computeTree(ScalarFunction* data, TreeType type) {
     qDebug() << "Time taken to compute tree : " << time << "ms";
 }
 
-void MergeTree::setupData() {
+template <class T>
+void MergeTree<T>::setupData() {
     qDebug() << "setting up data";
     maxStar = data->getMaxDegree();
     star.resize(maxStar);
+    set = ComponentSet<T>(maxStar);
 
     noVertices = data->getVertexCount();
     newVertex = false;
@@ -67,11 +159,21 @@ void MergeTree::setupData() {
     for(int64_t i = 0;i < noVertices;i ++) {
         sv[i] = i;
     }
-    nodes = DisjointSets<int64_t>(noVertices);
+    nodes = DisjointSets<T>(noVertices);
 }
 
-void MergeTree::orderVertices() {
+template <class T>
+void MergeTree<T>::orderVertices() {
     qDebug() << "ordering vertices";
+    const void *fnVals = data->getFunctionValues();
+    if(fnVals != NULL && data->getValueType() == TypeUInt8) {
+        countingSortVertices((const unsigned char *)fnVals);
+        return;
+    }
+    if(fnVals != NULL && data->getValueType() == TypeUInt16) {
+        countingSortVertices((const uint16_t *)fnVals);
+        return;
+    }
 #if defined (WIN32)
     std::sort(sv.begin(),sv.end(),Compare(data));
 #else
@@ -79,17 +181,99 @@ void MergeTree::orderVertices() {
 #endif
 }
 
-void MergeTree::computeJoinTree() {
-    qDebug() << "computing join tree";
+/**
+ * Stable counting sort of the vertices on their function value. The vertices are
+ * visited in the order of their index, so ties are broken by index as in lessThan.
+ * Every thread builds the histogram of a contiguous chunk of vertices, and the chunks
+ * are scattered in order.
+ */
+template <class T>
+template <class V>
+void MergeTree<T>::countingSortVertices(const V *fnVals) {
+    const int64_t noBuckets = int64_t(1) << (8 * sizeof(V));
+    int noChunks = 1;
+#ifdef _OPENMP
+    noChunks = omp_get_max_threads();
+#endif
+    int64_t chunkSize = (noVertices + noChunks - 1) / noChunks;
+
+    std::vector<int64_t> offsets(noChunks * noBuckets, 0);
+#pragma omp parallel for
+    for(int c = 0;c < noChunks;c ++) {
+        int64_t st = std::min(noVertices, c * chunkSize);
+        int64_t en = std::min(noVertices, st + chunkSize);
+        int64_t *hist = &offsets[c * noBuckets];
+        for(int64_t i = st;i < en;i ++) {
+            hist[fnVals[i]] ++;
+        }
+    }
+    int64_t pos = 0;
+    for(int64_t b = 0;b < noBuckets;b ++) {
+        for(int c = 0;c < noChunks;c ++) {
+            int64_t cct = offsets[c * noBuckets + b];
+            offsets[c * noBuckets + b] = pos;
+            pos += cct;
+        }
+    }
+
+#pragma omp parallel for
+    for(int c = 0;c < noChunks;c ++) {
+        int64_t st = std::min(noVertices, c * chunkSize);
+        int64_t en = std::min(noVertices, st + chunkSize);
+        int64_t *hist = &offsets[c * noBuckets];
+        for(int64_t i = st;i < en;i ++) {
+            sv[hist[fnVals[i]] ++] = i;
+        }
+    }
+}
+
+/**
+ * Runs the sweep with the star and order queries of the grid inlined if the
+ * input is a Grid3D, and through the ScalarFunction interface otherwise.
+ */
+template <class T>
+void MergeTree<T>::dispatchSweep(TreeType type, bool parallel) {
+    if(Grid3D<unsigned char> *grid = dynamic_cast<Grid3D<unsigned char> *>(data)) {
+        sweep(GridSweep<unsigned char>(grid), type, parallel);
+    } else if(Grid3D<uint16_t> *grid = dynamic_cast<Grid3D<uint16_t> *>(data)) {
+        sweep(GridSweep<uint16_t>(grid), type, parallel);
+    } else if(Grid3D<float> *grid = dynamic_cast<Grid3D<float> *>(data)) {
+        sweep(GridSweep<float>(grid), type, parallel);
+    } else {
+        sweep(FunctionSweep(data), type, parallel);
+    }
+}
+
+template <class T>
+template <class Function>
+void MergeTree<T>::sweep(const Function &fn, TreeType type, bool parallel) {
+    if(type == TypeJoinTree) {
+        parallel ? sweepJoinTreeParallel(fn) : sweepJoinTree(fn);
+    } else {
+        parallel ? sweepSplitTreeParallel(fn) : sweepSplitTree(fn);
+    }
+}
+
+template <class T>
+void MergeTree<T>::computeJoinTree() {
+    dispatchSweep(TypeJoinTree, false);
+}
+
+template <class T>
+template <class Function>
+void MergeTree<T>::sweepJoinTree(const Function &fn) {
+    if(showProgress) {
+        qDebug() << "computing join tree";
+    }
     int64_t ct = 0;
     for(int64_t i = noVertices - 1;i >= 0; i --) {
-        if(ct % 1000000 == 0) {
+        if(showProgress && ct % 1000000 == 0) {
             qDebug() << "processing vertex " <<  ct << " of " << noVertices;
         }
         ct ++;
 
         int64_t v = sv[i];
-        processVertex(v);
+        processVertex(fn, v);
     }
     int64_t in = 0;
     if(criticalPts[sv[in]] == SADDLE) {
@@ -102,18 +286,134 @@ void MergeTree::computeJoinTree() {
 }
 
 
-void MergeTree::computeSplitTree() {
-    qDebug() << "computing split tree";
+template <class T>
+void MergeTree<T>::computeSplitTree() {
+    dispatchSweep(TypeSplitTree, false);
+}
+
+template <class T>
+template <class Function>
+void MergeTree<T>::sweepSplitTree(const Function &fn) {
+    if(showProgress) {
+        qDebug() << "computing split tree";
+    }
     int64_t ct = 0;
     for(int64_t i = 0;i < noVertices; i ++) {
-        if(ct % 1000000 == 0) {
+        if(showProgress && ct % 1000000 == 0) {
             qDebug() << "processing vertex " <<  ct << " of " << noVertices;
         }
         ct ++;
 
         int64_t v = sv[i];
-        processVertexSplit(v);
+        processVertexSplit(fn, v);
+    }
+    int64_t in = noVertices - 1;
+    if(criticalPts[sv[in]] == SADDLE) {
+        // add a new vertex
+        newVertex = true;
+    } else {
+        criticalPts[sv[in]] = MAXIMUM;
+    }
+    newRoot = in;
+}
+
+/**
+ * Computes the join tree by first sweeping contiguous blocks of vertices in parallel,
+ * each restricted to edges within the block, and then gluing the local trees.
+ * The superlevel set connectivity of a block is fully captured by its local augmented
+ * join tree, so gluing only needs the local tree arcs plus the edges crossing block
+ * boundaries, and only visits the boundary vertices and the local critical points (see
+ * glueBlockTrees()). The result is identical to computeJoinTree().
+ */
+template <class T>
+void MergeTree<T>::computeJoinTreeParallel() {
+    dispatchSweep(TypeJoinTree, true);
+}
+
+template <class T>
+template <class Function>
+void MergeTree<T>::sweepJoinTreeParallel(const Function &fn) {
+    int noBlocks = 1;
+#ifdef _OPENMP
+    noBlocks = omp_get_max_threads();
+#endif
+    if(noBlocks < 2 || noVertices < 2 * noBlocks) {
+        sweepJoinTree(fn);
+        return;
+    }
+    qDebug() << "computing join tree using" << noBlocks << "blocks";
+    std::vector<T> order;
+    std::vector<char> link(noVertices, INTERIOR);
+    int64_t blockSize = partitionVertices(noBlocks, order);
+    // the local sweeps mark local critical points, which are reset before gluing
+    std::vector<char> types = criticalPts;
+    // the local trees contracted to their key vertices (see glueBlockTrees())
+    std::vector<T> child(noVertices, -1), sibling(noVertices, -1);
+
+    qDebug() << "computing local join trees";
+#pragma omp parallel for schedule(dynamic, 1)
+    for(int b = 0;b < noBlocks;b ++) {
+        int64_t st = std::min(noVertices, b * blockSize);
+        int64_t en = std::min(noVertices, st + blockSize);
+        QVector<int64_t> star(maxStar);
+        ComponentSet<T> set(maxStar);
+        for(int64_t i = en - 1;i >= st;i --) {
+            processVertexBlock(fn, order[i], st, en, star, set, link, child, sibling);
+        }
+    }
+
+    glueBlockTrees(fn, TypeJoinTree, noBlocks, blockSize, order, link, types, child, sibling);
+    int64_t in = 0;
+    if(criticalPts[sv[in]] == SADDLE) {
+        // add a new vertex
+        newVertex = true;
+    } else {
+        criticalPts[sv[in]] = MINIMUM;
     }
+    newRoot = in;
+}
+
+/**
+ * Split tree counterpart of computeJoinTreeParallel().
+ */
+template <class T>
+void MergeTree<T>::computeSplitTreeParallel() {
+    dispatchSweep(TypeSplitTree, true);
+}
+
+template <class T>
+template <class Function>
+void MergeTree<T>::sweepSplitTreeParallel(const Function &fn) {
+    int noBlocks = 1;
+#ifdef _OPENMP
+    noBlocks = omp_get_max_threads();
+#endif
+    if(noBlocks < 2 || noVertices < 2 * noBlocks) {
+        sweepSplitTree(fn);
+        return;
+    }
+    qDebug() << "computing split tree using" << noBlocks << "blocks";
+    std::vector<T> order;
+    std::vector<char> link(noVertices, INTERIOR);
+    int64_t blockSize = partitionVertices(noBlocks, order);
+    // the local sweeps mark local critical points, which are reset before gluing
+    std::vector<char> types = criticalPts;
+    // the local trees contracted to their key vertices (see glueBlockTrees())
+    std::vector<T> child(noVertices, -1), sibling(noVertices, -1);
+
+    qDebug() << "computing local split trees";
+#pragma omp parallel for schedule(dynamic, 1)
+    for(int b = 0;b < noBlocks;b ++) {
+        int64_t st = std::min(noVertices, b * blockSize);
+        int64_t en = std::min(noVertices, st + blockSize);
+        QVector<int64_t> star(maxStar);
+        ComponentSet<T> set(maxStar);
+        for(int64_t i = st;i < en;i ++) {
+            processVertexSplitBlock(fn, order[i], st, en, star, set, link, child, sibling);
+        }
+    }
+
+    glueBlockTrees(fn, TypeSplitTree, noBlocks, blockSize, order, link, types, child, sibling);
     int64_t in = noVertices - 1;
     if(criticalPts[sv[in]] == SADDLE) {
         // add a new vertex
@@ -124,7 +424,280 @@ void MergeTree::computeSplitTree() {
     newRoot = in;
 }
 
-void MergeTree::output(QString fileName, TreeType tree)
+/**
+ * Splits the vertex indices into noBlocks contiguous blocks and stores the vertices
+ * of each block in order, sorted the same way as sv.
+ *
+ * @return the number of vertices per block
+ */
+template <class T>
+int64_t MergeTree<T>::partitionVertices(int noBlocks, std::vector<T> &order) {
+    int64_t blockSize = (noVertices + noBlocks - 1) / noBlocks;
+    order.resize(noVertices);
+
+    // count for each chunk of sv the number of vertices in every block
+    std::vector<int64_t> offsets(noBlocks * noBlocks, 0);
+#pragma omp parallel for
+    for(int c = 0;c < noBlocks;c ++) {
+        int64_t st = std::min(noVertices, c * blockSize);
+        int64_t en = std::min(noVertices, st + blockSize);
+        for(int64_t i = st;i < en;i ++) {
+            offsets[c * noBlocks + sv[i] / blockSize] ++;
+        }
+    }
+    for(int b = 0;b < noBlocks;b ++) {
+        int64_t pos = std::min(noVertices, b * blockSize);
+        for(int c = 0;c < noBlocks;c ++) {
+            int64_t cct = offsets[c * noBlocks + b];
+            offsets[c * noBlocks + b] = pos;
+            pos += cct;
+        }
+    }
+
+    // scatter, preserving the sorted order within each block
+#pragma omp parallel for
+    for(int c = 0;c < noBlocks;c ++) {
+        int64_t st = std::min(noVertices, c * blockSize);
+        int64_t en = std::min(noVertices, st + blockSize);
+        for(int64_t i = st;i < en;i ++) {
+            order[offsets[c * noBlocks + sv[i] / blockSize] ++] = sv[i];
+        }
+    }
+    return blockSize;
+}
+
+/**
+ * Glues the local trees in levels: at level l, the trees of groups of 2^l consecutive
+ * blocks are merged by sweeping the key vertices of each group, with the groups handled in
+ * parallel. The key vertices of a level are those that are critical in the tree of their
+ * group one level below, or that have an upper (join tree) or lower (split tree) neighbour
+ * outside that group. Every other vertex is regular in the global tree as well, and drops
+ * out of the glue. Since the inner boundaries of a group drop out once it is merged, the
+ * serial work only grows with the number of levels instead of the number of blocks.
+ * The sweep of the last level records the arcs of its key vertices, and the vertices that
+ * dropped out are put on these arcs level by level from the top.
+ */
+template <class T>
+template <class Function>
+void MergeTree<T>::glueBlockTrees(const Function &fn, TreeType type, int noBlocks, int64_t blockSize, std::vector<T> &order, std::vector<char> &link,
+                                  const std::vector<char> &types, std::vector<T> &child, std::vector<T> &sibling) {
+    bool join = (type == TypeJoinTree);
+    std::vector<T> &tree = join ? prev : next;
+    int noLevels = 0;
+    while((1 << noLevels) < noBlocks) {
+        noLevels ++;
+    }
+
+    // the key vertices of every group in the order of sv, stored with the first block of the group
+    std::vector<std::vector<T> > keys(noBlocks);
+#pragma omp parallel for
+    for(int b = 0;b < noBlocks;b ++) {
+        int64_t st = std::min(noVertices, b * blockSize);
+        int64_t en = std::min(noVertices, st + blockSize);
+        for(int64_t i = st;i < en;i ++) {
+            int64_t v = order[i];
+            if(link[v] >= KEY) {
+                keys[b].push_back(v);
+                tree[v] = -1;
+                criticalPts[v] = types[v];
+                nodes.reset(v);
+            }
+        }
+    }
+    order = std::vector<T>();
+    int64_t noKeys = 0;
+    for(int b = 0;b < noBlocks;b ++) {
+        noKeys += keys[b].size();
+    }
+    qDebug() << "gluing local trees at" << noKeys << "of" << noVertices << "vertices in" << noLevels << "levels";
+
+    // the vertices that start a path of key vertices dropping out, for every level and group
+    std::vector<std::vector<T> > heads((noLevels - 1) * noBlocks);
+
+    std::vector<T> arcs(noVertices, -1);
+    std::vector<T> closing;
+    for(int l = 1;l <= noLevels;l ++) {
+        int noGroups = ((noBlocks - 1) >> l) + 1;
+#pragma omp parallel for schedule(dynamic, 1)
+        for(int g = 0;g < noGroups;g ++) {
+            std::vector<T> &groupKeys = keys[g << l];
+            int half = (g << l) + (1 << (l - 1));
+            if(half < noBlocks) {
+                std::vector<T> merged(groupKeys.size() + keys[half].size());
+                std::merge(groupKeys.begin(), groupKeys.end(), keys[half].begin(), keys[half].end(), merged.begin(),
+                           [&fn](T v1, T v2) { return fn.lessThan(v1, v2); });
+                groupKeys.swap(merged);
+                keys[half] = std::vector<T>();
+            }
+
+            QVector<int64_t> star(maxStar);
+            ComponentSet<T> set(maxStar);
+            int64_t noGroupKeys = groupKeys.size();
+            for(int64_t i = 0;i < noGroupKeys;i ++) {
+                int64_t v = groupKeys[join ? noGroupKeys - 1 - i : i];
+                bool outer = join ? glueVertex(fn, v, l, blockSize, child, sibling, link, star, set)
+                                  : glueVertexSplit(fn, v, l, blockSize, child, sibling, link, star, set);
+                if(l == noLevels) {
+                    glueComponents(v, set, join ? MAXIMUM : MINIMUM, arcs, closing);
+                    continue;
+                }
+                if(join) {
+                    updateJoinComponents(v, set);
+                } else {
+                    updateSplitComponents(v, set);
+                }
+                if(outer || set.size() != 1) {
+                    link[v] += KEY;
+                }
+            }
+            if(l == noLevels) {
+                continue;
+            }
+
+            for(int64_t i = 0;i < noGroupKeys;i ++) {
+                if(link[groupKeys[i]] / KEY > l) {
+                    child[groupKeys[i]] = -1;
+                }
+            }
+            for(int64_t i = 0;i < noGroupKeys;i ++) {
+                if(link[groupKeys[i]] / KEY > l) {
+                    linkKey(groupKeys[i], l, tree, types, link, child, sibling, heads[(l - 1) * noBlocks + g]);
+                }
+            }
+            groupKeys.erase(std::remove_if(groupKeys.begin(), groupKeys.end(), [&link, l](T v) { return link[v] / KEY <= l; }), groupKeys.end());
+        }
+    }
+
+    // the arcs of the vertices above (below) the ones that dropped out at a level are known
+    // once the levels above it are done
+    for(int l = noLevels - 1;l > 0;l --) {
+        int noGroups = ((noBlocks - 1) >> l) + 1;
+#pragma omp parallel for schedule(dynamic, 1)
+        for(int g = 0;g < noGroups;g ++) {
+            const std::vector<T> &levelHeads = heads[(l - 1) * noBlocks + g];
+            for(size_t i = 0;i < levelHeads.size();i ++) {
+                T a = arcs[child[levelHeads[i]]];
+                for(T u = levelHeads[i];u != (T)(-1) && link[u] / KEY == l;u = tree[u]) {
+                    // skip the arcs that were closed by a saddle before the sweep reached u
+                    while(closing[a] != (T)(-1) && (join ? fn.lessThan(u, closing[a]) : fn.lessThan(closing[a], u))) {
+                        a = arcs[closing[a]];
+                    }
+                    arcs[u] = a;
+                }
+            }
+        }
+    }
+    linkArcs(fn, type, noBlocks, tree, link, child, sibling, arcs, closing);
+    child = std::vector<T>();
+    sibling = std::vector<T>();
+}
+
+/**
+ * Links the key vertex v, which is still a key vertex at the level above the given one,
+ * into the child list of the first key vertex below (join tree) or above (split tree) it
+ * in the tree of its group, and resets its type, tree arc and union-find entry for the
+ * next sweep. The vertices on the way drop out at this level, and their child entry holds
+ * v instead, which stands in for them in the sweeps above. They have a single child each,
+ * so every path is walked once.
+ */
+template <class T>
+void MergeTree<T>::linkKey(int64_t v, int level, std::vector<T> &tree, const std::vector<char> &types, const std::vector<char> &link,
+                           std::vector<T> &child, std::vector<T> &sibling, std::vector<T> &heads) {
+    T p = tree[v];
+    if(p != (T)(-1) && link[p] / KEY == level) {
+        heads.push_back(p);
+    }
+    while(p != (T)(-1) && link[p] / KEY == level) {
+        child[p] = v;
+        p = tree[p];
+    }
+    if(p != (T)(-1)) {
+        sibling[v] = child[p];
+        child[p] = v;
+    }
+    tree[v] = -1;
+    criticalPts[v] = types[v];
+    nodes.reset(v);
+}
+
+/**
+ * Links every vertex to the next vertex of its arc in sweep order, or to the saddle that
+ * closes the arc if it is the last one. This scans one range of sv per block with an array
+ * over the arcs, and only the arcs that continue from one range into the next are linked
+ * serially. The vertices that were not key vertices of the glue are put on their arcs on the
+ * way, starting from the arc of the vertex before them on their local arc, or from that of
+ * the key vertex above (below) them if that vertex is in an earlier range.
+ */
+template <class T>
+template <class Function>
+void MergeTree<T>::linkArcs(const Function &fn, TreeType type, int noBlocks, std::vector<T> &tree, const std::vector<char> &link,
+                            const std::vector<T> &child, const std::vector<T> &sibling, std::vector<T> &arcs, const std::vector<T> &closing) {
+    bool join = (type == TypeJoinTree);
+    int64_t noArcs = closing.size();
+    // more ranges than blocks, since the saddles are not spread evenly over sv
+    int noRanges = 4 * noBlocks;
+    int64_t rangeSize = (noVertices + noRanges - 1) / noRanges;
+    std::vector<std::vector<T> > firsts(noRanges), lasts(noRanges);
+#pragma omp parallel
+    {
+        std::vector<T> last(noArcs, -1);
+#pragma omp for schedule(dynamic, 1)
+        for(int c = 0;c < noRanges;c ++) {
+            int64_t st = std::min(noVertices, c * rangeSize);
+            int64_t en = std::min(noVertices, st + rangeSize);
+            if(st == en) {
+                continue;
+            }
+            int64_t first = sv[join ? en - 1 : st];
+            for(int64_t i = 0;i < en - st;i ++) {
+                int64_t v = sv[join ? en - 1 - i : st + i];
+                if(link[v] == ISOLATED) {
+                    continue;
+                }
+                if(link[v] < KEY) {
+                    T p = sibling[v];
+                    bool inRange = (link[p] >= KEY) || (join ? !fn.lessThan(first, p) : !fn.lessThan(p, first));
+                    T a = inRange ? arcs[p] : arcs[child[v]];
+                    while(closing[a] != (T)(-1) && (join ? fn.lessThan(v, closing[a]) : fn.lessThan(closing[a], v))) {
+                        a = arcs[closing[a]];
+                    }
+                    arcs[v] = a;
+                }
+                T a = arcs[v];
+                if(last[a] == (T)(-1)) {
+                    firsts[c].push_back(v);
+                } else {
+                    tree[last[a]] = v;
+                }
+                last[a] = v;
+            }
+            lasts[c].resize(firsts[c].size());
+            for(size_t i = 0;i < firsts[c].size();i ++) {
+                T a = arcs[firsts[c][i]];
+                lasts[c][i] = last[a];
+                last[a] = -1;
+            }
+        }
+    }
+
+    std::vector<T> last(noArcs, -1);
+    for(int r = 0;r < noRanges;r ++) {
+        int c = join ? noRanges - 1 - r : r;
+        for(size_t i = 0;i < firsts[c].size();i ++) {
+            T a = arcs[firsts[c][i]];
+            if(last[a] != (T)(-1)) {
+                tree[last[a]] = firsts[c][i];
+            }
+            last[a] = lasts[c][i];
+        }
+    }
+    for(int64_t a = 0;a < noArcs;a ++) {
+        tree[last[a]] = closing[a];
+    }
+}
+
+template <class T>
+void MergeTree<T>::output(QString fileName, TreeType tree)
 {
     if(tree == TypeContourTree) {
         ctree.output(fileName);
@@ -151,20 +724,13 @@ void MergeTree::output(QString fileName, TreeType tree)
 
     // write meta data
     qDebug() << "Writing meta data";
-    {
-        QFile pr(fileName + ".rg.dat");
-        if(!pr.open(QFile::WriteOnly | QIODevice::Text)) {
-            qDebug() << "could not write to file" << fileName + ".rg.dat";
-        }
-        QTextStream text(&pr);
-        text << noNodes << "\n";
-        text << noArcs << "\n";
-        pr.close();
-    }
+    float minVal, maxVal;
+    getValueRange(minVal, maxVal);
+    ContourTreeData::writeMetaData(fileName, noNodes, noArcs, data->getValueType(), minVal, maxVal);
 
     qDebug() << ("Creating required memory!");
     std::vector<int64_t> nodeids(noNodes);
-    std::vector<unsigned char> nodefns(noNodes);
+    std::vector<float> nodefns(noNodes);
     std::vector<char> nodeTypes(noNodes);
     std::vector<int64_t> arcs(noArcs * 2);
 
@@ -176,12 +742,12 @@ void MergeTree::output(QString fileName, TreeType tree)
     if(newVertex) {
         if(tree == TypeJoinTree){
             nodeids[nct] = noVertices;
-            nodefns[nct] = 0;
+            nodefns[nct] = minVal;
             nodeTypes[nct] = MINIMUM;
             nct ++;
         }
     }
-    for(int i = 0;i < noVertices;i ++) {
+    for(int64_t i = 0;i < noVertices;i ++) {
         if(criticalPts[sv[i]] != REGULAR) {
             nodeids[nct] = sv[i];
             nodefns[nct] = data->getFunctionValue(sv[i]);
@@ -192,7 +758,7 @@ void MergeTree::output(QString fileName, TreeType tree)
     if(newVertex) {
         if(tree != TypeJoinTree){
             nodeids[nct] = noVertices;
-            nodefns[nct] = 255;
+            nodefns[nct] = maxVal;
             nodeTypes[nct] = MAXIMUM;
             nct ++;
         }
@@ -223,8 +789,8 @@ void MergeTree::output(QString fileName, TreeType tree)
             }
         }
         if(newVertex) {
-            int to = sv[0];
-            int from = noVertices;
+            int64_t to = sv[0];
+            int64_t from = noVertices;
             arcs[arcNo * 2 + 0] = from;
             arcs[arcNo * 2 + 1] = to;
             arcMap[to] = arcMap[from] = arcNo ++;
@@ -255,8 +821,8 @@ void MergeTree::output(QString fileName, TreeType tree)
             }
         }
         if(newVertex) {
-            int from = sv[sv.size() - 1];
-            int to = noVertices;
+            int64_t from = sv[sv.size() - 1];
+            int64_t to = noVertices;
             arcs[arcNo * 2 + 0] = from;
             arcs[arcNo * 2 + 1] = to;
             arcMap[to] = arcMap[from] = arcNo ++;
@@ -268,7 +834,7 @@ void MergeTree::output(QString fileName, TreeType tree)
     QString rgFile = fileName + ".rg.bin";
     std::ofstream of(rgFile.toStdString(),std::ios::binary);
     of.write((char *)nodeids.data(),nodeids.size() * sizeof(int64_t));
-    of.write((char *)nodefns.data(),nodeids.size());
+    ContourTreeData::writeFunctionValues(of, nodefns, data->getValueType());
     of.write((char *)nodeTypes.data(),nodeids.size());
     of.write((char *)arcs.data(),arcs.size() * sizeof(int64_t));
     of.close();
@@ -280,72 +846,313 @@ void MergeTree::output(QString fileName, TreeType tree)
     of.close();
 }
 
-void MergeTree::processVertex(int64_t v) {
-    int starct = data->getStar(v, star);
+/**
+ * Range of the function values used to normalize them, the full range of the type
+ * for integral values and the range of the data otherwise. The new root of the tree
+ * gets the lower or upper bound as function value.
+ */
+template <class T>
+void MergeTree<T>::getValueRange(float &minVal, float &maxVal) const {
+    switch(data->getValueType()) {
+    case TypeUInt8:
+        minVal = 0;
+        maxVal = 255;
+        break;
+
+    case TypeUInt16:
+        minVal = 0;
+        maxVal = 65535;
+        break;
+
+    default:
+        minVal = data->getFunctionValue(sv[0]);
+        maxVal = data->getFunctionValue(sv[noVertices - 1]);
+    }
+}
+
+template <class T>
+template <class Function>
+void MergeTree<T>::processVertex(const Function &fn, int64_t v) {
+    int starct = fn.getStar(v, star);
     if(starct == 0) {
         return;
     }
     set.clear();
     for(int x = 0;x < starct; x++) {
         int64_t tin = star[x];
-        if(data->lessThan(v,tin)) {
+        if(fn.lessThan(v,tin)) {
             // upperLink
-            int64_t comp = nodes.find(tin);
-            set << comp;
+            T comp = nodes.find(tin);
+            set.insert(comp);
+        }
+    }
+    updateJoinComponents(v, set);
+}
+
+template <class T>
+template <class Function>
+void MergeTree<T>::processVertexSplit(const Function &fn, int64_t v) {
+    int starct = fn.getStar(v, star);
+    if(starct == 0) {
+        return;
+    }
+    set.clear();
+    for(int x = 0;x < starct; x++) {
+        int64_t tin = star[x];
+        if(!(fn.lessThan(v,tin))) {
+            // lowerLink
+            T comp = nodes.find(tin);
+            set.insert(comp);
         }
     }
+    updateSplitComponents(v, set);
+}
+
+template <class T>
+void MergeTree<T>::updateJoinComponents(int64_t v, ComponentSet<T> &set) {
     if(set.size() == 0) {
         // Maximum
-        int64_t comp = nodes.find(v);
+        T comp = nodes.find(v);
         cpMap[comp] = v;
         criticalPts[v] = MAXIMUM;
     } else {
         if(set.size() > 1) {
             criticalPts[v] = SADDLE;
         }
-        foreach(int64_t comp, set) {
+        for(int i = 0;i < set.size();i ++) {
+            T comp = set[i];
             int64_t to = cpMap[comp];
             int64_t from = v;
             prev[to] = from;
             nodes.merge(comp, v);
         }
-        int64_t comp = nodes.find(v);
+        T comp = nodes.find(v);
         cpMap[comp] = v;
     }
 }
 
-void MergeTree::processVertexSplit(int64_t v) {
-    int starct = data->getStar(v, star);
-    if(starct == 0) {
-        return;
-    }
-    set.clear();
-    for(int x = 0;x < starct; x++) {
-        int64_t tin = star[x];
-        if(!(data->lessThan(v,tin))) {
-            // lowerLink
-            int64_t comp = nodes.find(tin);
-            set << comp;
-        }
-    }
+template <class T>
+void MergeTree<T>::updateSplitComponents(int64_t v, ComponentSet<T> &set) {
     if(set.size() == 0) {
         // Minimum
-        int64_t comp = nodes.find(v);
+        T comp = nodes.find(v);
         cpMap[comp] = v;
         criticalPts[v] = MINIMUM;
     } else {
         if(set.size() > 1) {
             criticalPts[v] = SADDLE;
         }
-        foreach(int64_t comp, set) {
+        for(int i = 0;i < set.size();i ++) {
+            T comp = set[i];
             int64_t from = cpMap[comp];
             int64_t to = v;
             next[from] = to;
             nodes.merge(comp, v);
         }
-        int64_t comp = nodes.find(v);
+        T comp = nodes.find(v);
         cpMap[comp] = v;
     }
 }
 
+template <class T>
+template <class Function>
+void MergeTree<T>::processVertexBlock(const Function &fn, int64_t v, int64_t from, int64_t to, QVector<int64_t> &star, ComponentSet<T> &set, std::vector<char> &link,
+                                       std::vector<T> &child, std::vector<T> &sibling) {
+    int starct = fn.getStar(v, star);
+    if(starct == 0) {
+        link[v] = ISOLATED;
+        return;
+    }
+    set.clear();
+    for(int x = 0;x < starct; x++) {
+        int64_t tin = star[x];
+        if(tin < from || tin >= to) {
+            // handled while gluing
+            if(fn.lessThan(v,tin)) {
+                link[v] = BOUNDARY;
+            }
+            continue;
+        }
+        if(fn.lessThan(v,tin)) {
+            // upperLink
+            T comp = nodes.find(tin);
+            set.insert(comp);
+        }
+    }
+    bool key = (set.size() != 1 || link[v] == BOUNDARY);
+    contractVertex(v, key, set, link, child, sibling);
+    updateJoinComponents(v, set);
+    if(key) {
+        link[v] += KEY;
+    }
+}
+
+template <class T>
+template <class Function>
+void MergeTree<T>::processVertexSplitBlock(const Function &fn, int64_t v, int64_t from, int64_t to, QVector<int64_t> &star, ComponentSet<T> &set, std::vector<char> &link,
+                                            std::vector<T> &child, std::vector<T> &sibling) {
+    int starct = fn.getStar(v, star);
+    if(starct == 0) {
+        link[v] = ISOLATED;
+        return;
+    }
+    set.clear();
+    for(int x = 0;x < starct; x++) {
+        int64_t tin = star[x];
+        if(tin < from || tin >= to) {
+            // handled while gluing
+            if(!(fn.lessThan(v,tin))) {
+                link[v] = BOUNDARY;
+            }
+            continue;
+        }
+        if(!(fn.lessThan(v,tin))) {
+            // lowerLink
+            T comp = nodes.find(tin);
+            set.insert(comp);
+        }
+    }
+    bool key = (set.size() != 1 || link[v] == BOUNDARY);
+    contractVertex(v, key, set, link, child, sibling);
+    updateSplitComponents(v, set);
+    if(key) {
+        link[v] += KEY;
+    }
+}
+
+/**
+ * Records v in the contracted local tree before its components are merged: a key vertex
+ * gets a child list of the first key vertices above (join tree) or below (split tree) it.
+ * Any other vertex gets the first key vertex above (below) it in its child entry, which
+ * stands in for it in the glue, and the vertex before it on its local arc in its sibling
+ * entry.
+ */
+template <class T>
+void MergeTree<T>::contractVertex(int64_t v, bool key, ComponentSet<T> &set, const std::vector<char> &link, std::vector<T> &child, std::vector<T> &sibling) {
+    for(int i = 0;i < set.size();i ++) {
+        T last = cpMap[set[i]];
+        T top = (link[last] >= KEY) ? last : child[last];
+        if(key) {
+            sibling[top] = child[v];
+            child[v] = top;
+        } else {
+            child[v] = top;
+            sibling[v] = last;
+        }
+    }
+}
+
+/**
+ * Collects the components above v in the sweep of its group at the given level: those of
+ * its child list, and those of its upper neighbours in the other half of the group, which
+ * are represented by the first key vertex above them.
+ *
+ * @return whether v has an upper neighbour outside the group
+ */
+template <class T>
+template <class Function>
+bool MergeTree<T>::glueVertex(const Function &fn, int64_t v, int level, int64_t blockSize, const std::vector<T> &child, const std::vector<T> &sibling,
+                              const std::vector<char> &link, QVector<int64_t> &star, ComponentSet<T> &set) {
+    set.clear();
+    for(T c = child[v];c != (T)(-1);c = sibling[c]) {
+        set.insert(nodes.find(c));
+    }
+    bool outer = false;
+    if(link[v] & BOUNDARY) {
+        // the vertex ranges of the half of the group that v is in and of the group
+        int64_t half = blockSize << (level - 1);
+        int64_t halfSt = v / half * half;
+        int64_t groupSt = v / (2 * half) * (2 * half);
+        int starct = fn.getStar(v, star);
+        for(int x = 0;x < starct; x++) {
+            int64_t tin = star[x];
+            if(!(fn.lessThan(v,tin)) || (tin >= halfSt && tin < halfSt + half)) {
+                continue;
+            }
+            if(tin < groupSt || tin >= groupSt + 2 * half) {
+                outer = true;
+                continue;
+            }
+            T u = tin;
+            while(link[u] / KEY < level) {
+                u = child[u];
+            }
+            set.insert(nodes.find(u));
+        }
+    }
+    return outer;
+}
+
+template <class T>
+template <class Function>
+bool MergeTree<T>::glueVertexSplit(const Function &fn, int64_t v, int level, int64_t blockSize, const std::vector<T> &child, const std::vector<T> &sibling,
+                                   const std::vector<char> &link, QVector<int64_t> &star, ComponentSet<T> &set) {
+    set.clear();
+    for(T c = child[v];c != (T)(-1);c = sibling[c]) {
+        set.insert(nodes.find(c));
+    }
+    bool outer = false;
+    if(link[v] & BOUNDARY) {
+        // the vertex ranges of the half of the group that v is in and of the group
+        int64_t half = blockSize << (level - 1);
+        int64_t halfSt = v / half * half;
+        int64_t groupSt = v / (2 * half) * (2 * half);
+        int starct = fn.getStar(v, star);
+        for(int x = 0;x < starct; x++) {
+            int64_t tin = star[x];
+            if(fn.lessThan(v,tin) || (tin >= halfSt && tin < halfSt + half)) {
+                continue;
+            }
+            if(tin < groupSt || tin >= groupSt + 2 * half) {
+                outer = true;
+                continue;
+            }
+            T u = tin;
+            while(link[u] / KEY < level) {
+                u = child[u];
+            }
+            set.insert(nodes.find(u));
+        }
+    }
+    return outer;
+}
+
+/**
+ * Merges the components in set at the key vertex v in the sweep of the last level. Instead
+ * of the arcs of the augmented tree, it records the arc that v lies on, which it starts if
+ * it is an extremum or a saddle, and the saddle that closes an arc.
+ */
+template <class T>
+void MergeTree<T>::glueComponents(int64_t v, ComponentSet<T> &set, char extremum, std::vector<T> &arcs, std::vector<T> &closing) {
+    if(set.size() == 1) {
+        arcs[v] = arcs[cpMap[set[0]]];
+    } else {
+        criticalPts[v] = (set.size() == 0) ? extremum : SADDLE;
+        for(int i = 0;i < set.size();i ++) {
+            closing[arcs[cpMap[set[i]]]] = v;
+        }
+        arcs[v] = closing.size();
+        closing.push_back(-1);
+    }
+    for(int i = 0;i < set.size();i ++) {
+        nodes.merge(set[i], v);
+    }
+    cpMap[nodes.find(v)] = v;
+}
+
+void computeMergeTree(ScalarFunction* data, TreeType type, QString fileName, bool parallel) {
+    if(data->getVertexCount() < int64_t(std::numeric_limits<uint32_t>::max())) {
+        MergeTree<uint32_t> ct;
+        ct.computeTree(data, type, parallel);
+        ct.output(fileName, type);
+    } else {
+        MergeTree<int64_t> ct;
+        ct.computeTree(data, type, parallel);
+        ct.output(fileName, type);
+    }
+}
+
+template class MergeTree<int64_t>;
+template class MergeTree<uint32_t>;
+
 }
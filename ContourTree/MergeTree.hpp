@@ -5,11 +5,16 @@
 #include "ScalarFunction.hpp"
 #include <vector>
 #include "DisjointSets.hpp"
-#include <QSet>
+#include "ComponentSet.hpp"
 #include "ContourTree.hpp"
 
 namespace contourtree {
 
+/**
+ * T is the type used to index vertices in the per vertex arrays. Use uint32_t when
+ * there are less than 2^32 - 1 vertices to halve the working set of the sweep.
+ */
+template <class T>
 class MergeTree
 {
 public:
@@ -25,38 +30,79 @@ public:
 public:
     MergeTree();
 
-    void computeTree(ScalarFunction* data, TreeType type);
+    void computeTree(ScalarFunction* data, TreeType type, bool parallel = false);
     void computeJoinTree();
     void computeSplitTree();
+    void computeJoinTreeParallel();
+    void computeSplitTreeParallel();
     void output(QString fileName, TreeType tree);
+    void getValueRange(float &minVal, float &maxVal) const;
 
 protected:
     void setupData();
     void orderVertices();
-    void processVertex(int64_t v);
-    void processVertexSplit(int64_t v);
+    template <class V> void countingSortVertices(const V *fnVals);
+
+    // the sweeps are templated on the star and order queries so that they can be inlined
+    void dispatchSweep(TreeType type, bool parallel);
+    template <class Function> void sweep(const Function &fn, TreeType type, bool parallel);
+    template <class Function> void sweepJoinTree(const Function &fn);
+    template <class Function> void sweepSplitTree(const Function &fn);
+    template <class Function> void sweepJoinTreeParallel(const Function &fn);
+    template <class Function> void sweepSplitTreeParallel(const Function &fn);
+    template <class Function> void processVertex(const Function &fn, int64_t v);
+    template <class Function> void processVertexSplit(const Function &fn, int64_t v);
+    void updateJoinComponents(int64_t v, ComponentSet<T> &set);
+    void updateSplitComponents(int64_t v, ComponentSet<T> &set);
+
+    // block-parallel construction: local trees on contiguous vertex ranges that are glued afterwards
+    int64_t partitionVertices(int noBlocks, std::vector<T> &order);
+    template <class Function> void processVertexBlock(const Function &fn, int64_t v, int64_t from, int64_t to, QVector<int64_t> &star, ComponentSet<T> &set, std::vector<char> &link,
+                                                      std::vector<T> &child, std::vector<T> &sibling);
+    template <class Function> void processVertexSplitBlock(const Function &fn, int64_t v, int64_t from, int64_t to, QVector<int64_t> &star, ComponentSet<T> &set, std::vector<char> &link,
+                                                           std::vector<T> &child, std::vector<T> &sibling);
+    void contractVertex(int64_t v, bool key, ComponentSet<T> &set, const std::vector<char> &link, std::vector<T> &child, std::vector<T> &sibling);
+    template <class Function> void glueBlockTrees(const Function &fn, TreeType type, int noBlocks, int64_t blockSize, std::vector<T> &order, std::vector<char> &link,
+                                                  const std::vector<char> &types, std::vector<T> &child, std::vector<T> &sibling);
+    void linkKey(int64_t v, int level, std::vector<T> &tree, const std::vector<char> &types, const std::vector<char> &link,
+                 std::vector<T> &child, std::vector<T> &sibling, std::vector<T> &heads);
+    template <class Function> void linkArcs(const Function &fn, TreeType type, int noBlocks, std::vector<T> &tree, const std::vector<char> &link,
+                                            const std::vector<T> &child, const std::vector<T> &sibling, std::vector<T> &arcs, const std::vector<T> &closing);
+    template <class Function> bool glueVertex(const Function &fn, int64_t v, int level, int64_t blockSize, const std::vector<T> &child, const std::vector<T> &sibling,
+                                              const std::vector<char> &link, QVector<int64_t> &star, ComponentSet<T> &set);
+    template <class Function> bool glueVertexSplit(const Function &fn, int64_t v, int level, int64_t blockSize, const std::vector<T> &child, const std::vector<T> &sibling,
+                                                   const std::vector<char> &link, QVector<int64_t> &star, ComponentSet<T> &set);
+    void glueComponents(int64_t v, ComponentSet<T> &set, char extremum, std::vector<T> &arcs, std::vector<T> &closing);
 
 public:
     ScalarFunction* data;
-    std::vector<int64_t> cpMap;
-    DisjointSets<int64_t> nodes;
+    std::vector<T> cpMap;
+    DisjointSets<T> nodes;
 
     int64_t noVertices;
     int maxStar;
-    std::vector<int64_t> prev;
-    std::vector<int64_t> next;
-    std::vector<int64_t> sv;
+    std::vector<T> prev;
+    std::vector<T> next;
+    std::vector<T> sv;
     std::vector<char> criticalPts;
     bool newVertex;
     int64_t newRoot;
+    // log the progress of the sweeps
+    bool showProgress;
 
-    QSet<int64_t> set;
-    ContourTree ctree;
+    ComponentSet<T> set;
+    ContourTree<T> ctree;
 
 private:
     QVector<int64_t> star;
 };
 
+/**
+ * Computes the tree with 32-bit vertex indices whenever the vertex count allows it
+ * and writes it to fileName.
+ */
+void computeMergeTree(ScalarFunction* data, TreeType type, QString fileName, bool parallel = false);
+
 }
 
 #endif // MERGETREE_H
@@ -0,0 +1,328 @@
+#include "PartitionFile.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <cassert>
+#include <QDebug>
+#include <QFile>
+
+namespace contourtree {
+
+namespace {
+    const char MAGIC[8] = {'C', 'T', 'P', 'A', 'R', 'T', 'B', 'K'};
+    const uint32_t VERSION = 1;
+
+    int bitsFor(size_t paletteSize) {
+        int bits = 0;
+        while((size_t(1) << bits) < paletteSize) {
+            bits ++;
+        }
+        return bits;
+    }
+}
+
+PartitionWriter::PartitionWriter(QString fileName, int dimx, int dimy, int dimz, int brickSize) :
+    of(fileName.toStdString(), std::ios::binary), noLayerSlices(0), bz(0)
+{
+    memset(&header, 0, sizeof(PartitionHeader));
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.brickSize = brickSize;
+    header.dimx = dimx;
+    header.dimy = dimy;
+    header.dimz = dimz;
+    header.bricksx = (dimx + brickSize - 1) / brickSize;
+    header.bricksy = (dimy + brickSize - 1) / brickSize;
+    header.bricksz = (dimz + brickSize - 1) / brickSize;
+    header.noBricks = uint64_t(header.bricksx) * header.bricksy * header.bricksz;
+
+    if(!of.is_open()) {
+        qDebug() << "could not write to file" << fileName;
+    }
+    // the offsets are written again when closing
+    offsets.resize(header.noBricks + 1, 0);
+    of.write((const char *)&header, sizeof(PartitionHeader));
+    of.write((const char *)offsets.data(), offsets.size() * sizeof(uint64_t));
+    pos = sizeof(PartitionHeader) + offsets.size() * sizeof(uint64_t);
+    offsets.clear();
+
+    layer.resize(int64_t(dimx) * dimy * brickSize);
+}
+
+/**
+ * Adds the next noSlices z-slices of the volume.
+ */
+void PartitionWriter::addSlices(const uint32_t *slices, int noSlices) {
+    int64_t sliceSize = int64_t(header.dimx) * header.dimy;
+    while(noSlices > 0) {
+        int ct = std::min<int>(noSlices, header.brickSize - noLayerSlices);
+        std::copy(slices, slices + ct * sliceSize, layer.begin() + noLayerSlices * sliceSize);
+        noLayerSlices += ct;
+        slices += ct * sliceSize;
+        noSlices -= ct;
+        if(noLayerSlices == (int)header.brickSize || bz * header.brickSize + noLayerSlices == header.dimz) {
+            writeBrickLayer();
+        }
+    }
+}
+
+bool PartitionWriter::close() {
+    assert(offsets.size() == header.noBricks);
+    offsets.push_back(pos);
+    of.seekp(sizeof(PartitionHeader));
+    of.write((const char *)offsets.data(), offsets.size() * sizeof(uint64_t));
+    of.close();
+    return !of.fail();
+}
+
+void PartitionWriter::writeBrickLayer() {
+    for(uint32_t by = 0;by < header.bricksy;by ++) {
+        for(uint32_t bx = 0;bx < header.bricksx;bx ++) {
+            encodeBrick(bx, by, noLayerSlices);
+        }
+    }
+    noLayerSlices = 0;
+    bz ++;
+}
+
+void PartitionWriter::encodeBrick(int bx, int by, int nz) {
+    int bs = header.brickSize;
+    int x0 = bx * bs;
+    int y0 = by * bs;
+    int nx = std::min<int>(bs, header.dimx - x0);
+    int ny = std::min<int>(bs, header.dimy - y0);
+
+    brick.clear();
+    for(int z = 0;z < nz;z ++) {
+        for(int y = 0;y < ny;y ++) {
+            const uint32_t *row = layer.data() + (int64_t(z) * header.dimy + y0 + y) * header.dimx + x0;
+            brick.insert(brick.end(), row, row + nx);
+        }
+    }
+    palette = brick;
+    std::sort(palette.begin(), palette.end());
+    palette.erase(std::unique(palette.begin(), palette.end()), palette.end());
+
+    uint32_t bits = bitsFor(palette.size());
+    packed.assign((brick.size() * bits + 63) / 64, 0);
+    if(bits > 0) {
+        for(size_t i = 0;i < brick.size();i ++) {
+            uint64_t index = std::lower_bound(palette.begin(), palette.end(), brick[i]) - palette.begin();
+            uint64_t bit = i * bits;
+            packed[bit / 64] |= index << (bit % 64);
+            if(bit % 64 + bits > 64) {
+                packed[bit / 64 + 1] |= index >> (64 - bit % 64);
+            }
+        }
+    }
+
+    // palette size, bits, palette padded to 8 bytes, packed indices
+    uint32_t paletteSize = palette.size();
+    if(palette.size() % 2 == 1) {
+        palette.push_back(0);
+    }
+    offsets.push_back(pos);
+    of.write((const char *)&paletteSize, sizeof(uint32_t));
+    of.write((const char *)&bits, sizeof(uint32_t));
+    of.write((const char *)palette.data(), palette.size() * sizeof(uint32_t));
+    of.write((const char *)packed.data(), packed.size() * sizeof(uint64_t));
+    pos += 2 * sizeof(uint32_t) + palette.size() * sizeof(uint32_t) + packed.size() * sizeof(uint64_t);
+}
+
+/**
+ * Converts a .part.raw file, reading one layer of bricks at a time.
+ *
+ * @return false if the raw file could not be read completely or the output could not be
+ * written, in which case no output file is left behind and the raw file has to be kept
+ */
+bool PartitionWriter::compress(QString rawFile, QString fileName, int dimx, int dimy, int dimz, int brickSize) {
+    std::ifstream ip(rawFile.toStdString(), std::ios::binary | std::ios::ate);
+    if(!ip.is_open()) {
+        qDebug() << "could not read file" << rawFile;
+        return false;
+    }
+    int64_t sliceSize = int64_t(dimx) * dimy * sizeof(uint32_t);
+    if(int64_t(ip.tellg()) != sliceSize * dimz) {
+        qDebug() << "size of" << rawFile << "does not match the volume dimensions";
+        return false;
+    }
+    ip.seekg(0);
+    bool complete = true;
+    {
+        PartitionWriter writer(fileName, dimx, dimy, dimz, brickSize);
+        std::vector<uint32_t> slices(int64_t(dimx) * dimy * brickSize);
+        for(int z = 0;z < dimz;z += brickSize) {
+            int noSlices = std::min(brickSize, dimz - z);
+            ip.read((char *)slices.data(), sliceSize * noSlices);
+            if(ip.gcount() != sliceSize * noSlices) {
+                qDebug() << "could not read slices" << z << "to" << z + noSlices - 1 << "of" << rawFile;
+                complete = false;
+                break;
+            }
+            writer.addSlices(slices.data(), noSlices);
+        }
+        complete = complete && writer.close();
+    }
+    if(!complete) {
+        QFile::remove(fileName);
+    }
+    return complete;
+}
+
+PartitionFile::PartitionFile() : offsets(NULL) {
+    memset(&header, 0, sizeof(PartitionHeader));
+}
+
+bool PartitionFile::open(QString fileName) {
+    offsets = NULL;
+    if(!file.map(fileName)) {
+        return false;
+    }
+    uint64_t size = file.size();
+    if(size < sizeof(PartitionHeader)) {
+        qDebug() << "not a partition file" << fileName;
+        file.unmap();
+        return false;
+    }
+    memcpy(&header, file.data(), sizeof(PartitionHeader));
+    if(memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION
+            || (size - sizeof(PartitionHeader)) / sizeof(uint64_t) < header.noBricks + 1) {
+        qDebug() << "not a partition file" << fileName;
+        file.unmap();
+        return false;
+    }
+    offsets = (const uint64_t *)(file.data() + sizeof(PartitionHeader));
+    if(offsets[header.noBricks] > size) {
+        qDebug() << "truncated partition file" << fileName;
+        file.unmap();
+        offsets = NULL;
+        return false;
+    }
+    if(!checkBricks()) {
+        qDebug() << "damaged partition file" << fileName;
+        file.unmap();
+        offsets = NULL;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Checks that the bricks tile the volume and that every brick lies within its offsets, with
+ * a palette of at least one and at most as many entries as it has voxels and at most 32 bits
+ * per voxel, so that readBrick stays inside the mapping.
+ */
+bool PartitionFile::checkBricks() const {
+    const uint64_t bs = header.brickSize;
+    if(bs == 0 || header.dimx == 0 || header.dimy == 0 || header.dimz == 0
+            || header.bricksx != (header.dimx + bs - 1) / bs || header.bricksy != (header.dimy + bs - 1) / bs
+            || header.bricksz != (header.dimz + bs - 1) / bs
+            || header.noBricks != uint64_t(header.bricksx) * header.bricksy * header.bricksz) {
+        return false;
+    }
+    if(offsets[0] < sizeof(PartitionHeader) + (header.noBricks + 1) * sizeof(uint64_t)) {
+        return false;
+    }
+    for(uint64_t b = 0;b < header.noBricks;b ++) {
+        if(offsets[b + 1] < offsets[b] || offsets[b + 1] - offsets[b] < 2 * sizeof(uint32_t)) {
+            return false;
+        }
+        int x0, y0, z0, nx, ny, nz;
+        getBrickExtent(b, x0, y0, z0, nx, ny, nz);
+        const uint64_t noVoxels = uint64_t(nx) * ny * nz;
+        const uint32_t *data = (const uint32_t *)(file.data() + offsets[b]);
+        const uint64_t paletteSize = data[0];
+        const uint64_t bits = data[1];
+        if(paletteSize < 1 || paletteSize > noVoxels || bits > 32) {
+            return false;
+        }
+        const uint64_t brickBytes = 2 * sizeof(uint32_t) + (paletteSize + paletteSize % 2) * sizeof(uint32_t)
+                + (noVoxels * bits + 63) / 64 * sizeof(uint64_t);
+        if(brickBytes > offsets[b + 1] - offsets[b]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int64_t PartitionFile::brickIndex(int bx, int by, int bz) const {
+    return (int64_t(bz) * header.bricksy + by) * header.bricksx + bx;
+}
+
+void PartitionFile::getBrickExtent(int64_t b, int &x0, int &y0, int &z0, int &nx, int &ny, int &nz) const {
+    int bs = header.brickSize;
+    x0 = (b % header.bricksx) * bs;
+    y0 = ((b / header.bricksx) % header.bricksy) * bs;
+    z0 = (b / (int64_t(header.bricksx) * header.bricksy)) * bs;
+    nx = std::min<int>(bs, header.dimx - x0);
+    ny = std::min<int>(bs, header.dimy - y0);
+    nz = std::min<int>(bs, header.dimz - z0);
+}
+
+/**
+ * Decodes brick b into vals, in x, y, z order within the brick.
+ *
+ * @return false if the brick refers to an entry past the end of its palette
+ */
+bool PartitionFile::readBrick(int64_t b, std::vector<uint32_t> &vals) const {
+    int x0, y0, z0, nx, ny, nz;
+    getBrickExtent(b, x0, y0, z0, nx, ny, nz);
+    vals.resize(int64_t(nx) * ny * nz);
+
+    const uint32_t *data = (const uint32_t *)(file.data() + offsets[b]);
+    uint32_t paletteSize = data[0];
+    uint32_t bits = data[1];
+    const uint32_t *palette = data + 2;
+    if(bits == 0) {
+        std::fill(vals.begin(), vals.end(), palette[0]);
+        return true;
+    }
+    const uint64_t *packed = (const uint64_t *)(palette + paletteSize + paletteSize % 2);
+    uint64_t mask = (uint64_t(1) << bits) - 1;
+    for(size_t i = 0;i < vals.size();i ++) {
+        uint64_t bit = i * bits;
+        uint64_t index = packed[bit / 64] >> (bit % 64);
+        if(bit % 64 + bits > 64) {
+            index |= packed[bit / 64 + 1] << (64 - bit % 64);
+        }
+        index &= mask;
+        if(index >= paletteSize) {
+            return false;
+        }
+        vals[i] = palette[index];
+    }
+    return true;
+}
+
+/**
+ * Decodes the slices z0 to z0 + noSlices - 1 into out, in the order of .part.raw.
+ * Every brick overlapping the slices is decoded once.
+ *
+ * @return false if one of the bricks is damaged, in which case out is only partly written
+ */
+bool PartitionFile::readSlices(int z0, int noSlices, uint32_t *out) const {
+    int bs = header.brickSize;
+    int64_t sliceSize = int64_t(header.dimx) * header.dimy;
+    std::vector<uint32_t> vals;
+    for(int bz = z0 / bs;bz * bs < z0 + noSlices;bz ++) {
+        for(uint32_t by = 0;by < header.bricksy;by ++) {
+            for(uint32_t bx = 0;bx < header.bricksx;bx ++) {
+                int64_t b = brickIndex(bx, by, bz);
+                int x0, y0, bz0, nx, ny, nz;
+                getBrickExtent(b, x0, y0, bz0, nx, ny, nz);
+                if(!readBrick(b, vals)) {
+                    return false;
+                }
+                for(int z = std::max(bz0, z0);z < std::min(bz0 + nz, z0 + noSlices);z ++) {
+                    for(int y = 0;y < ny;y ++) {
+                        const uint32_t *row = vals.data() + (int64_t(z - bz0) * ny + y) * nx;
+                        std::copy(row, row + nx, out + (z - z0) * sliceSize + int64_t(y0 + y) * header.dimx + x0);
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,94 @@
+#ifndef PARTITIONFILE_HPP
+#define PARTITIONFILE_HPP
+
+#include "MappedFile.hpp"
+#include <QString>
+#include <stdint.h>
+#include <vector>
+#include <fstream>
+
+namespace contourtree {
+
+/*
+ * Compressed storage (.part.brk) of the segmentation written as .part.raw, which has
+ * the arc id of every voxel as uint32_t in x, y, z order.
+ *
+ * The volume is split into bricks of brickSize^3 voxels, clipped at the border. Each
+ * brick stores the sorted distinct arc ids it contains and, for every voxel, the index
+ * into this palette packed with as many bits as the palette needs. Since the arcs are
+ * spatially coherent, most bricks need only a few bits per voxel, and bricks inside a
+ * single arc none at all. The file starts with a header and the offsets of all bricks,
+ * so any brick can be decoded on its own.
+ */
+struct PartitionHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t brickSize;
+    uint32_t dimx, dimy, dimz;
+    uint32_t bricksx, bricksy, bricksz;
+    uint64_t noBricks;
+};
+
+/**
+ * Writes a .part.brk file from z-slices given in order, buffering one layer of bricks.
+ */
+class PartitionWriter
+{
+public:
+    PartitionWriter(QString fileName, int dimx, int dimy, int dimz, int brickSize = 32);
+
+    void addSlices(const uint32_t *slices, int noSlices);
+    bool close();
+
+    static bool compress(QString rawFile, QString fileName, int dimx, int dimy, int dimz, int brickSize = 32);
+
+protected:
+    void writeBrickLayer();
+    void encodeBrick(int bx, int by, int nz);
+
+public:
+    PartitionHeader header;
+
+protected:
+    std::ofstream of;
+    std::vector<uint64_t> offsets;
+    uint64_t pos;
+    // the slices of the current layer of bricks
+    std::vector<uint32_t> layer;
+    int noLayerSlices;
+    int bz;
+
+    std::vector<uint32_t> brick;
+    std::vector<uint32_t> palette;
+    std::vector<uint64_t> packed;
+};
+
+/**
+ * Random access to the bricks of a mapped .part.brk file.
+ */
+class PartitionFile
+{
+public:
+    PartitionFile();
+
+    bool open(QString fileName);
+
+    int64_t brickIndex(int bx, int by, int bz) const;
+    void getBrickExtent(int64_t b, int &x0, int &y0, int &z0, int &nx, int &ny, int &nz) const;
+    bool readBrick(int64_t b, std::vector<uint32_t> &vals) const;
+    bool readSlices(int z0, int noSlices, uint32_t *out) const;
+
+public:
+    PartitionHeader header;
+
+protected:
+    bool checkBricks() const;
+
+protected:
+    MappedFile file;
+    const uint64_t *offsets;
+};
+
+}
+
+#endif // PARTITIONFILE_HPP
@@ -6,18 +6,22 @@ Persistence::Persistence(const ContourTreeData &ctData) {
     fnVals = ctData.fnVals.data();
 }
 
-void Persistence::init(std::vector<float> &fn, std::vector<Branch> &br) {
+void Persistence::init(std::vector<float> &fn, Branches &br) {
     this->fn = fn.data();
     for(int i = 0;i < fn.size();i ++) {
-        this->fn[i] = fnVals[br[i].to] - fnVals[br[i].from];
+        this->fn[i] = fnVals[br.to[i]] - fnVals[br.from[i]];
     }
 }
 
-void Persistence::update(const std::vector<Branch> &br, uint32_t brNo) {
-    fn[brNo] = fnVals[br[brNo].to] - fnVals[br[brNo].from];
+void Persistence::update(const Branches &br, uint32_t brNo) {
+    fn[brNo] = fnVals[br.to[brNo]] - fnVals[br.from[brNo]];
 }
 
-void Persistence::branchRemoved(std::vector<Branch>&, uint32_t, std::vector<bool>&) {
+void Persistence::branchRemoved(Branches&, uint32_t, std::vector<bool>&) {
+    // not required for persistence
+}
+
+void Persistence::branchMerged(const Branches&, uint32_t, uint32_t, const std::vector<uint32_t>&) {
     // not required for persistence
 }
 
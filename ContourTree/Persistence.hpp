@@ -11,9 +11,10 @@ class Persistence : public SimFunction
 public:
     Persistence(const ContourTreeData& ctData);
 
-    void init(std::vector<float> &fn, std::vector<Branch> &br);
-    void update(const std::vector<Branch> &br, uint32_t brNo);
-    void branchRemoved(std::vector<Branch>& br, uint32_t brNo, std::vector<bool>& invalid);
+    void init(std::vector<float> &fn, Branches &br);
+    void update(const Branches &br, uint32_t brNo);
+    void branchRemoved(Branches& br, uint32_t brNo, std::vector<bool>& invalid);
+    void branchMerged(const Branches& br, uint32_t brNo, uint32_t merged, const std::vector<uint32_t>& children);
     float getBranchWeight(uint32_t brNo);
 
 public:
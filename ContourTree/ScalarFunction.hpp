@@ -1,6 +1,7 @@
 #ifndef SCALARFUNCTION
 #define SCALARFUNCTION
 
+#include "constants.h"
 #include <QVector>
 #include <stdint.h>
 
@@ -10,10 +11,17 @@ class ScalarFunction {
 
 public:
     virtual int getMaxDegree() = 0;
-    virtual int getVertexCount() = 0;
+    virtual int64_t getVertexCount() = 0;
     virtual int getStar(int64_t v, QVector<int64_t> &star) = 0;
     virtual bool lessThan(int64_t v1, int64_t v2) = 0;
-    virtual unsigned char getFunctionValue(int64_t v) = 0;
+    virtual float getFunctionValue(int64_t v) = 0;
+
+    // Type the function values are stored in. Values of integral types are returned as is by getFunctionValue.
+    virtual ValueType getValueType() { return TypeUInt8; }
+
+    // Contiguous function values of all vertices, of type getValueType(), if available. NULL otherwise.
+    // Used to order the vertices with a counting sort instead of lessThan.
+    virtual const void* getFunctionValues() { return NULL; }
 };
 
 }
@@ -1,26 +1,154 @@
 #ifndef SIMFUNCTION_HPP
 #define SIMFUNCTION_HPP
 
-#include <QVector>
+#include <stddef.h>
 #include <stdint.h>
+#include <vector>
 
 namespace contourtree {
 
-struct Branch {
-    uint32_t from;
-    uint32_t to;
-    QVector<uint32_t> arcs;
+/**
+ * Branches of the simplification, stored as parallel arrays indexed by the branch id.
+ *
+ * Branch i starts out as arc i. The arcs and the children of a branch are kept as singly
+ * linked lists threaded through arcNext and childNext. An arc belongs to exactly one branch
+ * and a branch is the child of at most one branch, so both arrays can be indexed by the
+ * arc / branch id, and moving all arcs or children of one branch to another takes O(1)
+ * without allocating. The moved children are not touched, they still name the branch they
+ * were added to as parent, and parentOf resolves that through the merged branches.
+ */
+struct Branches {
+    enum : uint32_t { None = uint32_t(-1), Merged = uint32_t(-2) };
 
-    uint32_t parent;
-    QVector<uint32_t> children;
+    std::vector<uint32_t> from;
+    std::vector<uint32_t> to;
+    // branch that a branch was added to as a child, see parentOf. Merged once the branch itself
+    // was merged into another one
+    std::vector<uint32_t> parent;
+    // branch that the children of a merged branch were moved to, None for all other branches
+    std::vector<uint32_t> mergedInto;
+
+    std::vector<uint32_t> arcHead;
+    std::vector<uint32_t> arcTail;
+    std::vector<uint32_t> arcNext;
+
+    std::vector<uint32_t> childHead;
+    std::vector<uint32_t> childTail;
+    std::vector<uint32_t> childNext;
+
+    size_t size() const { return from.size(); }
+
+    void resize(size_t noBranches) {
+        from.resize(noBranches);
+        to.resize(noBranches);
+        parent.assign(noBranches, None);
+        mergedInto.assign(noBranches, None);
+        arcHead.resize(noBranches);
+        arcTail.resize(noBranches);
+        arcNext.assign(noBranches, None);
+        for(size_t i = 0;i < noBranches;i ++) {
+            arcHead[i] = arcTail[i] = uint32_t(i);
+        }
+        childHead.assign(noBranches, None);
+        childTail.assign(noBranches, None);
+        childNext.assign(noBranches, None);
+    }
+
+    // moves the arcs of branch other to the end of the arcs of branch b
+    void moveArcs(uint32_t b, uint32_t other) {
+        if(arcHead[other] == None) {
+            return;
+        }
+        if(arcHead[b] == None) {
+            arcHead[b] = arcHead[other];
+        } else {
+            arcNext[arcTail[b]] = arcHead[other];
+        }
+        arcTail[b] = arcTail[other];
+        arcHead[other] = arcTail[other] = None;
+    }
+
+    // moves the children of branch other to the end of the children of branch b
+    void moveChildren(uint32_t b, uint32_t other) {
+        mergedInto[other] = b;
+        if(childHead[other] == None) {
+            return;
+        }
+        if(childHead[b] == None) {
+            childHead[b] = childHead[other];
+        } else {
+            childNext[childTail[b]] = childHead[other];
+        }
+        childTail[b] = childTail[other];
+        childHead[other] = childTail[other] = None;
+    }
+
+    void addChild(uint32_t b, uint32_t ch) {
+        childNext[ch] = None;
+        if(childHead[b] == None) {
+            childHead[b] = ch;
+        } else {
+            childNext[childTail[b]] = ch;
+        }
+        childTail[b] = ch;
+        parent[ch] = b;
+    }
+
+    // the branch that ch is a child of, following the branches that its children were moved
+    // to. The path is halved on the way, like in DisjointSets
+    uint32_t parentOf(uint32_t ch) {
+        uint32_t p = parent[ch];
+        if(p == None || p == Merged) {
+            return p;
+        }
+        while(mergedInto[p] != None) {
+            uint32_t next = mergedInto[p];
+            if(mergedInto[next] != None) {
+                mergedInto[p] = mergedInto[next];
+            }
+            p = mergedInto[p];
+        }
+        parent[ch] = p;
+        return p;
+    }
+
+    // usage: for(uint32_t a = br.firstArc(b);a != Branches::None;a = br.nextArc(a))
+    uint32_t firstArc(uint32_t b) const { return arcHead[b]; }
+    uint32_t nextArc(uint32_t a) const { return arcNext[a]; }
+    uint32_t firstChild(uint32_t b) const { return childHead[b]; }
+    uint32_t nextChild(uint32_t ch) const { return childNext[ch]; }
+
+    void appendArcs(uint32_t b, std::vector<uint32_t> &arcs) const {
+        for(uint32_t a = arcHead[b];a != None;a = arcNext[a]) {
+            arcs.push_back(a);
+        }
+    }
+
+    std::vector<uint32_t> arcs(uint32_t b) const {
+        std::vector<uint32_t> ret;
+        appendArcs(b, ret);
+        return ret;
+    }
+
+    std::vector<uint32_t> children(uint32_t b) const {
+        std::vector<uint32_t> ret;
+        for(uint32_t ch = childHead[b];ch != None;ch = childNext[ch]) {
+            ret.push_back(ch);
+        }
+        return ret;
+    }
 };
 
 class SimFunction
 {
 public:
-    virtual void init(std::vector<float>& fn, std::vector<Branch>& br) = 0;
-    virtual void update(const std::vector<Branch>& br, uint32_t brNo) = 0;
-    virtual void branchRemoved(std::vector<Branch>& br, uint32_t brNo, std::vector<bool>& invalid) = 0;
+    virtual ~SimFunction() {}
+
+    virtual void init(std::vector<float>& fn, Branches& br) = 0;
+    virtual void update(const Branches& br, uint32_t brNo) = 0;
+    virtual void branchRemoved(Branches& br, uint32_t brNo, std::vector<bool>& invalid) = 0;
+    // branch merged was merged into branch brNo, which also adopted the removed branches in children
+    virtual void branchMerged(const Branches& br, uint32_t brNo, uint32_t merged, const std::vector<uint32_t>& children) = 0;
     virtual float getBranchWeight(uint32_t brNo) = 0;
 };
 
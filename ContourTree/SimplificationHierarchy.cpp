@@ -0,0 +1,182 @@
+#include "SimplificationHierarchy.hpp"
+#include "SimplifyCT.hpp"
+#include "ContourTreeFile.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+namespace contourtree {
+
+SimplificationHierarchy::SimplificationHierarchy() { }
+
+/**
+ * Builds the hierarchy in a few linear passes over the joins, which are already sorted
+ * by step. A child always joins before its parent does, so going over the joins forwards
+ * sees every subtree complete before it is added to its parent, and going backwards
+ * places every parent before its children.
+ */
+void SimplificationHierarchy::build(const SimplifyCT &sim) {
+    const std::vector<Join> &joins = sim.joins;
+    uint32_t noBranches = sim.branches.size();
+
+    std::vector<HierarchyBranch> brs(noBranches);
+    for(uint32_t b = 0;b < noBranches;b ++) {
+        brs[b].from = sim.data->arcs[b].from;
+        brs[b].to = sim.data->arcs[b].to;
+        brs[b].parent = -1;
+        brs[b].step = -1;
+        brs[b].start = 0;
+        brs[b].end = 1;
+        brs[b].firstChild = 0;
+        brs[b].endChild = 0;
+    }
+
+    // children grouped by parent, in the order of their steps
+    for(size_t i = 0;i < joins.size();i ++) {
+        brs[joins[i].parent].endChild ++;
+    }
+    uint32_t offset = 0;
+    for(uint32_t b = 0;b < noBranches;b ++) {
+        brs[b].firstChild = offset;
+        offset += brs[b].endChild;
+        brs[b].endChild = brs[b].firstChild;
+    }
+    std::vector<HierarchyChild> chs(joins.size());
+    for(size_t i = 0;i < joins.size();i ++) {
+        const Join &join = joins[i];
+        HierarchyChild &ch = chs[brs[join.parent].endChild ++];
+        ch.branch = join.branch;
+        ch.step = join.step;
+        ch.from = join.from;
+        ch.to = join.to;
+        assert(brs[join.branch].parent == uint32_t(-1));
+        brs[join.branch].parent = join.parent;
+        brs[join.branch].step = join.step;
+    }
+
+    // subtree sizes, kept in end until the starts are known
+    for(size_t i = 0;i < joins.size();i ++) {
+        brs[joins[i].parent].end += brs[joins[i].branch].end;
+    }
+    uint32_t pos = 0;
+    for(uint32_t b = 0;b < noBranches;b ++) {
+        if(brs[b].parent == uint32_t(-1)) {
+            brs[b].start = pos;
+            pos += brs[b].end;
+            brs[b].end = pos;
+        }
+    }
+    assert(pos == noBranches);
+    // fill every parent from its end, so that the children come out in the order of their steps
+    std::vector<uint32_t> cursor(noBranches);
+    for(uint32_t b = 0;b < noBranches;b ++) {
+        if(brs[b].parent == uint32_t(-1)) {
+            cursor[b] = brs[b].end;
+        }
+    }
+    for(size_t i = joins.size();i > 0;i --) {
+        const Join &join = joins[i - 1];
+        HierarchyBranch &br = brs[join.branch];
+        uint32_t size = br.end;
+        cursor[join.parent] -= size;
+        br.start = cursor[join.parent];
+        br.end = br.start + size;
+        cursor[join.branch] = br.end;
+    }
+    std::vector<uint32_t> lay(noBranches);
+    for(uint32_t b = 0;b < noBranches;b ++) {
+        lay[brs[b].start] = b;
+    }
+
+    branches.assign(brs);
+    children.assign(chs);
+    layout.assign(lay);
+}
+
+/**
+ * Uses the hierarchy stored in a .ctree file in place. The nodes, branches, children and
+ * layout ranges it refers to are checked first, as well as that every parent joins later
+ * than its children, so that the walks up the hierarchy end, and that the range of every
+ * child lies inside the range of its parent.
+ *
+ * @return false if the file has no valid hierarchy for noBranches branches of a tree with noNodes nodes
+ */
+bool SimplificationHierarchy::load(const std::shared_ptr<const ContourTreeFile> &file, uint32_t noBranches, uint32_t noNodes) {
+    uint64_t noHierarchy, noChildren, noLayout;
+    const HierarchyBranch *brs = file->section<HierarchyBranch>(SectionHierarchy, noHierarchy);
+    const HierarchyChild *chs = file->section<HierarchyChild>(SectionHierarchyChildren, noChildren);
+    const uint32_t *lay = file->section<uint32_t>(SectionHierarchyLayout, noLayout);
+    if(brs == NULL || chs == NULL || lay == NULL || noHierarchy != noBranches || noLayout != noBranches) {
+        return false;
+    }
+    for(uint32_t b = 0;b < noBranches;b ++) {
+        const HierarchyBranch &br = brs[b];
+        if(br.from >= noNodes || br.to >= noNodes || br.start >= br.end || br.end > noBranches
+                || br.firstChild > br.endChild || br.endChild > noChildren || lay[b] >= noBranches) {
+            return false;
+        }
+        if(br.parent != uint32_t(-1) && (br.parent >= noBranches
+                || (brs[br.parent].parent != uint32_t(-1) && brs[br.parent].step <= br.step))) {
+            return false;
+        }
+    }
+    for(uint64_t c = 0;c < noChildren;c ++) {
+        if(chs[c].branch >= noBranches || chs[c].from >= noNodes || chs[c].to >= noNodes) {
+            return false;
+        }
+    }
+    // the ranges have to nest as laid out in the constructor, or the queries would pick up
+    // branches of other subtrees without noticing
+    for(uint32_t b = 0;b < noBranches;b ++) {
+        const HierarchyBranch &br = brs[b];
+        if(lay[br.start] != b) {
+            return false;
+        }
+        for(uint32_t c = br.firstChild;c < br.endChild;c ++) {
+            const HierarchyBranch &child = brs[chs[c].branch];
+            if(child.parent != b || child.start <= br.start || child.end > br.end
+                    || (c > br.firstChild && chs[c].step < chs[c - 1].step)) {
+                return false;
+            }
+        }
+    }
+    branches.assign(brs, noHierarchy, file);
+    children.assign(chs, noChildren, file);
+    layout.assign(lay, noLayout, file);
+    return true;
+}
+
+uint32_t SimplificationHierarchy::firstChildAfter(uint32_t b, uint32_t level) const {
+    const HierarchyChild *first = children.data() + branches[b].firstChild;
+    const HierarchyChild *last = children.data() + branches[b].endChild;
+    const HierarchyChild *ch = std::lower_bound(first, last, level, [](const HierarchyChild &c, uint32_t level) {
+        return c.step < level;
+    });
+    return ch - children.data();
+}
+
+uint32_t SimplificationHierarchy::end(uint32_t b, uint32_t level) const {
+    uint32_t ch = firstChildAfter(b, level);
+    if(ch == branches[b].endChild) {
+        return branches[b].end;
+    }
+    return branches[children[ch].branch].start;
+}
+
+uint32_t SimplificationHierarchy::from(uint32_t b, uint32_t level) const {
+    uint32_t ch = firstChildAfter(b, level);
+    if(ch == branches[b].firstChild) {
+        return branches[b].from;
+    }
+    return children[ch - 1].from;
+}
+
+uint32_t SimplificationHierarchy::to(uint32_t b, uint32_t level) const {
+    uint32_t ch = firstChildAfter(b, level);
+    if(ch == branches[b].firstChild) {
+        return branches[b].to;
+    }
+    return children[ch - 1].to;
+}
+
+}
@@ -0,0 +1,74 @@
+#ifndef SIMPLIFICATIONHIERARCHY_HPP
+#define SIMPLIFICATIONHIERARCHY_HPP
+
+#include "ContourTreeData.hpp"
+#include <memory>
+
+namespace contourtree {
+
+class SimplifyCT;
+class ContourTreeFile;
+
+struct HierarchyBranch {
+    // end points of the arc the branch starts out as
+    uint32_t from;
+    uint32_t to;
+    // branch that this one joins, -1 if it never does, and the step at which it joins
+    uint32_t parent;
+    uint32_t step;
+    // the branch and its whole subtree are layout[start] .. layout[end - 1], with the branch first
+    uint32_t start;
+    uint32_t end;
+    // the children, sorted by the step at which they joined
+    uint32_t firstChild;
+    uint32_t endChild;
+};
+
+struct HierarchyChild {
+    uint32_t branch;
+    uint32_t step;
+    // end points of the parent once this child joined
+    uint32_t from;
+    uint32_t to;
+};
+
+/**
+ * Records how the branches join each other when the simplification order is applied, so
+ * that the state after removing any prefix of the order can be read off directly instead
+ * of replaying the simplification.
+ *
+ * Every branch joins at most one other branch, at a later step than all of its own children.
+ * The branches are laid out in depth first order with the children of a branch sorted by
+ * their step. After removing the first level branches of the order, a branch therefore
+ * covers the contiguous range from its start up to the first child with a step >= level.
+ */
+class SimplificationHierarchy
+{
+public:
+    SimplificationHierarchy();
+
+    // sim has to have replayed the whole order with recordJoins set
+    void build(const SimplifyCT &sim);
+    bool load(const std::shared_ptr<const ContourTreeFile> &file, uint32_t noBranches, uint32_t noNodes);
+    bool isEmpty() const { return branches.size() == 0; }
+
+    // end of the range of branch b in layout after level removals
+    uint32_t end(uint32_t b, uint32_t level) const;
+    // end points of branch b after level removals
+    uint32_t from(uint32_t b, uint32_t level) const;
+    uint32_t to(uint32_t b, uint32_t level) const;
+
+private:
+    // index of the first child of b that joined at level or later
+    uint32_t firstChildAfter(uint32_t b, uint32_t level) const;
+
+public:
+    SharedArray<HierarchyBranch> branches;
+    SharedArray<HierarchyChild> children;
+    // ids of the branches in depth first order. branch i starts out as arc i, so these are also arc ids
+    SharedArray<uint32_t> layout;
+};
+
+}
+
+#endif // SIMPLIFICATIONHIERARCHY_HPP
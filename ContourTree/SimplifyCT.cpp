@@ -1,4 +1,6 @@
 #include "SimplifyCT.hpp"
+#include "ContourTreeFile.hpp"
+#include "SimplificationHierarchy.hpp"
 
 #include <cassert>
 #include <QDebug>
@@ -13,35 +15,38 @@ bool BranchCompare::operator() (uint32_t v1, uint32_t v2) {
 }
 
 SimplifyCT::SimplifyCT() {
-    queue = std::priority_queue<uint32_t,std::vector<uint32_t>,BranchCompare>(BranchCompare(this));
+    queue = IndexedHeap<BranchCompare>(BranchCompare(this));
+    lazyQueue = false;
+    recordJoins = false;
+    step = 0;
     order.clear();
 }
 
-void SimplifyCT::setInput(ContourTreeData *data) {
+void SimplifyCT::setInput(const ContourTreeData *data) {
     this->data = data;
 }
 
 void SimplifyCT::addToQueue(uint32_t ano) {
-    if(isCandidate(branches[ano])) {
+    if(isCandidate(ano)) {
         queue.push(ano);
         inq[ano] = true;
     }
 }
 
-bool SimplifyCT::isCandidate(const Branch &br) {
-    uint32_t from = br.from;
-    uint32_t to = br.to;
-    if(nodes[from].prev.size() == 0) {
+bool SimplifyCT::isCandidate(uint32_t bno) {
+    uint32_t from = branches.from[bno];
+    uint32_t to = branches.to[bno];
+    if(prevCount[from] == 0) {
         // minimum
-        if(nodes[to].prev.size() > 1) {
+        if(prevCount[to] > 1) {
             return true;
         } else {
             return false;
         }
     }
-    if(nodes[to].next.size() == 0) {
+    if(nextCount[to] == 0) {
         // maximum
-        if(nodes[from].next.size() > 1) {
+        if(nextCount[from] > 1) {
             return true;
         } else {
             return false;
@@ -50,17 +55,40 @@ bool SimplifyCT::isCandidate(const Branch &br) {
     return false;
 }
 
+void SimplifyCT::removeAdjacent(std::vector<uint32_t> &adj, const std::vector<uint32_t> &offsets, std::vector<uint32_t> &count, uint32_t v, uint32_t ano) {
+    uint32_t *arcs = adj.data() + offsets[v];
+    for(uint32_t i = 0;i < count[v];i ++) {
+        if(arcs[i] == ano) {
+            count[v] --;
+            arcs[i] = arcs[count[v]];
+            return;
+        }
+    }
+}
+
+void SimplifyCT::replaceAdjacent(std::vector<uint32_t> &adj, const std::vector<uint32_t> &offsets, const std::vector<uint32_t> &count, uint32_t v, uint32_t ano, uint32_t with) {
+    uint32_t *arcs = adj.data() + offsets[v];
+    for(uint32_t i = 0;i < count[v];i ++) {
+        if(arcs[i] == ano) {
+            arcs[i] = with;
+        }
+    }
+}
+
 void SimplifyCT::initSimplification(SimFunction* f) {
     branches.resize(data->noArcs);
-    nodes.resize(data->noNodes);
     for(uint32_t i = 0;i < branches.size();i ++) {
-        branches[i].from = data->arcs[i].from;
-        branches[i].to = data->arcs[i].to;
-        branches[i].parent = -1;
-        branches[i].arcs.push_back(i);
+        branches.from[i] = data->arcs[i].from;
+        branches.to[i] = data->arcs[i].to;
+    }
 
-        nodes[branches[i].from].next.push_back(i);
-        nodes[branches[i].to].prev.push_back(i);
+    nextArcs = data->nextArcs;
+    prevArcs = data->prevArcs;
+    nextCount.resize(data->noNodes);
+    prevCount.resize(data->noNodes);
+    for(uint32_t i = 0;i < data->noNodes;i ++) {
+        nextCount[i] = data->nextOffsets[i + 1] - data->nextOffsets[i];
+        prevCount[i] = data->prevOffsets[i + 1] - data->prevOffsets[i];
     }
 
     fn.resize(branches.size());
@@ -68,15 +96,23 @@ void SimplifyCT::initSimplification(SimFunction* f) {
     invalid.resize(branches.size(),false);
     inq.resize(branches.size(), false);
 
-    vArray.resize(nodes.size());
+    vHead.assign(data->noNodes, Branches::None);
+    vTail.assign(data->noNodes, Branches::None);
+    vNext.assign(branches.size(), Branches::None);
 
     simFn = f;
     if(f != NULL) {
         simFn->init(fn, branches);
+        queue.resize(branches.size());
 
+        std::vector<uint32_t> candidates;
         for(uint32_t i = 0;i < branches.size();i ++) {
-            addToQueue(i);
+            if(isCandidate(i)) {
+                candidates.push_back(i);
+                inq[i] = true;
+            }
         }
+        queue.assign(candidates);
     }
 }
 
@@ -89,44 +125,48 @@ bool SimplifyCT::compare(uint32_t b1, uint32_t b2) const {
     if(fn[b1] < fn[b2]) {
         return false;
     }
-    float p1 = data->fnVals[branches[b1].to] - data->fnVals[branches[b1].from];
-    float p2 = data->fnVals[branches[b2].to] - data->fnVals[branches[b2].from];
+    float p1 = data->fnVals[branches.to[b1]] - data->fnVals[branches.from[b1]];
+    float p2 = data->fnVals[branches.to[b2]] - data->fnVals[branches.from[b2]];
     if(p1 > p2) {
         return true;
     }
     if(p1 < p2) {
         return false;
     }
-    int diff1 = branches[b1].to - branches[b1].from;
-    int diff2 = branches[b2].to - branches[b2].from;
+    int diff1 = branches.to[b1] - branches.from[b1];
+    int diff2 = branches.to[b2] - branches.from[b2];
     if(diff1 > diff2) {
         return true;
     }
     if(diff1 < diff2) {
         return false;
     }
-    return (branches[b2].from > branches[b1].from);
+    return (branches.from[b2] > branches.from[b1]);
 }
 
 void SimplifyCT::removeArc(uint32_t ano) {
-    Branch br = branches[ano];
-    uint32_t from = br.from;
-    uint32_t to = br.to;
+    uint32_t from = branches.from[ano];
+    uint32_t to = branches.to[ano];
     uint32_t mergedVertex = -1;
-    if(nodes[from].prev.size() == 0) {
+    if(prevCount[from] == 0) {
         // minimum
         mergedVertex = to;
     }
-    if(nodes[to].next.size() == 0) {
+    if(nextCount[to] == 0) {
         // maximum
         mergedVertex = from;
     }
-    nodes[from].next.removeAll(ano);
-    nodes[to].prev.removeAll(ano);
+    removeAdjacent(nextArcs, data->nextOffsets, nextCount, from, ano);
+    removeAdjacent(prevArcs, data->prevOffsets, prevCount, to, ano);
     removed[ano] = true;
 
-    vArray[mergedVertex].push_back(ano);
-    if(nodes[mergedVertex].prev.size() == 1 && nodes[mergedVertex].next.size() == 1) {
+    if(vHead[mergedVertex] == Branches::None) {
+        vHead[mergedVertex] = ano;
+    } else {
+        vNext[vTail[mergedVertex]] = ano;
+    }
+    vTail[mergedVertex] = ano;
+    if(prevCount[mergedVertex] == 1 && nextCount[mergedVertex] == 1) {
         mergeVertex(mergedVertex);
     }
     if(simFn != NULL)
@@ -134,51 +174,60 @@ void SimplifyCT::removeArc(uint32_t ano) {
 }
 
 void SimplifyCT::mergeVertex(uint32_t v) {
-    uint32_t prev = nodes[v].prev.at(0);
-    uint32_t next = nodes[v].next.at(0);
+    uint32_t prev = prevArcs[data->prevOffsets[v]];
+    uint32_t next = nextArcs[data->nextOffsets[v]];
     int a = -1;
     int rem = -1;
     if(inq[prev]) {
         invalid[prev] = true;
         removed[next] = true;
-        branches[prev].to = branches[next].to;
+        branches.to[prev] = branches.to[next];
         a = prev;
         rem = next;
 
-        for(int i = 0;i < nodes[branches[prev].to].prev.size();i ++) {
-            if(nodes[branches[prev].to].prev[i] == next) {
-                nodes[branches[prev].to].prev[i] = prev;
-            }
-        }
+        replaceAdjacent(prevArcs, data->prevOffsets, prevCount, branches.to[prev], next, prev);
     } else {
         invalid[next] = true;
         removed[prev] = true;
-        branches[next].from = branches[prev].from;
+        branches.from[next] = branches.from[prev];
         a = next;
         rem = prev;
 
-        for(int i = 0;i < nodes[branches[next].from].next.size();i ++) {
-            if(nodes[branches[next].from].next[i] == prev) {
-                nodes[branches[next].from].next[i] = next;
+        replaceAdjacent(nextArcs, data->nextOffsets, nextCount, branches.from[next], prev, next);
+    }
+    assert(branches.firstChild(rem) == Branches::None || branches.parentOf(branches.firstChild(rem)) == (uint32_t)rem);
+    branches.moveChildren(a, rem);
+    branches.moveArcs(a, rem);
+    adopted.clear();
+    for(uint32_t aa = vHead[v];aa != Branches::None;aa = vNext[aa]) {
+        branches.addChild(a, aa);
+        adopted.push_back(aa);
+    }
+    branches.parent[rem] = Branches::Merged;
+    if(recordJoins) {
+        Join join = {uint32_t(rem), uint32_t(a), step, branches.from[a], branches.to[a]};
+        joins.push_back(join);
+        for(size_t i = 0;i < adopted.size();i ++) {
+            join.branch = adopted[i];
+            joins.push_back(join);
+        }
+    }
+    if(simFn != NULL) {
+        simFn->branchMerged(branches, a, rem, adopted);
+        if(!lazyQueue) {
+            if(inq[rem]) {
+                queue.remove(rem);
+                inq[rem] = false;
             }
+            simFn->update(branches, a);
+            invalid[a] = false;
         }
-        if(simFn != NULL && !inq[next]) {
-            addToQueue(next);
+        if(!inq[a]) {
+            addToQueue(a);
+        } else if(!lazyQueue) {
+            queue.update(a);
         }
     }
-    for(int i = 0;i < branches[rem].children.size();i ++) {
-        int ch = branches[rem].children.at(i);
-        branches[a].children.push_back(ch);
-        assert(branches[ch].parent == rem);
-        branches[ch].parent = a;
-    }
-    branches[a].arcs << branches[rem].arcs;
-    for(int i = 0;i < vArray[v].size();i ++) {
-        uint32_t aa = vArray[v].at(i);
-        branches[a].children.push_back(aa);
-        branches[aa].parent = a;
-    }
-    branches[rem].parent = -2;
 }
 
 void SimplifyCT::simplify(SimFunction *simFn) {
@@ -186,7 +235,7 @@ void SimplifyCT::simplify(SimFunction *simFn) {
     initSimplification(simFn);
 
     qDebug() << "going over priority queue";
-    while(queue.size() > 0) {
+    while(!queue.empty()) {
         uint32_t ano = queue.top();
         queue.pop();
         inq[ano] = false;
@@ -196,7 +245,8 @@ void SimplifyCT::simplify(SimFunction *simFn) {
                 invalid[ano] = false;
                 addToQueue(ano);
             } else {
-                if(isCandidate(branches[ano])) {
+                if(isCandidate(ano)) {
+                    step = order.size();
                     removeArc(ano);
                     order.push_back(ano);
                 }
@@ -227,17 +277,18 @@ void SimplifyCT::simplify(const std::vector<uint32_t> &order, int topk, float th
         size_t ct = order.size() - topk;
         for(int i = 0;i < ct;i ++) {
             uint32_t ano = order.at(i);
-            if(!isCandidate(branches[ano])) {
+            if(!isCandidate(ano)) {
                 qDebug() << "failing candidate test";
                 assert(false);
             }
             inq[ano] = false;
+            step = i;
             removeArc(ano);
         }
     } else if(th != 0) {
         for(int i = 0;i < order.size() - 1;i ++) {
             uint32_t ano = order.at(i);
-            if(!isCandidate(branches[ano])) {
+            if(!isCandidate(ano)) {
                 qDebug() << "failing candidate test";
                 assert(false);
             }
@@ -246,6 +297,7 @@ void SimplifyCT::simplify(const std::vector<uint32_t> &order, int topk, float th
                 break;
             }
             inq[ano] = false;
+            step = i;
             removeArc(ano);
         }
     }
@@ -288,6 +340,18 @@ void SimplifyCT::outputOrder(QString fileName) {
     of.write((char *)wts.data(),wts.size() * sizeof(float));
 //    of.write((char *)arcs.data(),arcs.size() * sizeof(uint32_t));
     of.close();
+
+    qDebug() << "computing simplification hierarchy";
+    // from a replay of the order, which is what the features are computed from
+    SimplifyCT replay;
+    replay.setInput(data);
+    replay.recordJoins = true;
+    replay.simplify(order, 1);
+    SimplificationHierarchy hierarchy;
+    hierarchy.build(replay);
+
+    qDebug() << "writing tree file";
+    ContourTreeFile::write(fileName + ".ctree", *data, order, wts, &hierarchy);
 }
 
 }
@@ -3,7 +3,7 @@
 
 #include "ContourTreeData.hpp"
 #include "SimFunction.hpp"
-#include <queue>
+#include "IndexedHeap.hpp"
 #include <vector>
 
 #if defined (WIN32)
@@ -14,6 +14,18 @@ namespace contourtree {
 
 class SimplifyCT;
 
+// a branch that joined another one during the simplification, either by being merged
+// into it or by being adopted as a child after it was removed
+struct Join {
+    uint32_t branch;
+    uint32_t parent;
+    // index in the order of the removal that caused the join
+    uint32_t step;
+    // end points of parent after the join
+    uint32_t from;
+    uint32_t to;
+};
+
 struct BranchCompare {
     BranchCompare(){}
     BranchCompare(const SimplifyCT * simct): sim(simct) {}
@@ -27,7 +39,7 @@ class SimplifyCT
 public:
     SimplifyCT();
 
-    void setInput(ContourTreeData *data);
+    void setInput(const ContourTreeData *data);
     void simplify(SimFunction *simFn);
     void simplify(const std::vector<uint32_t> &order, int topk = -1, float th = 0, const std::vector<float> &wts = std::vector<float>());
     void outputOrder(QString fileName);
@@ -35,7 +47,9 @@ public:
 protected:
     void initSimplification(SimFunction *f);
     void addToQueue(uint32_t ano);
-    bool isCandidate(const Branch &br);
+    bool isCandidate(uint32_t bno);
+    void removeAdjacent(std::vector<uint32_t> &adj, const std::vector<uint32_t> &offsets, std::vector<uint32_t> &count, uint32_t v, uint32_t ano);
+    void replaceAdjacent(std::vector<uint32_t> &adj, const std::vector<uint32_t> &offsets, const std::vector<uint32_t> &count, uint32_t v, uint32_t ano, uint32_t with);
     void removeArc(uint32_t ano);
     void mergeVertex(uint32_t v);
 
@@ -44,8 +58,15 @@ public:
 
 public:
     const ContourTreeData *data;
-    std::vector<Branch> branches;
-    std::vector<Node> nodes;
+    Branches branches;
+
+    // adjacency of the simplified tree. it starts out as the CSR adjacency of the input, the arcs
+    // going up from node n are nextArcs[data->nextOffsets[n]] to nextArcs[data->nextOffsets[n] + nextCount[n] - 1].
+    // removing an arc swaps it with the last one of the node, and merging only replaces arcs in place.
+    std::vector<uint32_t> nextArcs;
+    std::vector<uint32_t> nextCount;
+    std::vector<uint32_t> prevArcs;
+    std::vector<uint32_t> prevCount;
 
     std::vector<float> fn;
     std::vector<float> fnv;
@@ -54,9 +75,23 @@ public:
     std::vector<bool> inq;
     SimFunction *simFn;
 
-    std::priority_queue<uint32_t,std::vector<uint32_t>,BranchCompare> queue;
+    IndexedHeap<BranchCompare> queue;
+    // re-evaluate merged branches only when they are popped, like the earlier std::priority_queue,
+    // instead of updating them in place. kept to compare the two in benchmarkSimplifyQueue
+    bool lazyQueue;
     std::vector<uint32_t> order;
-    std::vector<std::vector<uint32_t>> vArray;
+    // branches removed at node n, that become children once n is merged:
+    // vHead[n], vNext[vHead[n]], ... until vTail[n]
+    std::vector<uint32_t> vHead;
+    std::vector<uint32_t> vTail;
+    std::vector<uint32_t> vNext;
+    // the branches adopted by the last merge, reused across merges
+    std::vector<uint32_t> adopted;
+
+    // with recordJoins set, every join is added to joins, so in the order of their steps
+    bool recordJoins;
+    std::vector<Join> joins;
+    uint32_t step;
 };
 
 }
@@ -0,0 +1,485 @@
+#include "StreamingMergeTree.hpp"
+#include "MergeTree.hpp"
+#include "Grid3D.hpp"
+#include "DisjointSets.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <cassert>
+#include <QDebug>
+#include <QFile>
+#include <QTextStream>
+
+#if !defined (WIN32)
+#include <parallel/algorithm>
+#endif
+
+namespace contourtree {
+
+StreamingMergeTree::StreamingMergeTree(int dimx, int dimy, int dimz, int slabDepth) :
+    dimx(dimx), dimy(dimy), dimz(dimz), slabDepth(slabDepth)
+{
+    // the local trees index the vertices of a slab with uint32_t, see computeMergeTree
+    int64_t layer = int64_t(dimx) * dimy;
+    int64_t maxDepth = std::max<int64_t>(1, (int64_t(std::numeric_limits<uint32_t>::max()) - 1) / layer);
+    if(this->slabDepth > maxDepth) {
+        qDebug() << "slab depth" << slabDepth << "too large for 32 bit vertex indices, using" << maxDepth;
+        this->slabDepth = int(maxDepth);
+    }
+    noSlabs = (dimz + this->slabDepth - 1) / this->slabDepth;
+    noVertices = int64_t(dimx) * dimy * dimz;
+    newVertex = false;
+    noNodes = 0;
+    noArcs = 0;
+}
+
+StreamingMergeTree::~StreamingMergeTree() {
+    if(!childFile.isEmpty()) {
+        QFile::remove(childFile);
+    }
+}
+
+void StreamingMergeTree::computeTree(QString rawFile, TreeType type) {
+    if(type != TypeJoinTree) {
+        qDebug() << "Only join trees can be computed out-of-core";
+        assert(false);
+        return;
+    }
+    this->rawFile = rawFile;
+    this->childFile = rawFile + ".child.tmp";
+    std::chrono::time_point<std::chrono::system_clock> ct, en;
+    ct = std::chrono::system_clock::now();
+
+    verts.clear();
+    fns.clear();
+    prev.clear();
+    criticalPts.clear();
+    referenced.clear();
+    forwards.clear();
+    std::ofstream cf(childFile.toStdString(), std::ios::binary);
+    for(int slab = 0;slab < noSlabs;slab ++) {
+        qDebug() << "processing slab" << slab << "of" << noSlabs;
+        int z0 = slab * slabDepth;
+        Grid3D<unsigned char> grid(dimx, dimy, std::min(slabDepth, dimz - z0));
+        grid.loadGrid(rawFile, int64_t(z0) * dimx * dimy);
+        MergeTree<uint32_t> tree;
+        tree.computeTree(&grid, TypeJoinTree, true);
+
+        // one child of every vertex in the local tree, -1 for the local maxima
+        std::vector<uint32_t> child(tree.noVertices, (uint32_t)(-1));
+        for(int64_t v = 0;v < tree.noVertices;v ++) {
+            if(tree.prev[v] != (uint32_t)(-1)) {
+                child[tree.prev[v]] = v;
+            }
+        }
+        cf.write((char *)child.data(), child.size() * sizeof(uint32_t));
+
+        glueSlab(slab, tree, child);
+        qDebug() << "tree size:" << verts.size() << "vertices," << forwards.size() << "forwarded";
+    }
+    cf.close();
+
+    newVertex = false;
+    if(criticalPts[0] == SADDLE) {
+        // add a new vertex
+        newVertex = true;
+    } else {
+        criticalPts[0] = MINIMUM;
+    }
+
+    std::sort(forwards.begin(), forwards.end());
+    nodesByVertex.resize(verts.size());
+    for(size_t i = 0;i < verts.size();i ++) {
+        nodesByVertex[i] = std::make_pair(verts[i], int64_t(i));
+    }
+    std::sort(nodesByVertex.begin(), nodesByVertex.end());
+    computeArcs();
+
+    en = std::chrono::system_clock::now();
+    long time = std::chrono::duration_cast<std::chrono::milliseconds>(en-ct).count();
+
+    qDebug() << "Time taken to compute tree : " << time << "ms";
+}
+
+void StreamingMergeTree::output(QString fileName, TreeType tree) {
+    if(tree != TypeJoinTree) {
+        qDebug() << "Only join trees can be computed out-of-core";
+        assert(false);
+        return;
+    }
+
+    // write meta data
+    qDebug() << "Writing meta data";
+    {
+        QFile pr(fileName + ".rg.dat");
+        if(!pr.open(QFile::WriteOnly | QIODevice::Text)) {
+            qDebug() << "could not write to file" << fileName + ".rg.dat";
+        }
+        QTextStream text(&pr);
+        text << noNodes << "\n";
+        text << noArcs << "\n";
+        pr.close();
+    }
+
+    std::vector<int64_t> nodeids;
+    std::vector<unsigned char> nodefns;
+    std::vector<char> nodeTypes;
+    if(newVertex) {
+        nodeids.push_back(noVertices);
+        nodefns.push_back(0);
+        nodeTypes.push_back(MINIMUM);
+    }
+    for(size_t i = 0;i < verts.size();i ++) {
+        if(criticalPts[i] != REGULAR) {
+            nodeids.push_back(verts[i]);
+            nodefns.push_back(fns[i]);
+            nodeTypes.push_back(criticalPts[i]);
+        }
+    }
+    assert(nodeids.size() == noNodes);
+
+    qDebug() << "writing tree output";
+    QString rgFile = fileName + ".rg.bin";
+    std::ofstream of(rgFile.toStdString(),std::ios::binary);
+    of.write((char *)nodeids.data(),nodeids.size() * sizeof(int64_t));
+    of.write((char *)nodefns.data(),nodeids.size());
+    of.write((char *)nodeTypes.data(),nodeids.size());
+    of.write((char *)arcs.data(),arcs.size() * sizeof(int64_t));
+    of.close();
+
+    qDebug() << "writing partition";
+    QString partFile = fileName + ".part.raw";
+    of.open(partFile.toStdString(), std::ios::binary);
+    std::ifstream raw(rawFile.toStdString(), std::ios::binary);
+    std::ifstream cf(childFile.toStdString(), std::ios::binary);
+    for(int slab = 0;slab < noSlabs;slab ++) {
+        qDebug() << "segmenting slab" << slab << "of" << noSlabs;
+        int z0 = slab * slabDepth;
+        int64_t nv = int64_t(dimx) * dimy * std::min(slabDepth, dimz - z0);
+        std::vector<unsigned char> values(nv);
+        std::vector<uint32_t> child(nv);
+        raw.read((char *)values.data(), nv);
+        cf.read((char *)child.data(), nv * sizeof(uint32_t));
+        if(!raw || !cf) {
+            qDebug() << "could not read slab" << slab << "from" << rawFile << "and" << childFile;
+            assert(false);
+            return;
+        }
+        writeSlabPartition(slab, values, child, of);
+    }
+    if(newVertex) {
+        uint32_t ano = arcMap[0];
+        of.write((char *)&ano, sizeof(uint32_t));
+    }
+    of.close();
+}
+
+/**
+ * Computes the join tree of the graph made of the tree of the previous slabs, the local
+ * tree of this slab with its regular chains contracted, and the edges between the last
+ * slice of the previous slab and the first slice of this one. Contracting a tree keeps the
+ * superlevel set components of the vertices that are left, so this is the join tree of the
+ * slabs up to this one. Afterwards only its nodes and the last slice of the slab are kept.
+ */
+void StreamingMergeTree::glueSlab(int slab, const MergeTree<uint32_t> &tree, const std::vector<uint32_t> &child) {
+    int64_t layer = int64_t(dimx) * dimy;
+    int64_t offset = int64_t(slab) * slabDepth * layer;
+    int64_t zb = int64_t(slab) * slabDepth;
+    bool bottom = (slab > 0);
+    bool top = (slab < noSlabs - 1);
+    int64_t nt = verts.size();
+    int64_t nv = tree.noVertices;
+
+    // append the local skeleton, i.e. the critical points and the boundary slices, in order
+    std::vector<int64_t> index(nv, -1);
+    for(int64_t i = 0;i < nv;i ++) {
+        int64_t v = tree.sv[i];
+        if((bottom && v < layer) || (top && v >= nv - layer) ||
+                tree.criticalPts[v] != REGULAR || tree.prev[v] == (uint32_t)(-1) || child[v] == (uint32_t)(-1)) {
+            index[v] = verts.size();
+            verts.push_back(v + offset);
+            fns.push_back((unsigned char)tree.data->getFunctionValue(v));
+            referenced.push_back(child[v] == (uint32_t)(-1));
+        }
+    }
+    int64_t n = verts.size();
+
+    // edges of both trees, contracting the regular vertices in between skeleton vertices
+    std::vector<int64_t> down(prev.begin(), prev.end());
+    down.resize(n);
+    for(int64_t s = nt;s < n;s ++) {
+        uint32_t d = tree.prev[verts[s] - offset];
+        while(d != (uint32_t)(-1) && index[d] == -1) {
+            d = tree.prev[d];
+        }
+        down[s] = (d == (uint32_t)(-1)) ? -1 : index[d];
+    }
+    std::vector<int64_t>().swap(index);
+
+    auto lessThan = [this](int64_t s1, int64_t s2) {
+        return (fns[s1] < fns[s2]) || (fns[s1] == fns[s2] && verts[s1] < verts[s2]);
+    };
+    std::vector<int64_t> sv(n);
+    for(int64_t i = 0;i < n;i ++) {
+        sv[i] = i;
+    }
+    std::inplace_merge(sv.begin(), sv.begin() + nt, sv.end(), lessThan);
+
+    std::vector<int64_t> firstChild(n, -1);
+    std::vector<int64_t> sibling(n, -1);
+    for(int64_t s = 0;s < n;s ++) {
+        if(down[s] != -1) {
+            sibling[s] = firstChild[down[s]];
+            firstChild[down[s]] = s;
+        }
+    }
+
+    // the slices on both sides of the boundary to the previous slab
+    std::vector<int64_t> below, above;
+    if(bottom) {
+        below.assign(layer, -1);
+        above.assign(layer, -1);
+        for(int64_t s = 0;s < n;s ++) {
+            int64_t z = verts[s] / layer;
+            if(z == zb - 1) {
+                below[verts[s] % layer] = s;
+            } else if(z == zb) {
+                above[verts[s] % layer] = s;
+            }
+        }
+    }
+
+    std::vector<int64_t> newPrev(n, -1);
+    std::vector<char> cps(n, REGULAR);
+    std::vector<int64_t> cpMap(n);
+    DisjointSets<int64_t> nodes(n);
+
+    Grid3D<unsigned char> stencil(dimx, dimy, 2);
+    QSet<int64_t> set;
+    for(int64_t i = n - 1;i >= 0;i --) {
+        int64_t s = sv[i];
+        set.clear();
+        for(int64_t c = firstChild[s];c != -1;c = sibling[c]) {
+            set << nodes.find(c);
+        }
+
+        int64_t v = verts[s];
+        int64_t z = v / layer;
+        if(bottom && (z == zb - 1 || z == zb)) {
+            const std::vector<int64_t> &other = (z == zb) ? below : above;
+            int64_t otherZ = (z == zb) ? zb - 1 : zb;
+            int y = (v % layer) / dimx;
+            int x = v % dimx;
+            for(int j = 0;j < 14;j ++) {
+                int _x = x + stencil.starin[j][0];
+                int _y = y + stencil.starin[j][1];
+                int64_t _z = z + stencil.starin[j][2];
+                if(_x < 0 || _x >= dimx ||
+                   _y < 0 || _y >= dimy ||
+                   _z != otherZ) {
+                    continue;
+                }
+                int64_t t = other[_x + _y * int64_t(dimx)];
+                assert(t != -1);
+                if(lessThan(s, t)) {
+                    set << nodes.find(t);
+                }
+            }
+        }
+
+        if(set.size() == 0) {
+            // Maximum
+            int64_t comp = nodes.find(s);
+            cpMap[comp] = s;
+            cps[s] = MAXIMUM;
+        } else {
+            if(set.size() > 1) {
+                cps[s] = SADDLE;
+            }
+            foreach(int64_t comp, set) {
+                int64_t to = cpMap[comp];
+                newPrev[to] = s;
+                nodes.merge(comp, s);
+            }
+            int64_t comp = nodes.find(s);
+            cpMap[comp] = s;
+        }
+    }
+
+    // keep the nodes, the root and the frontier to the next slab
+    int64_t frontierZ = zb + slabDepth - 1;
+    std::vector<char> keep(n);
+    for(int64_t s = 0;s < n;s ++) {
+        keep[s] = (cps[s] != REGULAR || newPrev[s] == -1 || (top && verts[s] / layer == frontierZ));
+    }
+
+    // a removed vertex that the segmentation starts from is forwarded to a maximum above it,
+    // which is kept
+    std::vector<int64_t> upChild(n, -1);
+    for(int64_t s = 0;s < n;s ++) {
+        if(newPrev[s] != -1) {
+            upChild[newPrev[s]] = s;
+        }
+    }
+    std::vector<int64_t> maximum(n);
+    for(int64_t i = n - 1;i >= 0;i --) {
+        int64_t s = sv[i];
+        maximum[s] = (upChild[s] == -1) ? s : maximum[upChild[s]];
+    }
+    for(int64_t s = 0;s < n;s ++) {
+        if(!keep[s] && referenced[s]) {
+            forwards.push_back(std::make_pair(verts[s], verts[maximum[s]]));
+            referenced[maximum[s]] = 1;
+        }
+    }
+
+    // compact the tree, linking every kept vertex to the first kept vertex below it
+    std::vector<int64_t> keptBelow(n);
+    std::vector<int64_t> newIndex(n, -1);
+    int64_t nk = 0;
+    for(int64_t i = 0;i < n;i ++) {
+        int64_t s = sv[i];
+        if(keep[s]) {
+            keptBelow[s] = s;
+            newIndex[s] = nk ++;
+        } else {
+            keptBelow[s] = keptBelow[newPrev[s]];
+        }
+    }
+    std::vector<int64_t> kVerts(nk), kPrev(nk);
+    std::vector<unsigned char> kFns(nk);
+    std::vector<char> kCps(nk), kRef(nk);
+    for(int64_t s = 0;s < n;s ++) {
+        if(keep[s]) {
+            int64_t k = newIndex[s];
+            kVerts[k] = verts[s];
+            kFns[k] = fns[s];
+            kPrev[k] = (newPrev[s] == -1) ? -1 : newIndex[keptBelow[newPrev[s]]];
+            kCps[k] = cps[s];
+            kRef[k] = referenced[s];
+        }
+    }
+    verts.swap(kVerts);
+    fns.swap(kFns);
+    prev.swap(kPrev);
+    criticalPts.swap(kCps);
+    referenced.swap(kRef);
+}
+
+/**
+ * Numbers the arcs the same way MergeTree::output does.
+ */
+void StreamingMergeTree::computeArcs() {
+    int64_t noTree = verts.size();
+    noNodes = 0;
+    for(int64_t s = 0;s < noTree;s ++) {
+        if(criticalPts[s] != REGULAR) {
+            noNodes ++;
+        }
+    }
+    if(newVertex) {
+        noNodes ++;
+    }
+    noArcs = noNodes - 1;
+
+    downArc.assign(noTree, -1);
+    arcMap.assign(noTree, -1);
+    arcs.resize(noArcs * 2);
+    uint32_t arcNo = 0;
+    for(int64_t i = 0;i < noTree;i ++) {
+        // in the order of the vertex ids
+        int64_t s = nodesByVertex[i].second;
+        if((criticalPts[s] == MAXIMUM || criticalPts[s] == SADDLE) && s != 0) {
+            arcMap[s] = arcNo;
+            downArc[s] = arcNo;
+
+            int64_t to = s;
+            int64_t from = prev[to];
+            while(criticalPts[from] == REGULAR) {
+                arcMap[from] = arcNo;
+                downArc[from] = arcNo;
+                from = prev[from];
+            }
+            arcMap[from] = arcNo;
+
+            arcs[arcNo * 2 + 0] = verts[from];
+            arcs[arcNo * 2 + 1] = verts[to];
+            arcNo ++;
+        }
+    }
+    if(newVertex) {
+        arcs[arcNo * 2 + 0] = noVertices;
+        arcs[arcNo * 2 + 1] = verts[0];
+        arcMap[0] = arcNo ++;
+    }
+    assert(arcNo == noArcs);
+}
+
+/**
+ * Each vertex of the slab lies on the tree arc below the lowest node that is above one of
+ * its children in the local tree. Processing the slab in descending order makes every walk
+ * down the tree continue where the one of its child stopped. The local maxima have no
+ * child and start from the node they were forwarded to, if they are not a node themselves.
+ */
+void StreamingMergeTree::writeSlabPartition(int slab, const std::vector<unsigned char> &values, const std::vector<uint32_t> &child, std::ofstream &of) {
+    int64_t offset = int64_t(slab) * slabDepth * dimx * dimy;
+    int64_t nv = values.size();
+
+    // order of the vertices as in Grid3D::lessThan, by value and then by index
+    std::vector<int64_t> start(257, 0);
+    for(int64_t v = 0;v < nv;v ++) {
+        start[values[v] + 1] ++;
+    }
+    for(int i = 0;i < 256;i ++) {
+        start[i + 1] += start[i];
+    }
+    std::vector<uint32_t> order(nv);
+    for(int64_t v = 0;v < nv;v ++) {
+        order[start[values[v]] ++] = v;
+    }
+
+    std::vector<int64_t> above(nv, -1);
+    std::vector<uint32_t> part(nv);
+    for(int64_t i = nv - 1;i >= 0;i --) {
+        int64_t v = order[i];
+        unsigned char fn = values[v];
+        int64_t x = (child[v] == (uint32_t)(-1)) ? resolve(v + offset) : above[child[v]];
+        while(true) {
+            int64_t p = prev[x];
+            if(p == -1 || fns[p] < fn || (fns[p] == fn && verts[p] < v + offset)) {
+                break;
+            }
+            x = p;
+        }
+        above[v] = x;
+        part[v] = (verts[x] == v + offset) ? arcMap[x] : downArc[x];
+    }
+    of.write((char *)part.data(), part.size() * sizeof(uint32_t));
+}
+
+// index of the node of vertex v, -1 if it is not a node
+int64_t StreamingMergeTree::nodeIndex(int64_t v) const {
+    std::vector<std::pair<int64_t, int64_t> >::const_iterator it =
+            std::lower_bound(nodesByVertex.begin(), nodesByVertex.end(), std::make_pair(v, int64_t(-1)));
+    if(it == nodesByVertex.end() || it->first != v) {
+        return -1;
+    }
+    return it->second;
+}
+
+// index of the node that a local maximum was forwarded to
+int64_t StreamingMergeTree::resolve(int64_t v) const {
+    while(true) {
+        int64_t node = nodeIndex(v);
+        if(node != -1) {
+            return node;
+        }
+        std::vector<std::pair<int64_t, int64_t> >::const_iterator it =
+                std::lower_bound(forwards.begin(), forwards.end(), std::make_pair(v, int64_t(-1)));
+        assert(it != forwards.end() && it->first == v);
+        v = it->second;
+    }
+}
+
+}
@@ -0,0 +1,79 @@
+#ifndef STREAMINGMERGETREE_HPP
+#define STREAMINGMERGETREE_HPP
+
+#include "constants.h"
+#include <QString>
+#include <QSet>
+#include <stdint.h>
+#include <vector>
+#include <fstream>
+#include <utility>
+
+namespace contourtree {
+
+template <class T> class MergeTree;
+
+/**
+ * Out-of-core join tree computation for unsigned char volumes stored as raw files.
+ *
+ * The volume is read in z-slabs of slabDepth slices, and every slab is glued to the tree
+ * of the slabs before it as soon as its local join tree is known. Only the critical points
+ * of that tree and the last slice, which is the frontier to the next slab, are kept, so
+ * the memory is that of one slab and the tree rather than of all slab boundaries.
+ *
+ * The first pass also writes one child of every vertex in its local tree to a temporary
+ * file next to the raw file, from which output writes the segmentation without computing
+ * the local trees again. The output is identical to MergeTree::output for the same volume.
+ */
+class StreamingMergeTree
+{
+public:
+    StreamingMergeTree(int dimx, int dimy, int dimz, int slabDepth);
+    ~StreamingMergeTree();
+
+    void computeTree(QString rawFile, TreeType type);
+    void output(QString fileName, TreeType tree);
+
+protected:
+    void glueSlab(int slab, const MergeTree<uint32_t> &tree, const std::vector<uint32_t> &child);
+    void computeArcs();
+    void writeSlabPartition(int slab, const std::vector<unsigned char> &fns, const std::vector<uint32_t> &child, std::ofstream &of);
+
+    int64_t nodeIndex(int64_t v) const;
+    int64_t resolve(int64_t v) const;
+
+public:
+    int dimx, dimy, dimz;
+    int slabDepth;
+    int noSlabs;
+    int64_t noVertices;
+    QString rawFile;
+    QString childFile;
+
+    // join tree of the slabs glued so far, sorted by function value. After the last slab
+    // only its nodes are left
+    std::vector<int64_t> verts;
+    std::vector<unsigned char> fns;
+    std::vector<int64_t> prev;
+    std::vector<char> criticalPts;
+    // local maxima of the slabs, from which the segmentation starts its walks down the tree
+    std::vector<char> referenced;
+    bool newVertex;
+
+    // referenced vertices that were removed from the tree, and a vertex above them
+    // that was kept, sorted by vertex
+    std::vector<std::pair<int64_t, int64_t> > forwards;
+    // nodes sorted by vertex, and their index in verts
+    std::vector<std::pair<int64_t, int64_t> > nodesByVertex;
+
+    // arc of the tree below each node, and its label in the segmentation
+    std::vector<uint32_t> downArc;
+    std::vector<uint32_t> arcMap;
+    std::vector<int64_t> arcs;
+    uint32_t noNodes;
+    uint32_t noArcs;
+};
+
+}
+
+#endif // STREAMINGMERGETREE_HPP
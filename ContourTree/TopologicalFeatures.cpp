@@ -1,19 +1,105 @@
 #include "TopologicalFeatures.hpp"
 #include <fstream>
+#include <deque>
+#include <algorithm>
+#include <limits>
 #include <QFile>
 #include <QTextStream>
 #include <cassert>
 
 #include "constants.h"
+#include "ContourTreeFile.hpp"
 
 #include<QDebug>
 
 namespace contourtree {
 
-TopologicalFeatures::TopologicalFeatures() { }
+TopologicalFeatures::TopologicalFeatures() : query(0), hasLastQuery(false) { }
 
 void TopologicalFeatures::loadData(QString dataLocation, bool partition) {
     ctdata = ContourTreeData();
+    hierarchy = SimplificationHierarchy();
+    if(!loadTreeFile(dataLocation + ".ctree")) {
+        loadBinFiles(dataLocation);
+    }
+
+    // files written before the hierarchy was stored need a replay of the order to build it
+    if(partition || hierarchy.isEmpty()) {
+        sim.setInput(&ctdata);
+        sim.recordJoins = hierarchy.isEmpty();
+        sim.simplify(order,1,0,wts);
+        if(hierarchy.isEmpty()) {
+            hierarchy.build(sim);
+            std::vector<Join>().swap(sim.joins);
+        }
+    }
+
+    // a removed branch does not change anymore, so its end points after all removals are the ones it was removed with
+    orderIndex.assign(ctdata.noArcs, -1);
+    maxPersistence.resize(order.size());
+    uint32_t last = order.size();
+    for(size_t i = 0;i < order.size();i ++) {
+        orderIndex[order[i]] = i;
+        uint32_t from = hierarchy.from(order[i], last);
+        uint32_t to = hierarchy.to(order[i], last);
+        if(ctdata.type[to] == MAXIMUM) {
+            maxPersistence[i] = ctdata.fnVals[to] - ctdata.fnVals[from];
+        } else {
+            maxPersistence[i] = -std::numeric_limits<float>::infinity();
+        }
+    }
+    prefixMaxPersistence.resize(order.size());
+    for(size_t i = 0;i < order.size();i ++) {
+        prefixMaxPersistence[i] = (i == 0) ? maxPersistence[i] : std::max(prefixMaxPersistence[i - 1], maxPersistence[i]);
+    }
+    query = 0;
+    hasLastQuery = false;
+    headStamp.assign(ctdata.noArcs, 0);
+    visitStamp.assign(ctdata.noArcs, 0);
+    covered.assign(ctdata.noArcs, 0);
+}
+
+/**
+ * Loads the tree and its order from the .ctree file written by SimplifyCT::outputOrder.
+ *
+ * @return false if there is no valid file, in which case nothing is loaded
+ */
+bool TopologicalFeatures::loadTreeFile(QString fileName) {
+    if(!QFile::exists(fileName)) {
+        return false;
+    }
+    std::shared_ptr<ContourTreeFile> file = std::make_shared<ContourTreeFile>();
+    if(!file->open(fileName)) {
+        return false;
+    }
+    uint64_t orderSize, noWts;
+    const uint32_t *fileOrder = file->section<uint32_t>(SectionOrder, orderSize);
+    const float *fileWts = file->section<float>(SectionWeights, noWts);
+    if(fileOrder == NULL || fileWts == NULL || noWts != orderSize) {
+        qDebug() << "no branch order in" << fileName;
+        return false;
+    }
+    if(!ctdata.loadTreeFile(file)) {
+        ctdata = ContourTreeData();
+        return false;
+    }
+    for(uint64_t i = 0;i < orderSize;i ++) {
+        if(fileOrder[i] >= ctdata.noArcs) {
+            qDebug() << "branch order in" << fileName << "refers to arcs that do not exist";
+            ctdata = ContourTreeData();
+            return false;
+        }
+    }
+    order.assign(fileOrder, fileOrder + orderSize);
+    wts.assign(fileWts, fileWts + orderSize);
+    // without a valid hierarchy, loadData builds it again by replaying the order
+    if(!hierarchy.load(file, ctdata.noArcs, ctdata.noNodes)) {
+        hierarchy = SimplificationHierarchy();
+    }
+    return true;
+}
+
+void TopologicalFeatures::loadBinFiles(QString dataLocation) {
     ctdata.loadBinFile(dataLocation);
 
     // read order file
@@ -34,81 +120,200 @@ void TopologicalFeatures::loadData(QString dataLocation, bool partition) {
     bin.read((char *)order.data(),order.size() * sizeof(uint32_t));
     bin.read((char *)wts.data(),wts.size() * sizeof(float));
     bin.close();
+}
 
-    if(partition) {
-        sim.setInput(&ctdata);
-        sim.simplify(order,1,0,wts);
+/**
+ * Checks whether a removed branch already is part of a feature, i.e. whether one of the
+ * branches it has joined up to level is the head of a feature. The heads are the remaining
+ * branches and the removed ones added in getFeatures before bno, which are all the ones
+ * that bno can have joined. The result for every branch on the way is kept for the
+ * current query, so the walks stay short.
+ */
+bool TopologicalFeatures::isCovered(uint32_t bno, uint32_t level) {
+    path.clear();
+    bool cov = false;
+    uint32_t b = bno;
+    while(hierarchy.branches[b].parent != uint32_t(-1) && hierarchy.branches[b].step < level) {
+        b = hierarchy.branches[b].parent;
+        if(visitStamp[b] == query) {
+            cov = covered[b];
+            break;
+        }
+        if((orderIndex[b] != uint32_t(-1) && orderIndex[b] >= level) || headStamp[b] == query) {
+            cov = true;
+            break;
+        }
+        path.push_back(b);
     }
+    for(size_t i = 0;i < path.size();i ++) {
+        visitStamp[path[i]] = query;
+        covered[path[i]] = cov;
+    }
+    return cov;
 }
 
-void TopologicalFeatures::addFeature(SimplifyCT &sim, uint32_t bno, std::vector<Feature> &features, QSet<size_t> &featureSet) {
-    Branch b1 = sim.branches.at(bno);
-    Feature f;
-    f.from = ctdata.nodeVerts[b1.from];
-    f.to = ctdata.nodeVerts[b1.from];
-
-    std::deque<size_t> queue;
-    queue.push_back(bno);
-    while(queue.size() > 0) {
-        size_t b = queue.front();
-        queue.pop_front();
-        if(b != bno && featureSet.contains(b)) {
-            // this cannot happen
-            assert(false);
-        }
-        featureSet << b;
-        Branch br = sim.branches.at(b);
-        f.arcs.insert(f.arcs.end(),br.arcs.data(), br.arcs.data()+br.arcs.size());
-        for(int i = 0;i < br.children.size();i ++) {
-            uint32_t bc = br.children.at(i);
-            queue.push_back(bc);
-        }
-    }
-    features.push_back(f);
+uint32_t TopologicalFeatures::getLevel(int topk, float th) const {
+    if(order.size() == 0) {
+        return 0;
+    }
+    if(topk > 0) {
+        return order.size() - std::min<size_t>(topk, order.size());
+    }
+    if(th != 0) {
+        // the weights are sorted, and the last branch is never removed
+        return std::upper_bound(wts.begin(), wts.end() - 1, th) - wts.begin();
+    }
+    return 0;
 }
 
+/**
+ * Same as replaying the first getLevel(topk, th) branches of the order with SimplifyCT,
+ * and taking the remaining branches with everything that was merged into them as
+ * features. The removed branches that end in a maximum, are not part of a feature and
+ * have a persistence of at least secondary become features as well.
+ *
+ * With the hierarchy this only touches the removed branches and the arcs of the features.
+ */
 std::vector<Feature> TopologicalFeatures::getFeatures(int topk, float th, float secondary) {
-    SimplifyCT sim;
-    sim.setInput(&ctdata);
+    uint32_t level = getLevel(topk, th);
+    const std::vector<FeatureRange> &ranges = cachedFeatures(FeatureQuery(topk, th, secondary));
 
-    sim.simplify(order,topk,th,wts);
-    std::vector<Feature> features;
+    // after removing the first level branches of the order, the feature of a branch is a
+    // contiguous range of the hierarchy layout
+    const uint32_t *layout = hierarchy.layout.data();
+    std::vector<Feature> features(ranges.size());
+    for(size_t i = 0;i < ranges.size();i ++) {
+        Feature &f = features[i];
+        f.from = ctdata.nodeVerts[hierarchy.from(ranges[i].branch, level)];
+        f.to = ctdata.nodeVerts[hierarchy.from(ranges[i].branch, level)];
+        f.arcs.assign(layout + ranges[i].start, layout + ranges[i].end);
+    }
+    return features;
+}
 
-    QSet<size_t> featureSet;
-    for(size_t _i = 0;_i < order.size();_i ++) {
-        size_t i = order.size() - _i - 1;
-        if(sim.removed[order[i]]) {
-            break;
+/**
+ * Ranges of the features in the order of getFeatures, without copying their arcs.
+ */
+void TopologicalFeatures::findFeatures(uint32_t level, float secondary, std::vector<FeatureRange> &ranges) {
+    ranges.clear();
+    for(size_t i = order.size();i > level;i --) {
+        uint32_t b = order[i - 1];
+        ranges.push_back({b, hierarchy.branches[b].start, hierarchy.end(b, level), uint32_t(ranges.size())});
+    }
+
+    query ++;
+    // none of the remaining candidates is persistent enough once the prefix maximum drops below secondary
+    for(uint32_t i = level;i > 0 && prefixMaxPersistence[i - 1] >= secondary;i --) {
+        // TODO make any leaf?
+        uint32_t b = order[i - 1];
+        if(maxPersistence[i - 1] >= secondary && !isCovered(b, level)) {
+            headStamp[b] = query;
+            ranges.push_back({b, hierarchy.branches[b].start, hierarchy.end(b, level), uint32_t(ranges.size())});
         }
-        featureSet << order[i];
     }
-    size_t pos = 0;
-    for(size_t _i = 0;_i < order.size();_i ++) {
-        size_t i = order.size() - _i - 1;
-        if(sim.removed[order[i]]) {
-            pos = _i;
-            break;
+}
+
+const std::vector<TopologicalFeatures::FeatureRange> &TopologicalFeatures::cachedFeatures(const FeatureQuery &q) {
+    if(!(hasLastQuery && lastQuery == q)) {
+        findFeatures(getLevel(q.topk, q.th), q.secondary, lastRanges);
+        lastQuery = q;
+        hasLastQuery = true;
+    }
+    return lastRanges;
+}
+
+/**
+ * Changes from the features of query from to those of query to. Both sets of features
+ * are disjoint ranges of the hierarchy layout, so sorting them by their start and going
+ * over both at once finds the stretches of the layout whose feature id differs. This takes
+ * O(f log f) for f features plus the number of changed arcs, which is much less than all
+ * arcs when only a few features change. The features of to are kept, so that stepping
+ * through a sequence of queries and calling getFeatures(to) afterwards only finds the
+ * features of each query once.
+ *
+ * Since the secondary features are numbered after the remaining branches, changing the
+ * number of those renumbers all secondary features, and their arcs are reported as changed.
+ */
+FeatureDelta TopologicalFeatures::getFeatureDelta(const FeatureQuery &from, const FeatureQuery &to) {
+    std::vector<FeatureRange> before = cachedFeatures(from);
+    const std::vector<FeatureRange> &after = cachedFeatures(to);
+
+    FeatureDelta delta;
+    delta.noFeatures = uint32_t(after.size());
+
+    query ++;
+    for(size_t i = 0;i < before.size();i ++) {
+        headStamp[before[i].branch] = query;
+    }
+    for(size_t i = 0;i < after.size();i ++) {
+        if(headStamp[after[i].branch] != query) {
+            delta.split.push_back(after[i].branch);
+        }
+    }
+    query ++;
+    for(size_t i = 0;i < after.size();i ++) {
+        headStamp[after[i].branch] = query;
+    }
+    for(size_t i = 0;i < before.size();i ++) {
+        if(headStamp[before[i].branch] != query) {
+            delta.merged.push_back(before[i].branch);
         }
-        addFeature(sim,order[i],features,featureSet);
     }
 
-    for(size_t _i = pos;_i < order.size();_i ++) {
-        size_t i = order.size() - _i - 1;
-        if(featureSet.contains(order[i])) {
-            continue;
+    // both sorted by start, as start << 32 | index
+    std::vector<uint64_t> sortedBefore(before.size()), sortedAfter(after.size());
+    for(size_t i = 0;i < before.size();i ++) {
+        sortedBefore[i] = (uint64_t(before[i].start) << 32) | i;
+    }
+    for(size_t i = 0;i < after.size();i ++) {
+        sortedAfter[i] = (uint64_t(after[i].start) << 32) | i;
+    }
+    std::sort(sortedBefore.begin(), sortedBefore.end());
+    std::sort(sortedAfter.begin(), sortedAfter.end());
+
+    const uint32_t *layout = hierarchy.layout.data();
+    uint32_t n = uint32_t(hierarchy.layout.size());
+    uint32_t pos = 0;
+    size_t ib = 0, ia = 0;
+    while(pos < n) {
+        // feature id at pos and the position where it may change next, for both sides
+        while(ib < before.size() && before[uint32_t(sortedBefore[ib])].end <= pos) {
+            ib ++;
         }
-        uint32_t bno = order[i];
-        featureSet << bno;
-        Branch br = sim.branches.at(bno);
-        uint32_t from = br.from;
-        uint32_t to = br.to;
-        float per = ctdata.fnVals[to] - ctdata.fnVals[from];
-        // TODO make any leaf?
-        if(ctdata.type[to] == MAXIMUM && per >= secondary) {
-            addFeature(sim,bno,features,featureSet);
+        while(ia < after.size() && after[uint32_t(sortedAfter[ia])].end <= pos) {
+            ia ++;
+        }
+        uint32_t idBefore = uint32_t(-1), nextBefore = n;
+        if(ib < before.size()) {
+            const FeatureRange &r = before[uint32_t(sortedBefore[ib])];
+            if(r.start <= pos) {
+                idBefore = r.id;
+                nextBefore = r.end;
+            } else {
+                nextBefore = r.start;
+            }
+        }
+        uint32_t idAfter = uint32_t(-1), nextAfter = n;
+        if(ia < after.size()) {
+            const FeatureRange &r = after[uint32_t(sortedAfter[ia])];
+            if(r.start <= pos) {
+                idAfter = r.id;
+                nextAfter = r.end;
+            } else {
+                nextAfter = r.start;
+            }
         }
+        uint32_t next = std::min(nextBefore, nextAfter);
+        if(idBefore != idAfter) {
+            for(uint32_t i = pos;i < next;i ++) {
+                delta.arcs.push_back(layout[i]);
+                delta.features.push_back(idAfter);
+            }
+        }
+        pos = next;
     }
-    return features;
+
+    return delta;
 }
 
 std::vector<Feature> TopologicalFeatures::getPartitionedExtremaFeatures(int topk, float th) {
@@ -130,10 +335,9 @@ std::vector<Feature> TopologicalFeatures::getPartitionedExtremaFeatures(int topk
 
     for(int _i = 0;_i < topk;_i ++) {
         size_t i = order.size() - _i - 1;
-        Branch b1 = sim.branches.at(order[i]);
         Feature f;
-        f.from = ctdata.nodeVerts[b1.from];
-        f.to = ctdata.nodeVerts[b1.to];
+        f.from = ctdata.nodeVerts[sim.branches.from[order[i]]];
+        f.to = ctdata.nodeVerts[sim.branches.to[order[i]]];
 
         size_t bno = order[i];
         std::deque<size_t> queue;
@@ -144,10 +348,8 @@ std::vector<Feature> TopologicalFeatures::getPartitionedExtremaFeatures(int topk
             if(b != bno && featureSet.contains(b)) {
                 continue;
             }
-            Branch br = sim.branches.at(b);
-            f.arcs.insert(f.arcs.end(),br.arcs.data(), br.arcs.data()+br.arcs.size());
-            for(int i = 0;i < br.children.size();i ++) {
-                int bc = br.children.at(i);
+            sim.branches.appendArcs(b, f.arcs);
+            for(uint32_t bc = sim.branches.firstChild(b);bc != Branches::None;bc = sim.branches.nextChild(bc)) {
                 queue.push_back(bc);
             }
         }
@@ -175,10 +377,9 @@ std::vector<Feature> TopologicalFeatures::getArcFeatures(int topk, float th) {
         if(sim.removed[i]) {
             continue;
         }
-        Branch b1 = sim.branches.at(i);
         Feature f;
-        f.from = ctdata.nodeVerts[b1.from];
-        f.to = ctdata.nodeVerts[b1.to];
+        f.from = ctdata.nodeVerts[sim.branches.from[i]];
+        f.to = ctdata.nodeVerts[sim.branches.to[i]];
 
         size_t bno = i;
         std::deque<size_t> queue;
@@ -190,10 +391,8 @@ std::vector<Feature> TopologicalFeatures::getArcFeatures(int topk, float th) {
                 // this cannot happen
                 assert(false);
             }
-            Branch br = sim.branches.at(b);
-            f.arcs.insert(f.arcs.end(),br.arcs.data(), br.arcs.data()+br.arcs.size());
-            for(int i = 0;i < br.children.size();i ++) {
-                int bc = br.children.at(i);
+            sim.branches.appendArcs(b, f.arcs);
+            for(uint32_t bc = sim.branches.firstChild(b);bc != Branches::None;bc = sim.branches.nextChild(bc)) {
                 queue.push_back(bc);
             }
         }
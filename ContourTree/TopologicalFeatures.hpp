@@ -2,6 +2,7 @@
 #define TOPOLOGICALFEATURES_HPP
 
 #include "SimplifyCT.hpp"
+#include "SimplificationHierarchy.hpp"
 #include <QString>
 #include <QSet>
 
@@ -12,6 +13,27 @@ struct Feature {
     uint32_t from, to;
 };
 
+// parameters of getFeatures
+struct FeatureQuery {
+    FeatureQuery(int topk = -1, float th = 0, float secondary = 1) : topk(topk), th(th), secondary(secondary) {}
+    bool operator==(const FeatureQuery &q) const { return topk == q.topk && th == q.th && secondary == q.secondary; }
+    int topk;
+    float th;
+    float secondary;
+};
+
+// changes between the features of two queries. feature ids are the indices into the result of getFeatures
+struct FeatureDelta {
+    uint32_t noFeatures;
+    // branches that head a feature only after the change, i.e. that were split off from another feature
+    std::vector<uint32_t> split;
+    // branches that head a feature only before the change, i.e. that were merged into another one
+    std::vector<uint32_t> merged;
+    // arcs whose feature id changed, in no particular order, and their new feature ids, -1 if they are no longer part of one
+    std::vector<uint32_t> arcs;
+    std::vector<uint32_t> features;
+};
+
 class TopologicalFeatures
 {
 public:
@@ -21,6 +43,10 @@ public:
     std::vector<Feature> getArcFeatures(int topk = -1, float th = 0);
     std::vector<Feature> getPartitionedExtremaFeatures(int topk = -1, float th = 0);
     std::vector<Feature> getFeatures(int topk = -1, float th = 0, float secondary = 1);
+    std::vector<Feature> getFeatures(const FeatureQuery &q) { return getFeatures(q.topk, q.th, q.secondary); }
+    FeatureDelta getFeatureDelta(const FeatureQuery &from, const FeatureQuery &to);
+    // number of branches of the order that are removed to get topk features, or all features above th
+    uint32_t getLevel(int topk = -1, float th = 0) const;
 
 public:
     ContourTreeData ctdata;
@@ -31,8 +57,41 @@ public:
     std::vector<std::vector<uint32_t> > featureArcs;
     SimplifyCT sim;
 
+    SimplificationHierarchy hierarchy;
+    // position of every branch in order, -1 for the branches that are merged into others
+    std::vector<uint32_t> orderIndex;
+    // persistence of the branches in order once removed, -infinity if they do not end in a maximum
+    std::vector<float> maxPersistence;
+    // largest maxPersistence of the first i + 1 branches of order
+    std::vector<float> prefixMaxPersistence;
+
 private:
-    void addFeature(SimplifyCT &sim, uint32_t bno, std::vector<Feature> &features, QSet<size_t> &featureSet);
+    // a feature headed by branch, covering layout[start] .. layout[end - 1] of the hierarchy
+    struct FeatureRange {
+        uint32_t branch;
+        uint32_t start;
+        uint32_t end;
+        uint32_t id;
+    };
+
+    bool loadTreeFile(QString fileName);
+    void loadBinFiles(QString dataLocation);
+    void findFeatures(uint32_t level, float secondary, std::vector<FeatureRange> &ranges);
+    // features of q, reusing those of the last query when it is the same
+    const std::vector<FeatureRange> &cachedFeatures(const FeatureQuery &q);
+    bool isCovered(uint32_t bno, uint32_t level);
+
+    // scratch space of isCovered, entries are valid if their stamp is the current query
+    uint32_t query;
+    std::vector<uint32_t> headStamp;
+    std::vector<uint32_t> visitStamp;
+    std::vector<char> covered;
+    std::vector<uint32_t> path;
+
+    // features of the last query of getFeatures or getFeatureDelta
+    bool hasLastQuery;
+    FeatureQuery lastQuery;
+    std::vector<FeatureRange> lastRanges;
 
 };
 
@@ -16,7 +16,7 @@ int TriMesh::getMaxDegree() {
     return maxStar;
 }
 
-int TriMesh::getVertexCount() {
+int64_t TriMesh::getVertexCount() {
     return nv;
 }
 
@@ -38,7 +38,7 @@ bool TriMesh::lessThan(int64_t v1, int64_t v2) {
     return false;
 }
 
-unsigned char TriMesh::getFunctionValue(int64_t v) {
+float TriMesh::getFunctionValue(int64_t v) {
     return this->fnVals[v];
 }
 
@@ -17,10 +17,10 @@ public:
     TriMesh();
 
     int getMaxDegree();
-    int getVertexCount();
+    int64_t getVertexCount();
     int getStar(int64_t v, QVector<int64_t> &star);
     bool lessThan(int64_t v1, int64_t v2);
-    unsigned char getFunctionValue(int64_t v);
+    float getFunctionValue(int64_t v);
 
 public:
     void loadData(QString fileName);
@@ -12,6 +12,9 @@ const char SADDLE = 4;
 // JoinTree -> maxima and SplitTree -> minima
 enum TreeType {TypeJoinTree, TypeSplitTree, TypeContourTree};
 
+// Storage type of the function values of the input and of the nodes in .rg.bin
+enum ValueType {TypeUInt8, TypeUInt16, TypeFloat};
+
 }
 
 #endif // CONSTANTS_H
@@ -12,8 +12,10 @@
 #include "TriMesh.hpp"
 #include "TopologicalFeatures.hpp"
 #include "HyperVolume.hpp"
+#include "PartitionFile.hpp"
 #include <fstream>
 #include <cmath>
+#include <cstdio>
 
 using namespace contourtree;
 
@@ -21,7 +23,7 @@ void preProcessing(QString rawFile, int dimx, int dimy, int dimz) {
     // Assumes type to be unsigned char
 
     std::chrono::time_point<std::chrono::system_clock> start, end;
-    Grid3D grid(dimx,dimy,dimz);
+    Grid3D<unsigned char> grid(dimx,dimy,dimz);
 
     QString data = rawFile;
     if(rawFile.endsWith(".raw")) {
@@ -29,14 +31,14 @@ void preProcessing(QString rawFile, int dimx, int dimy, int dimz) {
     }
 
     start = std::chrono::system_clock::now();
-    grid.loadGrid(data + ".raw");
-    MergeTree ct;
+    if(!grid.mapGrid(data + ".raw")) {
+        grid.loadGrid(data + ".raw");
+    }
     contourtree::TreeType tree = TypeJoinTree;
     qDebug() << "computing join tree";
-    ct.computeTree(&grid,tree);
+    computeMergeTree(&grid,tree,data,true);
     end = std::chrono::system_clock::now();
     qDebug() << "Time to compute contour tree: " << std::chrono::duration_cast<std::chrono::milliseconds>(end-start).count() << "ms\n";
-    ct.output(data, tree);
 
 
     qDebug() << "creating hierarchical segmentation";
@@ -59,6 +61,11 @@ void preProcessing(QString rawFile, int dimx, int dimy, int dimz) {
     qDebug() << "Time to simplify: " << std::chrono::duration_cast<std::chrono::milliseconds>(end-start).count() << "ms\n";
 
     sim.outputOrder(data);
+
+    qDebug() << "compressing segmentation";
+    if(PartitionWriter::compress(data + ".part.raw", data + ".part.brk", dimx, dimy, dimz)) {
+        std::remove((data + ".part.raw").toStdString().c_str());
+    }
     qDebug() << "done";
 }
 
@@ -14,8 +14,24 @@
 #include "TriMesh.hpp"
 #include "TopologicalFeatures.hpp"
 #include "HyperVolume.hpp"
+#include "ContourTreeFile.hpp"
+#include "PartitionFile.hpp"
+#include "StreamingMergeTree.hpp"
+#include "AllocationCounter.hpp"
+#include "Feathering.hpp"
 #include <fstream>
 #include <cmath>
+#include <deque>
+#include <cstring>
+#ifdef WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 void testDisjointSets() {
     int numElements = 128;
@@ -40,17 +56,51 @@ void testDisjointSets() {
     std::cout << "\n";
 }
 
+// Stress test on n elements: a monotone chain, which made the recursive find overflow
+// the stack, followed by random merges, serially and with the concurrent variant.
+void benchmarkDisjointSets(int64_t n = 1000000000) {
+    std::chrono::time_point<std::chrono::system_clock> start, end;
+    {
+        DisjointSets<uint32_t> ds(n);
+        start = std::chrono::system_clock::now();
+        for(int64_t i = 1;i < n;i ++) {
+            ds.set[i] = i - 1;
+        }
+        assert(ds.find(n - 1) == 0);
+        for(int64_t i = 0;i < n;i ++) {
+            ds.merge(i, (i * 2654435761u) % n);
+        }
+        end = std::chrono::system_clock::now();
+        qDebug() << "serial, " << n << "elements: " << std::chrono::duration_cast<std::chrono::milliseconds>(end-start).count() << "ms";
+    }
+    {
+        ConcurrentDisjointSets<uint32_t> ds(n);
+        start = std::chrono::system_clock::now();
+#pragma omp parallel for
+        for(int64_t i = 1;i < n;i ++) {
+            ds.set[i].store(i - 1, std::memory_order_relaxed);
+        }
+        assert(ds.find(n - 1) == 0);
+#pragma omp parallel for
+        for(int64_t i = 0;i < n;i ++) {
+            ds.merge(i, (i * 2654435761u) % n);
+        }
+        end = std::chrono::system_clock::now();
+        qDebug() << "concurrent, " << n << "elements: " << std::chrono::duration_cast<std::chrono::milliseconds>(end-start).count() << "ms";
+    }
+}
+
 void testGrid() {
     qDebug() << "in test grid";
     std::chrono::time_point<std::chrono::system_clock> start, end;
     start = std::chrono::system_clock::now();
-    Grid3D grid(256,257,471);
+    Grid3D<unsigned char> grid(256,257,471);
     end = std::chrono::system_clock::now();
     qDebug() << "Test 1 - Elapsed time: " << std::chrono::duration_cast<std::chrono::milliseconds>(end-start).count() << "ms\n";
 
     start = std::chrono::system_clock::now();
     grid.loadGrid("/home/harishd/Desktop/Projects/Fish/data/Fish_256/Fish_256.raw");
-    MergeTree ct;
+    MergeTree<uint32_t> ct;
     ct.computeTree(&grid,TypeJoinTree);
     end = std::chrono::system_clock::now();
     qDebug() << "Test 2 - Elapsed time: " << std::chrono::duration_cast<std::chrono::milliseconds>(end-start).count() << "ms\n";
@@ -124,12 +174,11 @@ void testSimplification2() {
 
     qDebug() << "testing equivalence";
     for(int i = 0;i < order.size();i ++) {
-        Branch b1 = sim.branches.at(order[i]);
-        Branch b2 = simo.branches.at(order[i]);
-        assert(b1.from != b2.from || b1.to != b2.to);
-        assert(b1.parent == b2.parent);
-        assert(b1.children == b2.children);
-        assert(b1.arcs == b2.arcs);
+        uint32_t b = order[i];
+        assert(sim.branches.from[b] != simo.branches.from[b] || sim.branches.to[b] != simo.branches.to[b]);
+        assert(sim.branches.parentOf(b) == simo.branches.parentOf(b));
+        assert(sim.branches.children(b) == simo.branches.children(b));
+        assert(sim.branches.arcs(b) == simo.branches.arcs(b));
     }
     qDebug() << "done!";
 
@@ -153,9 +202,8 @@ void testSimplification1() {
     qDebug() << "simplification - Elapsed time: " << std::chrono::duration_cast<std::chrono::milliseconds>(end-start).count() << "ms\n";
 
     for(int i = 0;i < sim.order.size();i ++) {
-        Branch b1 = sim.branches.at(sim.order[i]);
-        int v1 = b1.from;
-        int v2 = b1.to;
+        int v1 = sim.branches.from[sim.order[i]];
+        int v2 = sim.branches.to[sim.order[i]];
         qDebug() << ctdata.nodeVerts[v1] << ctdata.nodeVerts[v2];
     }
     qDebug() << "done!";
@@ -164,6 +212,11 @@ void testSimplification1() {
 
 void testPriorityQueue() {
     SimplifyCT sim;
+    sim.fn.resize(30);
+    for(int i = 0;i < 30;i ++) {
+        sim.fn[i] = i;
+    }
+    sim.queue.resize(30);
     sim.queue.push(20);
     sim.queue.push(10);
     sim.queue.push(15);
@@ -175,12 +228,25 @@ void testPriorityQueue() {
         sim.queue.pop();
         qDebug() << top;
     }
+
+    // key changes in both directions
+    sim.queue.push(20);
+    sim.queue.push(10);
+    sim.queue.push(15);
+    sim.fn[10] = 25;
+    sim.queue.update(10);
+    assert(sim.queue.top() == 15);
+    sim.fn[20] = 1;
+    sim.queue.update(20);
+    assert(sim.queue.top() == 20);
+    sim.queue.remove(20);
+    assert(sim.queue.top() == 15 && sim.queue.size() == 2);
 }
 
 void testMergeTree() {
     TriMesh tri;
     tri.loadData("C:/Users/harishd/Desktop/Courses/Topology-2017/data/2d/assignment.off");
-    MergeTree ct;
+    MergeTree<uint32_t> ct;
     ct.computeTree(&tri,TypeContourTree);
     qDebug() << "done";
     ct.output("C:/Users/harishd/Desktop/Courses/Topology-2017/data/2d/assignment",TypeContourTree);
@@ -203,9 +269,8 @@ void testMergeTree() {
     sim.outputOrder("C:/Users/harishd/Desktop/Courses/Topology-2017/data/2d/assignment");
     qDebug() << "************** All branches ********************";;
     for(int i = 0;i < sim.order.size();i ++) {
-        Branch b1 = sim.branches.at(sim.order[i]);
-        int v1 = b1.from;
-        int v2 = b1.to;
+        int v1 = sim.branches.from[sim.order[i]];
+        int v2 = sim.branches.to[sim.order[i]];
         qDebug() << ctdata.nodeVerts[v1] << ctdata.nodeVerts[v2];
     }
 
@@ -218,9 +283,8 @@ void testMergeTree() {
         if(sim2.removed[sim.order[i]]) {
             break;
         }
-        Branch b1 = sim2.branches.at(sim.order[i]);
-        int v1 = b1.from;
-        int v2 = b1.to;
+        int v1 = sim2.branches.from[sim.order[i]];
+        int v2 = sim2.branches.to[sim.order[i]];
         qDebug() << ctdata.nodeVerts[v1] << ctdata.nodeVerts[v2];
     }
 
@@ -233,12 +297,12 @@ void toyProcessing() {
 
     std::chrono::time_point<std::chrono::system_clock> start, end;
     start = std::chrono::system_clock::now();
-    Grid3D grid(128,128,128);
+    Grid3D<unsigned char> grid(128,128,128);
     end = std::chrono::system_clock::now();
 
     start = std::chrono::system_clock::now();
     grid.loadGrid(data + ".raw");
-    MergeTree ct;
+    MergeTree<uint32_t> ct;
     contourtree::TreeType tree = TypeJoinTree;
     ct.computeTree(&grid,tree);
     end = std::chrono::system_clock::now();
@@ -417,10 +481,10 @@ void testFeatures() {
 
 void testConnectivity() {
 //    QString data = "../data/ContourTree/Fish_256";
-//    Grid3D grid(256,257,471);
+//    Grid3D<unsigned char> grid(256,257,471);
 
     QString data = "../data/Cameroon/Cameroon_256";
-    Grid3D grid(256,256,527);
+    Grid3D<unsigned char> grid(256,256,527);
 
     // read part file
     int dimx = 256;
@@ -542,10 +606,973 @@ void toyFeatures() {
     ip.close();
 }
 
+// Times the sweep alone, i.e. without setting up and ordering the vertices
+class ParallelSweep : public MergeTree<uint32_t> {
+public:
+    double seconds(ScalarFunction *fn, TreeType type, bool parallel) {
+        data = fn;
+        setupData();
+        orderVertices();
+        showProgress = false;
+        std::chrono::time_point<std::chrono::system_clock> start, end;
+        start = std::chrono::system_clock::now();
+        if(type == TypeJoinTree) {
+            parallel ? computeJoinTreeParallel() : computeJoinTree();
+        } else {
+            parallel ? computeSplitTreeParallel() : computeSplitTree();
+        }
+        end = std::chrono::system_clock::now();
+        return std::chrono::duration_cast<std::chrono::microseconds>(end-start).count() / 1e6;
+    }
+};
+
+// The block-parallel sweeps for 1 to 32 threads against the serial one, on a noisy volume
+// with many critical points. The trees have to be the same
+void benchmarkParallelMergeTree(int dim = 192) {
+    QString data = "../data/bench_par";
+    {
+        std::vector<uint8_t> volume(int64_t(dim) * dim * dim);
+        srand(7);
+        for(int64_t i = 0;i < (int64_t)volume.size();i ++) {
+            int x = i % dim, y = (i / dim) % dim, z = i / (int64_t(dim) * dim);
+            double val = 127 + 60 * std::sin(x * 0.31) * std::cos(y * 0.27) + 50 * std::sin(z * 0.19 + x * 0.05) + rand() % 24;
+            volume[i] = (uint8_t)std::max(0.0, std::min(255.0, val));
+        }
+        std::ofstream of((data + ".raw").toStdString(), std::ios::binary);
+        of.write((char *)volume.data(), volume.size());
+    }
+    Grid3D<unsigned char> grid(dim,dim,dim);
+    grid.loadGrid(data + ".raw");
+
+    TreeType types[] = {TypeJoinTree, TypeSplitTree};
+    int threads[] = {1, 2, 4, 8, 16, 32};
+    for(TreeType type: types) {
+        ParallelSweep serial;
+        double serialTime = serial.seconds(&grid, type, false);
+        qDebug() << dim << "^3," << (type == TypeJoinTree ? "join" : "split") << "tree, serial sweep:" << serialTime * 1000 << "ms";
+        for(int t: threads) {
+#ifdef _OPENMP
+            omp_set_num_threads(t);
+#endif
+            ParallelSweep ct;
+            double time = ct.seconds(&grid, type, true);
+            bool same = (ct.prev == serial.prev && ct.next == serial.next && ct.criticalPts == serial.criticalPts);
+            qDebug() << t << "threads:" << time * 1000 << "ms, speedup" << serialTime / time << (same ? "" : "- DIFFERENT TREE");
+            assert(same);
+        }
+    }
+#ifdef _OPENMP
+    omp_set_num_threads(omp_get_num_procs());
+#endif
+}
+
+// peak resident set size of the process in MB
+double peakMemory() {
+#ifdef WIN32
+    PROCESS_MEMORY_COUNTERS pmc;
+    GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc));
+    return pmc.PeakWorkingSetSize / (1024.0 * 1024.0);
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.0;
+#endif
+}
+
+template <class T>
+void benchmarkJoinTree(QString data, int dim) {
+    Grid3D<unsigned char> grid(dim,dim,dim);
+    grid.loadGrid(data + ".raw");
+
+    std::chrono::time_point<std::chrono::system_clock> start, end;
+    start = std::chrono::system_clock::now();
+    MergeTree<T> ct;
+    ct.computeTree(&grid,TypeJoinTree,true);
+    end = std::chrono::system_clock::now();
+    qDebug() << dim << "^3," << sizeof(T) * 8 << "bit indices: " << std::chrono::duration_cast<std::chrono::milliseconds>(end-start).count() << "ms,"
+             << "peak memory" << peakMemory() << "MB";
+}
+
+// The peak memory is that of the whole process, so the runs go from the smallest to the largest
+void benchmarkIndexWidth() {
+    int dims[] = {256, 512};
+    for(int d = 0;d < 2;d ++) {
+        int dim = dims[d];
+        QString data = "../data/bench_" + QString::number(dim);
+        {
+            std::vector<uint8_t> volume(int64_t(dim) * dim * dim);
+            for(int z = 0;z < dim;z ++) {
+                for(int y = 0;y < dim;y ++) {
+                    for(int x = 0;x < dim;x ++) {
+                        double val = std::sin(x * 0.05) * std::cos(y * 0.07) + std::sin(z * 0.03 + x * 0.02);
+                        volume[(int64_t(z) * dim + y) * dim + x] = (uint8_t)((val + 2) * 63);
+                    }
+                }
+            }
+            std::ofstream of((data + ".raw").toStdString(), std::ios::binary);
+            of.write((char *)volume.data(), volume.size());
+            of.close();
+        }
+        benchmarkJoinTree<uint32_t>(data, dim);
+        benchmarkJoinTree<int64_t>(data, dim);
+    }
+}
+
+std::vector<char> readFile(QString fileName) {
+    std::ifstream ip(fileName.toStdString(), std::ios::binary);
+    return std::vector<char>(std::istreambuf_iterator<char>(ip), std::istreambuf_iterator<char>());
+}
+
+// The out-of-core join tree has to write exactly the files of MergeTree::output, for any slab
+// depth. The volume has few distinct values, so that the order of equal values is exercised
+void testStreamingMergeTree() {
+    const int dimx = 37, dimy = 29, dimz = 53;
+    QString data = "../data/stream";
+    {
+        std::vector<uint8_t> volume(int64_t(dimx) * dimy * dimz);
+        srand(11);
+        for(int64_t i = 0;i < (int64_t)volume.size();i ++) {
+            int x = i % dimx, y = (i / dimx) % dimy, z = i / (int64_t(dimx) * dimy);
+            double val = 8 + 4 * std::sin(x * 0.4) * std::cos(y * 0.3) + 3 * std::sin(z * 0.25 + x * 0.1) + rand() % 3;
+            volume[i] = (uint8_t)val;
+        }
+        std::ofstream of((data + ".raw").toStdString(), std::ios::binary);
+        of.write((char *)volume.data(), volume.size());
+    }
+    Grid3D<unsigned char> grid(dimx,dimy,dimz);
+    grid.loadGrid(data + ".raw");
+    MergeTree<uint32_t> ct;
+    ct.computeTree(&grid,TypeJoinTree);
+    ct.output(data,TypeJoinTree);
+
+    int depths[] = {1, 2, 5, 16, 52, 53, 64};
+    for(int depth : depths) {
+        StreamingMergeTree st(dimx, dimy, dimz, depth);
+        st.computeTree(data + ".raw", TypeJoinTree);
+        st.output(data + "_stream", TypeJoinTree);
+        for(QString ext : {".rg.dat", ".rg.bin", ".part.raw"}) {
+            bool same = (readFile(data + ext) == readFile(data + "_stream" + ext));
+            qDebug() << "slab depth" << depth << ext << (same ? "identical" : "DIFFERENT");
+            assert(same);
+        }
+    }
+}
+
+// Forwards to a Grid3D without being one, so that the merge tree sweep uses the virtual interface
+class VirtualGrid : public ScalarFunction {
+public:
+    VirtualGrid(Grid3D<unsigned char> *grid) : grid(grid) {}
+    int getMaxDegree() { return grid->getMaxDegree(); }
+    int64_t getVertexCount() { return grid->getVertexCount(); }
+    int getStar(int64_t v, QVector<int64_t> &star) { return grid->getStar(v, star); }
+    bool lessThan(int64_t v1, int64_t v2) { return grid->lessThan(v1, v2); }
+    float getFunctionValue(int64_t v) { return grid->getFunctionValue(v); }
+    ValueType getValueType() { return grid->getValueType(); }
+    const void* getFunctionValues() { return grid->getFunctionValues(); }
+
+    Grid3D<unsigned char> *grid;
+};
+
+// Times only the join tree sweep, i.e. processVertex for every vertex
+class SweepBenchmark : public MergeTree<uint32_t> {
+public:
+    double verticesPerSecond(ScalarFunction *fn) {
+        data = fn;
+        setupData();
+        orderVertices();
+        std::chrono::time_point<std::chrono::system_clock> start, end;
+        start = std::chrono::system_clock::now();
+        computeJoinTree();
+        end = std::chrono::system_clock::now();
+        double secs = std::chrono::duration_cast<std::chrono::microseconds>(end-start).count() / 1e6;
+        return noVertices / secs;
+    }
+
+#ifndef NDEBUG
+    // without the progress messages, the sweep is nothing but the loop over the vertices
+    int64_t countAllocations(ScalarFunction *fn) {
+        data = fn;
+        setupData();
+        orderVertices();
+        showProgress = false;
+        AllocationCounter counter;
+        computeJoinTree();
+        return counter.count();
+    }
+#endif
+};
+
+void benchmarkProcessVertex() {
+    QString data = "../data/toy";
+    Grid3D<unsigned char> grid(128,128,128);
+    grid.loadGrid(data + ".raw");
+    VirtualGrid vgrid(&grid);
+
+    SweepBenchmark before;
+    qDebug() << "virtual ScalarFunction:" << before.verticesPerSecond(&vgrid) << "vertices/sec";
+    SweepBenchmark after;
+    qDebug() << "inlined Grid3D:" << after.verticesPerSecond(&grid) << "vertices/sec";
+}
+
+#ifndef NDEBUG
+void testSweepAllocations() {
+    QString data = "../data/toy";
+    Grid3D<unsigned char> grid(128,128,128);
+    grid.loadGrid(data + ".raw");
+
+    SweepBenchmark sweep;
+    int64_t allocations = sweep.countAllocations(&grid);
+    qDebug() << "heap allocations during the sweep of" << sweep.noVertices << "vertices:" << allocations;
+    assert(allocations == 0);
+}
+#endif
+
+// A contour tree segmentation of a noisy volume whose dimensions are not multiples of the brick sizes
+QString generatePartition(int dimx, int dimy, int dimz) {
+    QString data = "../data/partition";
+    {
+        std::vector<uint8_t> volume(int64_t(dimx) * dimy * dimz);
+        srand(13);
+        for(int64_t i = 0;i < (int64_t)volume.size();i ++) {
+            int x = i % dimx, y = (i / dimx) % dimy, z = i / (int64_t(dimx) * dimy);
+            double val = 127 + 60 * std::sin(x * 0.31) * std::cos(y * 0.27) + 50 * std::sin(z * 0.19 + x * 0.05) + rand() % 24;
+            volume[i] = (uint8_t)std::max(0.0, std::min(255.0, val));
+        }
+        std::ofstream of((data + ".raw").toStdString(), std::ios::binary);
+        of.write((char *)volume.data(), volume.size());
+    }
+    Grid3D<unsigned char> grid(dimx,dimy,dimz);
+    grid.loadGrid(data + ".raw");
+    computeMergeTree(&grid,TypeContourTree,data,true);
+    return data;
+}
+
+// Round trip of .part.raw through .part.brk, by bricks and by random ranges of slices
+void testPartitionFile() {
+    const int dimx = 45, dimy = 38, dimz = 29;
+    QString data = generatePartition(dimx, dimy, dimz);
+    std::vector<uint32_t> raw(int64_t(dimx) * dimy * dimz);
+    {
+        std::ifstream ip((data + ".part.raw").toStdString(), std::ios::binary);
+        ip.read((char *)raw.data(), raw.size() * sizeof(uint32_t));
+    }
+    uint64_t rawSize = raw.size() * sizeof(uint32_t);
+
+    int brickSizes[] = {1, 7, 16, 32, 64};
+    srand(17);
+    for(int brickSize : brickSizes) {
+        bool written = PartitionWriter::compress(data + ".part.raw", data + ".part.brk", dimx, dimy, dimz, brickSize);
+        assert(written);
+        PartitionFile part;
+        bool opened = part.open(data + ".part.brk");
+        assert(opened);
+        assert(part.header.dimx == dimx && part.header.dimy == dimy && part.header.dimz == dimz);
+
+        std::vector<uint32_t> vals;
+        int64_t noVoxels = 0;
+        for(int64_t b = 0;b < (int64_t)part.header.noBricks;b ++) {
+            int x0, y0, z0, nx, ny, nz;
+            part.getBrickExtent(b, x0, y0, z0, nx, ny, nz);
+            part.readBrick(b, vals);
+            assert((int64_t)vals.size() == int64_t(nx) * ny * nz);
+            int64_t i = 0;
+            for(int z = z0;z < z0 + nz;z ++) {
+                for(int y = y0;y < y0 + ny;y ++) {
+                    for(int x = x0;x < x0 + nx;x ++) {
+                        assert(vals[i ++] == raw[(int64_t(z) * dimy + y) * dimx + x]);
+                    }
+                }
+            }
+            noVoxels += vals.size();
+        }
+        assert(noVoxels == (int64_t)raw.size());
+
+        for(int i = 0;i < 20;i ++) {
+            int z0 = rand() % dimz;
+            int noSlices = 1 + rand() % (dimz - z0);
+            vals.resize(int64_t(noSlices) * dimx * dimy);
+            part.readSlices(z0, noSlices, vals.data());
+            assert(std::equal(vals.begin(), vals.end(), raw.begin() + int64_t(z0) * dimx * dimy));
+        }
+
+        std::ifstream brk((data + ".part.brk").toStdString(), std::ios::binary | std::ios::ate);
+        qDebug() << "brick size" << brickSize << ": round trip ok," << rawSize << "bytes as .part.raw," << (uint64_t)brk.tellg() << "as .part.brk";
+    }
+
+    // a truncated raw file must not give a .part.brk file, so that the raw file is kept
+    {
+        std::ofstream of((data + "_short.part.raw").toStdString(), std::ios::binary);
+        of.write((const char *)raw.data(), rawSize / 2);
+    }
+    QFile::remove(data + "_short.part.brk");
+    bool written = PartitionWriter::compress(data + "_short.part.raw", data + "_short.part.brk", dimx, dimy, dimz);
+    assert(!written && !QFile::exists(data + "_short.part.brk"));
+    written = PartitionWriter::compress(data + ".part.raw", data + "_short.part.brk", dimx, dimy, dimz + 1);
+    assert(!written && !QFile::exists(data + "_short.part.brk"));
+    qDebug() << "truncated .part.raw is not compressed";
+
+    // a damaged .part.brk has to be rejected when it is opened or when the damaged brick is
+    // read, rather than being decoded from outside of the mapping
+    written = PartitionWriter::compress(data + ".part.raw", data + ".part.brk", dimx, dimy, dimz, 7);
+    assert(written);
+    std::vector<char> intact = readFile(data + ".part.brk");
+    PartitionHeader header;
+    memcpy(&header, &intact[0], sizeof(PartitionHeader));
+    const uint64_t *intactOffsets = (const uint64_t *)(&intact[0] + sizeof(PartitionHeader));
+    // a brick with more than one arc, so that it has packed indices
+    uint64_t packedBrick = 0;
+    while(((const uint32_t *)(&intact[0] + intactOffsets[packedBrick]))[1] == 0) {
+        packedBrick ++;
+    }
+    enum Damage { OffsetsDecreasing, EmptyPalette, LargePalette, TooManyBits, PackedPastEnd, IndexPastPalette };
+    const char *damageNames[] = {"decreasing offsets", "empty palette", "palette larger than the brick",
+                                 "more than 32 bits", "packed indices past the brick", "index past the palette"};
+    for(int damage = OffsetsDecreasing;damage <= IndexPastPalette;damage ++) {
+        std::vector<char> bytes = intact;
+        uint64_t *offsets = (uint64_t *)(&bytes[0] + sizeof(PartitionHeader));
+        uint32_t *brick = (uint32_t *)(&bytes[0] + offsets[packedBrick]);
+        switch(damage) {
+        case OffsetsDecreasing: std::swap(offsets[1], offsets[2]); break;
+        case EmptyPalette: brick[0] = 0; break;
+        case LargePalette: brick[0] = 7 * 7 * 7 + 1; break;
+        case TooManyBits: brick[1] = 64; break;
+        case PackedPastEnd: brick[1] = 32; break;
+        case IndexPastPalette: brick[0] = 1; break;
+        }
+        {
+            std::ofstream of((data + "_damaged.part.brk").toStdString(), std::ios::binary);
+            of.write(bytes.data(), bytes.size());
+        }
+        PartitionFile part;
+        if(part.open(data + "_damaged.part.brk")) {
+            assert(damage == IndexPastPalette);
+            std::vector<uint32_t> vals;
+            bool read = part.readBrick(packedBrick, vals);
+            assert(!read);
+            vals.resize(int64_t(dimx) * dimy * dimz);
+            read = part.readSlices(0, dimz, vals.data());
+            assert(!read);
+        }
+        qDebug() << "damaged" << damageNames[damage] << ": rejected";
+    }
+    QFile::remove(data + "_damaged.part.brk");
+}
+
+// HyperVolume has to find the same arc volumes, and give the same simplification, from both formats
+void testHyperVolumeBricks() {
+    const int dimx = 45, dimy = 38, dimz = 29;
+    QString data = generatePartition(dimx, dimy, dimz);
+    bool written = PartitionWriter::compress(data + ".part.raw", data + ".part.brk", dimx, dimy, dimz);
+    assert(written);
+
+    ContourTreeData ctdata;
+    ctdata.loadBinFile(data);
+    HyperVolume fromRaw(ctdata, data + ".part.raw");
+    HyperVolume fromBricks(ctdata, data + ".part.brk");
+    assert(fromRaw.vol == fromBricks.vol);
+
+    SimplifyCT simRaw;
+    simRaw.setInput(&ctdata);
+    simRaw.simplify(&fromRaw);
+    SimplifyCT simBricks;
+    simBricks.setInput(&ctdata);
+    simBricks.simplify(&fromBricks);
+    assert(simRaw.order == simBricks.order);
+    qDebug() << ctdata.noArcs << "arcs: same volumes and simplification order from .part.raw and .part.brk";
+}
+
+// Needs the output of toyProcessing
+void benchmarkTreeLoading() {
+    QString data = "../data/toy";
+
+    std::chrono::time_point<std::chrono::system_clock> start, end;
+    start = std::chrono::system_clock::now();
+    ContourTreeData binData;
+    binData.loadBinFile(data);
+    end = std::chrono::system_clock::now();
+    qDebug() << "loading .rg.dat and .rg.bin:" << std::chrono::duration_cast<std::chrono::microseconds>(end-start).count() << "us";
+
+    start = std::chrono::system_clock::now();
+    std::shared_ptr<ContourTreeFile> file = std::make_shared<ContourTreeFile>();
+    ContourTreeData fileData;
+    bool loaded = file->open(data + ".ctree") && fileData.loadTreeFile(file);
+    end = std::chrono::system_clock::now();
+    qDebug() << "mapping .ctree:" << std::chrono::duration_cast<std::chrono::microseconds>(end-start).count() << "us";
+
+    assert(loaded);
+    assert(fileData.noNodes == binData.noNodes && fileData.noArcs == binData.noArcs);
+    for(uint32_t i = 0;i < binData.noArcs;i ++) {
+        assert(fileData.arcs[i].from == binData.arcs[i].from && fileData.arcs[i].to == binData.arcs[i].to);
+    }
+}
+
+// Needs the output of toyProcessing
+void benchmarkLoadData() {
+    QString data = "../data/toy";
+    const int runs = 10;
+
+    std::chrono::time_point<std::chrono::system_clock> start, end;
+    start = std::chrono::system_clock::now();
+    uint32_t noArcs = 0;
+    for(int i = 0;i < runs;i ++) {
+        ContourTreeData ctdata;
+        ctdata.loadBinFile(data);
+        noArcs = ctdata.noArcs;
+    }
+    end = std::chrono::system_clock::now();
+    double secs = std::chrono::duration_cast<std::chrono::microseconds>(end-start).count() / 1e6;
+    qDebug() << "loadBinFile:" << noArcs * (runs / secs) << "arcs/sec";
+}
+
+// A noisy volume, so that the contour tree has about 10^6 arcs
+void benchmarkHyperVolume() {
+    const int dim = 320;
+    QString data = "../data/bench_hv";
+    {
+        std::vector<uint8_t> volume(int64_t(dim) * dim * dim);
+        srand(7);
+        for(int64_t i = 0;i < (int64_t)volume.size();i ++) {
+            int x = i % dim, y = (i / dim) % dim, z = i / (int64_t(dim) * dim);
+            double val = 127 + 60 * std::sin(x * 0.31) * std::cos(y * 0.27) + 50 * std::sin(z * 0.19 + x * 0.05) + rand() % 24;
+            volume[i] = (uint8_t)std::max(0.0, std::min(255.0, val));
+        }
+        std::ofstream of((data + ".raw").toStdString(), std::ios::binary);
+        of.write((char *)volume.data(), volume.size());
+        of.close();
+    }
+    Grid3D<unsigned char> grid(dim,dim,dim);
+    grid.loadGrid(data + ".raw");
+    computeMergeTree(&grid,TypeContourTree,data,true);
+
+    ContourTreeData ctdata;
+    ctdata.loadBinFile(data);
+    SimplifyCT sim;
+    sim.setInput(&ctdata);
+    HyperVolume simFn(ctdata,data + ".part.raw");
+
+    std::chrono::time_point<std::chrono::system_clock> start, end;
+    start = std::chrono::system_clock::now();
+    sim.simplify(&simFn);
+    end = std::chrono::system_clock::now();
+    qDebug() << ctdata.noArcs << "arcs, hyper volume simplification:" << std::chrono::duration_cast<std::chrono::milliseconds>(end-start).count() << "ms";
+}
+
+// HyperVolume::update as it was before the branch volumes were kept up to date: the volume of
+// a branch is summed over its whole subtree of removed branches on every update. The subtree
+// is walked with a stack instead of the recursion, which would overflow on the comb below
+class SubtreeHyperVolume : public HyperVolume
+{
+public:
+    SubtreeHyperVolume(const ContourTreeData &ctData, QString partFile) : HyperVolume(ctData, partFile) { }
+
+    void update(const Branches &br, uint32_t brNo) {
+        brVol[brNo] = 0;
+        stack.assign(1, brNo);
+        while(!stack.empty()) {
+            uint32_t b = stack.back();
+            stack.pop_back();
+            for(uint32_t a = br.firstArc(b);a != Branches::None;a = br.nextArc(a)) {
+                brVol[brNo] += vol[a];
+            }
+            for(uint32_t ch = br.firstChild(b);ch != Branches::None;ch = br.nextChild(ch)) {
+                stack.push_back(ch);
+            }
+        }
+        fn[brNo] = (fnVals[br.to[brNo]] - fnVals[br.from[brNo]]) * brVol[brNo];
+    }
+
+    void branchMerged(const Branches&, uint32_t, uint32_t, const std::vector<uint32_t>&) { }
+
+    std::vector<uint32_t> stack;
+};
+
+// A comb: a ridge rising along x with a tooth next to every other ridge vertex, whose persistence
+// grows along x. The teeth are removed from the left, and each one is merged into the branch
+// that holds all the teeth removed before it, so the subtree sums of SubtreeHyperVolume take
+// quadratic time. noTeeth = 500000 gives about 10^6 arcs
+void benchmarkHyperVolumeComb(int noTeeth = 500000, int maxSubtreeTeeth = 1 << 16) {
+    QString data = "../data/bench_comb";
+    std::vector<int> sizes;
+    for(int teeth = 1 << 12;teeth < noTeeth;teeth *= 2) {
+        sizes.push_back(teeth);
+    }
+    sizes.push_back(noTeeth);
+    for(int teeth: sizes) {
+        const int dimx = 2 * teeth + 2, dimy = 2, dimz = 1;
+        {
+            std::vector<float> volume(int64_t(dimx) * dimy * dimz);
+            for(int x = 0;x < dimx;x ++) {
+                volume[x] = x;
+                volume[dimx + x] = (x % 2 == 0) ? 1.25f * x + 2 : x - 0.5f;
+            }
+            std::ofstream of((data + ".raw").toStdString(), std::ios::binary);
+            of.write((char *)volume.data(), volume.size() * sizeof(float));
+        }
+        {
+            Grid3D<float> grid(dimx,dimy,dimz);
+            grid.loadGrid(data + ".raw");
+            computeMergeTree(&grid,TypeContourTree,data,true);
+        }
+        ContourTreeData ctdata;
+        ctdata.loadBinFile(data);
+
+        std::chrono::time_point<std::chrono::system_clock> start, end;
+        SimplifyCT sim;
+        sim.setInput(&ctdata);
+        HyperVolume simFn(ctdata,data + ".part.raw");
+        start = std::chrono::system_clock::now();
+        sim.simplify(&simFn);
+        end = std::chrono::system_clock::now();
+        int64_t incremental = std::chrono::duration_cast<std::chrono::milliseconds>(end-start).count();
+
+        if(teeth > maxSubtreeTeeth) {
+            qDebug() << ctdata.noArcs << "arcs, hyper volume simplification:" << incremental << "ms incremental, subtree sums skipped";
+            continue;
+        }
+        SimplifyCT subtreeSim;
+        subtreeSim.setInput(&ctdata);
+        SubtreeHyperVolume subtreeFn(ctdata,data + ".part.raw");
+        start = std::chrono::system_clock::now();
+        subtreeSim.simplify(&subtreeFn);
+        end = std::chrono::system_clock::now();
+        assert(subtreeSim.order == sim.order);
+        qDebug() << ctdata.noArcs << "arcs, hyper volume simplification:" << incremental << "ms incremental,"
+                 << std::chrono::duration_cast<std::chrono::milliseconds>(end-start).count() << "ms with subtree sums";
+    }
+}
+
+// Compares the indexed heap against re-evaluating stale branches when they are popped.
+// Needs a tree and a .part.raw, e.g. the output of benchmarkHyperVolume
+void benchmarkSimplifyQueue(QString data = "../data/bench_hv") {
+    ContourTreeData ctdata;
+    ctdata.loadBinFile(data);
+    for(int hv = 0;hv < 2;hv ++) {
+        for(int lazy = 1;lazy >= 0;lazy --) {
+            SimplifyCT sim;
+            sim.setInput(&ctdata);
+            sim.lazyQueue = (lazy == 1);
+            SimFunction *simFn;
+            if(hv) {
+                simFn = new HyperVolume(ctdata,data + ".part.raw");
+            } else {
+                simFn = new Persistence(ctdata);
+            }
+
+            std::chrono::time_point<std::chrono::system_clock> start, end;
+            start = std::chrono::system_clock::now();
+            sim.simplify(simFn);
+            end = std::chrono::system_clock::now();
+            qDebug() << (hv ? "hyper volume," : "persistence,") << (lazy ? "lazy:" : "indexed:")
+                     << std::chrono::duration_cast<std::chrono::milliseconds>(end-start).count() << "ms"
+                     << "pushes" << sim.queue.noPushes << "pops" << sim.queue.noPops
+                     << "updates" << sim.queue.noUpdates << "removals" << sim.queue.noRemovals;
+            delete simFn;
+        }
+    }
+}
+
+// Time to answer a slider change, against replaying the order for every query.
+// Needs a tree and a .part.raw, e.g. the output of benchmarkHyperVolume
+void benchmarkFeatureQueries(QString data = "../data/bench_hv") {
+    {
+        ContourTreeData ctdata;
+        ctdata.loadBinFile(data);
+        SimplifyCT sim;
+        sim.setInput(&ctdata);
+        HyperVolume simFn(ctdata,data + ".part.raw");
+        sim.simplify(&simFn);
+        sim.outputOrder(data);
+    }
+    TopologicalFeatures tf;
+    tf.loadData(data);
+
+    std::chrono::time_point<std::chrono::system_clock> start, end;
+    int topks[] = {1, 10, 100, 1000, 10000};
+    for(int topk: topks) {
+        start = std::chrono::system_clock::now();
+        SimplifyCT sim;
+        sim.setInput(&tf.ctdata);
+        sim.simplify(tf.order,topk,0,tf.wts);
+        end = std::chrono::system_clock::now();
+        int64_t replay = std::chrono::duration_cast<std::chrono::microseconds>(end-start).count();
+
+        start = std::chrono::system_clock::now();
+        std::vector<Feature> features = tf.getFeatures(topk,0,1);
+        end = std::chrono::system_clock::now();
+        int64_t query = std::chrono::duration_cast<std::chrono::microseconds>(end-start).count();
+
+        start = std::chrono::system_clock::now();
+        std::vector<Feature> secondary = tf.getFeatures(topk,0,0.f);
+        end = std::chrono::system_clock::now();
+        int64_t querySecondary = std::chrono::duration_cast<std::chrono::microseconds>(end-start).count();
+
+        qDebug() << tf.ctdata.noArcs << "arcs, top" << topk << "- replaying the order:" << replay << "us, getFeatures:" << query
+                 << "us, with all secondary features:" << querySecondary << "us (" << secondary.size() << "features)";
+    }
+}
+
+// appends the arcs of branch and of everything that was merged into it
+void collectFeature(const SimplifyCT &sim, uint32_t branch, std::vector<bool> &inFeature, Feature &f) {
+    std::deque<uint32_t> queue;
+    queue.push_back(branch);
+    while(queue.size() > 0) {
+        uint32_t b = queue.front();
+        queue.pop_front();
+        assert(b == branch || !inFeature[b]);
+        inFeature[b] = true;
+        sim.branches.appendArcs(b, f.arcs);
+        for(uint32_t bc = sim.branches.firstChild(b);bc != Branches::None;bc = sim.branches.nextChild(bc)) {
+            queue.push_back(bc);
+        }
+    }
+}
+
+// what getFeatures did before the hierarchy: replay the order and walk the branches
+std::vector<Feature> replayFeatures(const TopologicalFeatures &tf, int topk, float th, float secondary) {
+    SimplifyCT sim;
+    sim.setInput(&tf.ctdata);
+    sim.simplify(tf.order,topk,th,tf.wts);
+
+    std::vector<Feature> features;
+    std::vector<bool> inFeature(sim.branches.size(), false);
+    size_t i = tf.order.size();
+    for(;i > 0 && !sim.removed[tf.order[i - 1]];i --) {
+        inFeature[tf.order[i - 1]] = true;
+    }
+    for(size_t j = tf.order.size();j > i;j --) {
+        uint32_t b = tf.order[j - 1];
+        Feature f;
+        f.from = f.to = tf.ctdata.nodeVerts[sim.branches.from[b]];
+        collectFeature(sim, b, inFeature, f);
+        features.push_back(f);
+    }
+    for(;i > 0;i --) {
+        uint32_t b = tf.order[i - 1];
+        if(inFeature[b]) {
+            continue;
+        }
+        inFeature[b] = true;
+        uint32_t from = sim.branches.from[b];
+        uint32_t to = sim.branches.to[b];
+        float per = tf.ctdata.fnVals[to] - tf.ctdata.fnVals[from];
+        if(tf.ctdata.type[to] == MAXIMUM && per >= secondary) {
+            Feature f;
+            f.from = f.to = tf.ctdata.nodeVerts[from];
+            collectFeature(sim, b, inFeature, f);
+            features.push_back(f);
+        }
+    }
+    return features;
+}
+
+// labels every arc with its feature id, -1 for none
+std::vector<uint32_t> featureLabels(const std::vector<Feature> &features, uint32_t noArcs) {
+    std::vector<uint32_t> labels(noArcs, -1);
+    for(size_t i = 0;i < features.size();i ++) {
+        for(uint32_t a: features[i].arcs) {
+            labels[a] = i;
+        }
+    }
+    return labels;
+}
+
+// The features from the simplification hierarchy have to be the ones of the replay, in the same
+// order, both with the hierarchy stored in the .ctree file and with the one built at load time
+void testHierarchyFeatures() {
+    const int dimx = 45, dimy = 38, dimz = 29;
+    QString data = generatePartition(dimx, dimy, dimz);
+    {
+        ContourTreeData ctdata;
+        ctdata.loadBinFile(data);
+        SimplifyCT sim;
+        sim.setInput(&ctdata);
+        HyperVolume simFn(ctdata,data + ".part.raw");
+        sim.simplify(&simFn);
+        sim.outputOrder(data);
+    }
+
+    for(int stored = 1;stored >= 0;stored --) {
+        if(!stored) {
+            QFile::remove(data + ".ctree");
+        }
+        TopologicalFeatures tf;
+        tf.loadData(data);
+
+        std::vector<FeatureQuery> queries;
+        int topks[] = {1, 2, 5, 20, 100, int(tf.order.size())};
+        float ths[] = {0.0001f, 0.001f, 0.01f, 0.1f, 0.5f};
+        float secondaries[] = {1, 0.2f, 0.05f, 0};
+        for(float secondary: secondaries) {
+            for(int topk: topks) {
+                queries.push_back(FeatureQuery(topk, 0, secondary));
+            }
+            for(float th: ths) {
+                queries.push_back(FeatureQuery(-1, th, secondary));
+            }
+        }
+
+        for(const FeatureQuery &q: queries) {
+            std::vector<Feature> features = tf.getFeatures(q);
+            std::vector<Feature> expected = replayFeatures(tf, q.topk, q.th, q.secondary);
+            assert(features.size() == expected.size());
+            for(size_t i = 0;i < features.size();i ++) {
+                assert(features[i].from == expected[i].from && features[i].to == expected[i].to);
+                std::sort(features[i].arcs.begin(), features[i].arcs.end());
+                std::sort(expected[i].arcs.begin(), expected[i].arcs.end());
+                assert(features[i].arcs == expected[i].arcs);
+            }
+            assert(featureLabels(features, tf.ctdata.noArcs) == featureLabels(expected, tf.ctdata.noArcs));
+        }
+        qDebug() << tf.ctdata.noArcs << "arcs," << queries.size() << "queries:" << (stored ? "stored" : "rebuilt")
+                 << "hierarchy gives the features of the replay";
+    }
+}
+
+// A .ctree file with arcs, order or hierarchy entries out of range has to give the same tree
+// and features as the intact one, by loading the .rg.bin files or rebuilding the hierarchy
+void testDamagedTreeFile() {
+    const int dimx = 45, dimy = 38, dimz = 29;
+    QString data = generatePartition(dimx, dimy, dimz);
+    {
+        ContourTreeData ctdata;
+        ctdata.loadBinFile(data);
+        SimplifyCT sim;
+        sim.setInput(&ctdata);
+        HyperVolume simFn(ctdata,data + ".part.raw");
+        sim.simplify(&simFn);
+        sim.outputOrder(data);
+    }
+    std::vector<char> intact = readFile(data + ".ctree");
+    FeatureQuery query(20, 0, 1);
+    ContourTreeData expectedData;
+    expectedData.loadBinFile(data);
+    std::vector<uint32_t> expectedOrder, expectedLabels;
+    {
+        // the file is rewritten below, so nothing may stay mapped from it
+        TopologicalFeatures tf;
+        tf.loadData(data);
+        expectedOrder = tf.order;
+        expectedLabels = featureLabels(tf.getFeatures(query), tf.ctdata.noArcs);
+    }
+
+    // every damage has to be noticed by the checks when the file is loaded, so that the tree
+    // and the hierarchy are rebuilt instead of giving wrong features
+    enum Damage { ArcNode, OrderArc, RangePastEnd, RangeOutsideParent, ChildOfOtherBranch, ChildrenUnsorted, LayoutSwapped };
+    const char *damageNames[] = {"arc node", "order arc", "range past the end", "range outside the parent",
+                                 "child of another branch", "unsorted children", "swapped layout"};
+    for(int damage = ArcNode;damage <= LayoutSwapped;damage ++) {
+        std::vector<char> bytes = intact;
+        FileHeader header;
+        memcpy(&header, &bytes[0], sizeof(FileHeader));
+        const SectionEntry *entries = (const SectionEntry *)(&bytes[0] + sizeof(FileHeader));
+        Arc *arcs = NULL;
+        uint32_t *order = NULL, *lay = NULL;
+        HierarchyBranch *brs = NULL;
+        HierarchyChild *chs = NULL;
+        for(uint32_t i = 0;i < header.noSections;i ++) {
+            char *sec = &bytes[0] + entries[i].offset;
+            switch(entries[i].id) {
+            case SectionArcs: arcs = (Arc *)sec; break;
+            case SectionOrder: order = (uint32_t *)sec; break;
+            case SectionHierarchy: brs = (HierarchyBranch *)sec; break;
+            case SectionHierarchyChildren: chs = (HierarchyChild *)sec; break;
+            case SectionHierarchyLayout: lay = (uint32_t *)sec; break;
+            default: break;
+            }
+        }
+        assert(arcs != NULL && order != NULL && brs != NULL && chs != NULL && lay != NULL);
+        const uint32_t noBranches = header.noArcs;
+        uint32_t b = 0;
+        switch(damage) {
+        case ArcNode:
+            arcs[0].from = header.noNodes;
+            break;
+        case OrderArc:
+            order[0] = header.noArcs;
+            break;
+        case RangePastEnd:
+            brs[0].end = header.noArcs + 1;
+            break;
+        case RangeOutsideParent:
+            while(b < noBranches && brs[b].parent == uint32_t(-1)) {
+                b ++;
+            }
+            assert(b < noBranches);
+            brs[b].start = 0;
+            brs[b].end = 1;
+            break;
+        case ChildOfOtherBranch:
+            while(b < noBranches && brs[b].firstChild == brs[b].endChild) {
+                b ++;
+            }
+            assert(b < noBranches);
+            // a branch that never joins, so it has no parent at all
+            for(uint32_t root = 0;root < noBranches;root ++) {
+                if(brs[root].parent == uint32_t(-1)) {
+                    chs[brs[b].firstChild].branch = root;
+                    break;
+                }
+            }
+            break;
+        case ChildrenUnsorted:
+            while(b < noBranches && brs[b].endChild - brs[b].firstChild < 2) {
+                b ++;
+            }
+            assert(b < noBranches);
+            std::swap(chs[brs[b].firstChild], chs[brs[b].firstChild + 1]);
+            break;
+        case LayoutSwapped:
+            std::swap(lay[0], lay[1]);
+            break;
+        }
+        {
+            std::ofstream of((data + ".ctree").toStdString(), std::ios::binary);
+            of.write(bytes.data(), bytes.size());
+        }
+
+        TopologicalFeatures tf;
+        tf.loadData(data);
+        assert(tf.ctdata.noArcs == expectedData.noArcs && tf.order == expectedOrder);
+        for(uint32_t i = 0;i < tf.ctdata.noArcs;i ++) {
+            assert(tf.ctdata.arcs[i].from == expectedData.arcs[i].from && tf.ctdata.arcs[i].to == expectedData.arcs[i].to);
+        }
+        assert(featureLabels(tf.getFeatures(query), tf.ctdata.noArcs) == expectedLabels);
+        qDebug() << "damaged" << damageNames[damage] << ": same tree and features as the intact file";
+    }
+    std::ofstream of((data + ".ctree").toStdString(), std::ios::binary);
+    of.write(intact.data(), intact.size());
+}
+
+// Applies the delta of every step from top 1 to top 200 and compares the labels with those of a
+// replay of the order, against relabeling all arcs from the features of the replay
+void benchmarkFeatureDelta(QString data = "../data/bench_hv") {
+    TopologicalFeatures tf;
+    tf.loadData(data);
+
+    std::chrono::time_point<std::chrono::system_clock> start, end;
+    float secondaries[] = {1, 0.5f, 0};
+    for(float secondary: secondaries) {
+        FeatureQuery prev(1, 0, secondary);
+        std::vector<uint32_t> labels = featureLabels(tf.getFeatures(prev), tf.ctdata.noArcs);
+        int64_t full = 0, incremental = 0;
+        size_t noChanged = 0;
+        int steps = 0;
+        for(int topk = 2;topk <= 200;topk ++, steps ++) {
+            FeatureQuery q(topk, 0, secondary);
+            start = std::chrono::system_clock::now();
+            std::vector<uint32_t> expected = featureLabels(replayFeatures(tf, q.topk, q.th, q.secondary), tf.ctdata.noArcs);
+            end = std::chrono::system_clock::now();
+            full += std::chrono::duration_cast<std::chrono::microseconds>(end-start).count();
+
+            // what LoadContourTree does: apply the delta, and get the arcs of the features from the cache
+            start = std::chrono::system_clock::now();
+            FeatureDelta delta = tf.getFeatureDelta(prev, q);
+            for(size_t i = 0;i < delta.arcs.size();i ++) {
+                labels[delta.arcs[i]] = delta.features[i];
+            }
+            std::vector<Feature> features = tf.getFeatures(q);
+            end = std::chrono::system_clock::now();
+            incremental += std::chrono::duration_cast<std::chrono::microseconds>(end-start).count();
+            noChanged += delta.arcs.size();
+
+            assert(delta.noFeatures == features.size());
+            assert(labels == expected);
+            if(labels != expected) {
+                qDebug() << "delta from top" << prev.topk << "to top" << topk << "does not match";
+                return;
+            }
+            prev = q;
+        }
+        qDebug() << tf.ctdata.noArcs << "arcs, secondary" << secondary << "- top 2 .. 200, replaying and relabeling everything:" << full / steps
+                 << "us, applying the delta:" << incremental / steps << "us per step," << noChanged / steps << "arcs changed per step";
+    }
+}
+
+// a few random balls in a dim^3 volume, x running fastest
+std::vector<uint8_t> ballMask(int dim, int noBalls) {
+    std::vector<uint8_t> mask(size_t(dim) * dim * dim, 0);
+    srand(7);
+    for(int b = 0;b < noBalls;b ++) {
+        int cx = rand() % dim, cy = rand() % dim, cz = rand() % dim;
+        int r = 1 + rand() % std::max(1, dim / 16);
+        for(int z = std::max(0, cz - r);z <= std::min(dim - 1, cz + r);z ++) {
+            for(int y = std::max(0, cy - r);y <= std::min(dim - 1, cy + r);y ++) {
+                for(int x = std::max(0, cx - r);x <= std::min(dim - 1, cx + r);x ++) {
+                    if((x - cx) * (x - cx) + (y - cy) * (y - cy) + (z - cz) * (z - cz) <= r * r) {
+                        mask[(size_t(z) * dim + y) * dim + x] = 1;
+                    }
+                }
+            }
+        }
+    }
+    return mask;
+}
+
+// what VolumeExportGenerator used to do: test every offset of the cube, clamped to the volume
+std::vector<uint8_t> featherByOffsets(const std::vector<uint8_t> &mask, int dim, int distance) {
+    std::vector<uint8_t> ret(mask.size(), 0);
+    for(int z = 0;z < dim;z ++) {
+        for(int y = 0;y < dim;y ++) {
+            for(int x = 0;x < dim;x ++) {
+                bool set = false;
+                for(int oz = -distance;oz <= distance && !set;oz ++) {
+                    for(int oy = -distance;oy <= distance && !set;oy ++) {
+                        for(int ox = -distance;ox <= distance && !set;ox ++) {
+                            int px = std::min(std::max(x + ox, 0), dim - 1);
+                            int py = std::min(std::max(y + oy, 0), dim - 1);
+                            int pz = std::min(std::max(z + oz, 0), dim - 1);
+                            set = mask[(size_t(pz) * dim + py) * dim + px] != 0;
+                        }
+                    }
+                }
+                ret[(size_t(z) * dim + y) * dim + x] = set;
+            }
+        }
+    }
+    return ret;
+}
+
+void benchmarkFeathering() {
+    std::chrono::time_point<std::chrono::system_clock> start, end;
+    int distances[] = {0, 2, 8, 32};
+
+    // the cube offsets are only feasible on small volumes
+    int smallDim = 48;
+    std::vector<uint8_t> small = ballMask(smallDim, 20);
+    for(int d: distances) {
+        std::vector<uint8_t> separable = small;
+        start = std::chrono::system_clock::now();
+        featherMask(separable, smallDim, smallDim, smallDim, d);
+        end = std::chrono::system_clock::now();
+        int64_t separableTime = std::chrono::duration_cast<std::chrono::microseconds>(end-start).count();
+
+        start = std::chrono::system_clock::now();
+        std::vector<uint8_t> offsets = featherByOffsets(small, smallDim, d);
+        end = std::chrono::system_clock::now();
+        int64_t offsetsTime = std::chrono::duration_cast<std::chrono::microseconds>(end-start).count();
+
+        assert(separable == offsets);
+        qDebug() << smallDim << "^3, feathering" << d << "- separable dilation:" << separableTime << "us, cube offsets:" << offsetsTime
+                 << "us" << (separable == offsets ? "" : "MISMATCH");
+    }
+
+    int dim = 256;
+    std::vector<uint8_t> mask = ballMask(dim, 200);
+    for(int d: distances) {
+        std::vector<uint8_t> separable = mask;
+        start = std::chrono::system_clock::now();
+        featherMask(separable, dim, dim, dim, d);
+        end = std::chrono::system_clock::now();
+        qDebug() << dim << "^3, feathering" << d << "- separable dilation:"
+                 << std::chrono::duration_cast<std::chrono::milliseconds>(end-start).count() << "ms";
+    }
+}
+
 int oldMain(int argc, char *argv[])
 {
     QCoreApplication a(argc, argv);
 //    testGrid();
+//    benchmarkDisjointSets();
 //    testSimplification3();
 //    testPriorityQueue();
 //    testMergeTree();
@@ -553,6 +1580,23 @@ int oldMain(int argc, char *argv[])
 //    testApi();
 //    testFeatures();
 //    testConnectivity();
+//    benchmarkParallelMergeTree();
+//    benchmarkIndexWidth();
+//    testStreamingMergeTree();
+//    benchmarkProcessVertex();
+//    testSweepAllocations();
+//    testPartitionFile();
+//    testHyperVolumeBricks();
+//    benchmarkTreeLoading();
+//    benchmarkLoadData();
+//    benchmarkHyperVolume();
+//    benchmarkHyperVolumeComb();
+//    benchmarkSimplifyQueue();
+//    benchmarkFeatureQueries();
+//    testHierarchyFeatures();
+//    testDamagedTreeFile();
+//    benchmarkFeatureDelta();
+//    benchmarkFeathering();
     generateData();
     toyProcessing();
     toyFeatures();
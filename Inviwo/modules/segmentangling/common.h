@@ -7,6 +7,8 @@
 
 #include <Eigen/Core>
 
+#include <memory>
+
 namespace inviwo {
 
 struct ContourInformation {
@@ -20,7 +22,24 @@ using ContourOutport = DataOutport<ContourInformation>;
 
 
 using Feature = std::vector<uint32_t>;
-using FeatureInformation = std::vector<Feature>;
+struct FeatureInformation {
+    // The arcs of every feature
+    std::vector<Feature> features;
+    // The inverse, shared with the contour buffer of LoadContourTree until the next selection,
+    // which copies it first if it is still held: [0] is the number of features, [arc + 1] the
+    // feature of arc
+    std::shared_ptr<const std::vector<uint32_t>> arcFeatures;
+    size_t nArcs = 0;
+
+    // The feature of arc, or -1 if the arc is not part of one
+    uint32_t featureOf(uint32_t arc) const {
+        if (arc >= nArcs) {
+            return uint32_t(-1);
+        }
+        const uint32_t feature = (*arcFeatures)[arc + 1];
+        return feature < features.size() ? feature : uint32_t(-1);
+    }
+};
 using FeatureInport = DataInport<FeatureInformation>;
 using FeatureOutport = DataOutport<FeatureInformation>;
 
@@ -0,0 +1,72 @@
+#include "partitionvolumereader.h"
+
+#include <inviwo/core/datastructures/volume/volumedisk.h>
+#include <inviwo/core/datastructures/volume/volumeramprecision.h>
+#include <glm/gtx/component_wise.hpp>
+
+#include "../../ContourTree/PartitionFile.hpp"
+
+namespace inviwo {
+
+PartitionVolumeReader::PartitionVolumeReader() : DataReaderType<Volume>() {
+    addExtension(FileExtension("brk", "Compressed segmentation"));
+}
+
+PartitionVolumeReader* PartitionVolumeReader::clone() const {
+    return new PartitionVolumeReader(*this);
+}
+
+std::shared_ptr<Volume> PartitionVolumeReader::readData(const std::string& filePath) {
+    contourtree::PartitionFile part;
+    if (!part.open(QString::fromStdString(filePath))) {
+        throw DataReaderException("Could not open segmentation file: " + filePath, IvwContext);
+    }
+    const size3_t dimensions(part.header.dimx, part.header.dimy, part.header.dimz);
+
+    auto volume = std::make_shared<Volume>(dimensions, DataUInt32::get());
+    // Same basis as the .part.dat files written for uncompressed segmentations
+    const float minSize = static_cast<float>(glm::compMin(dimensions));
+    volume->setBasis(glm::mat3(
+        dimensions.x / minSize, 0.f, 0.f,
+        0.f, dimensions.y / minSize, 0.f,
+        0.f, 0.f, dimensions.z / minSize
+    ));
+    volume->setOffset(-0.5f * (volume->getBasis()[0] + volume->getBasis()[1] + volume->getBasis()[2]));
+
+    auto vd = std::make_shared<VolumeDisk>(filePath, dimensions, DataUInt32::get());
+    vd->setLoader(new PartitionRAMLoader(filePath));
+    volume->addRepresentation(vd);
+    return volume;
+}
+
+PartitionRAMLoader::PartitionRAMLoader(const std::string& filePath) : _filePath(filePath) {}
+
+PartitionRAMLoader* PartitionRAMLoader::clone() const {
+    return new PartitionRAMLoader(*this);
+}
+
+std::shared_ptr<VolumeRepresentation> PartitionRAMLoader::createRepresentation() const {
+    contourtree::PartitionFile part;
+    if (!part.open(QString::fromStdString(_filePath))) {
+        throw DataReaderException("Could not open segmentation file: " + _filePath, IvwContext);
+    }
+    const size3_t dimensions(part.header.dimx, part.header.dimy, part.header.dimz);
+    auto volumeRAM = std::make_shared<VolumeRAMPrecision<glm::u32>>(dimensions);
+    if (!part.readSlices(0, part.header.dimz, volumeRAM->getDataTyped())) {
+        throw DataReaderException("Damaged segmentation file: " + _filePath, IvwContext);
+    }
+    return volumeRAM;
+}
+
+void PartitionRAMLoader::updateRepresentation(std::shared_ptr<VolumeRepresentation> dest) const {
+    contourtree::PartitionFile part;
+    if (!part.open(QString::fromStdString(_filePath))) {
+        throw DataReaderException("Could not open segmentation file: " + _filePath, IvwContext);
+    }
+    auto volumeRAM = std::static_pointer_cast<VolumeRAMPrecision<glm::u32>>(dest);
+    if (!part.readSlices(0, part.header.dimz, volumeRAM->getDataTyped())) {
+        throw DataReaderException("Damaged segmentation file: " + _filePath, IvwContext);
+    }
+}
+
+} // namespace
@@ -0,0 +1,42 @@
+#ifndef __AB_PARTITIONVOLUMEREADER_H__
+#define __AB_PARTITIONVOLUMEREADER_H__
+
+#include <modules/segmentangling/segmentanglingmoduledefine.h>
+#include <inviwo/core/common/inviwo.h>
+#include <inviwo/core/io/datareader.h>
+#include <inviwo/core/datastructures/diskrepresentation.h>
+#include <inviwo/core/datastructures/volume/volume.h>
+#include <inviwo/core/datastructures/volume/volumerepresentation.h>
+
+namespace inviwo {
+
+// Reads the compressed segmentation (.part.brk) written by the DataPreprocessor
+class IVW_MODULE_SEGMENTANGLING_API PartitionVolumeReader : public DataReaderType<Volume> {
+public:
+    PartitionVolumeReader();
+    PartitionVolumeReader(const PartitionVolumeReader& rhs) = default;
+    PartitionVolumeReader& operator=(const PartitionVolumeReader& that) = default;
+    virtual PartitionVolumeReader* clone() const override;
+    virtual ~PartitionVolumeReader() = default;
+
+    virtual std::shared_ptr<Volume> readData(const std::string& filePath) override;
+};
+
+// Decodes the bricks into a VolumeRAM only once a representation is requested
+class IVW_MODULE_SEGMENTANGLING_API PartitionRAMLoader
+    : public DiskRepresentationLoader<VolumeRepresentation> {
+public:
+    PartitionRAMLoader(const std::string& filePath);
+    virtual PartitionRAMLoader* clone() const override;
+    virtual ~PartitionRAMLoader() = default;
+
+    virtual std::shared_ptr<VolumeRepresentation> createRepresentation() const override;
+    virtual void updateRepresentation(std::shared_ptr<VolumeRepresentation> dest) const override;
+
+private:
+    std::string _filePath;
+};
+
+} // namespace
+
+#endif // __AB_PARTITIONVOLUMEREADER_H__
@@ -19,19 +19,42 @@
 #include "../../ContourTree/TopologicalFeatures.hpp"
 
 #include <algorithm>
+#include <cstdio>
 
 #include "../../ContourTree/DisjointSets.hpp"
 #include "../../ContourTree/Grid3D.hpp"
 #include "../../ContourTree/MergeTree.hpp"
+#include "../../ContourTree/StreamingMergeTree.hpp"
 #include "../../ContourTree/ContourTreeData.hpp"
 #include "../../ContourTree/SimplifyCT.hpp"
 #include "../../ContourTree/Persistence.hpp"
 #include "../../ContourTree/TriMesh.hpp"
 #include "../../ContourTree/TopologicalFeatures.hpp"
 #include "../../ContourTree/HyperVolume.hpp"
+#include "../../ContourTree/PartitionFile.hpp"
 
 namespace inviwo {
 
+namespace {
+
+// The topology is computed on the native precision of the volume
+template <typename T>
+void computeGridTree(const glm::size3_t& size, const std::string& baseFile,
+                     contourtree::TreeType tree) {
+    contourtree::Grid3D<T> grid(
+        static_cast<int>(size.x),
+        static_cast<int>(size.y),
+        static_cast<int>(size.z)
+    );
+    // The mapped file shares the page cache with the volume already loaded by Inviwo
+    if (!grid.mapGrid(QString::fromStdString(baseFile + ".raw"))) {
+        grid.loadGrid(QString::fromStdString(baseFile + ".raw"));
+    }
+    contourtree::computeMergeTree(&grid, tree, QString::fromStdString(baseFile), true);
+}
+
+}  // namespace
+
 const ProcessorInfo DataPreprocessor::processorInfo_{
     "bock.datainput",  // Class identifier
     "Data Preprocessor",            // Display name
@@ -47,6 +70,9 @@ DataPreprocessor::DataPreprocessor()
     , _subsampledVolumeFile("_subsampledVolumeFile", "Subsampled Volume File")
     , _fullVolumeFile("_fullVolumeFile", "Full Volume File")
     , _contourTreeFile("contourTreeFile", "Contour Tree File")
+    , _outOfCore("_outOfCore", "Out-of-core Tree Computation", false)
+    , _slabDepth("_slabDepth", "Slab Depth", 64, 1, 4096)
+    , _compressSegmentation("_compressSegmentation", "Compress Segmentation", true)
     , _loadButton("_loadButton", "Load")
 {
     addProperty(_baseVolume);
@@ -61,6 +87,10 @@ DataPreprocessor::DataPreprocessor()
     _contourTreeFile.setReadOnly(true);
     addProperty(_contourTreeFile);
 
+    addProperty(_outOfCore);
+    addProperty(_slabDepth);
+    addProperty(_compressSegmentation);
+
     _loadButton.onChange([&]() { _volumeIsDirty = true; });
     addProperty(_loadButton);
 }
@@ -141,12 +171,38 @@ void DataPreprocessor::process() {
         filesystem::getFileNameWithoutExtension(subSampleVolumeFile);
 
     const glm::size3_t subSampledSize = scaledVolume->getDimensions();
-    contourtree::Grid3D grid(subSampledSize.x, subSampledSize.y, subSampledSize.z);
-    grid.loadGrid(QString::fromStdString(baseFile + ".raw"));
-    contourtree::MergeTree ct;
+    const DataFormatId formatId = scaledVolume->getDataFormat()->getId();
     contourtree::TreeType tree = contourtree::TypeJoinTree;
-    ct.computeTree(&grid, tree);
-    ct.output(QString::fromStdString(baseFile), tree);
+    if (formatId != DataFormatId::UInt8 && formatId != DataFormatId::UInt16 && formatId != DataFormatId::Float32) {
+        // Grid3D only has function values of these types, anything else would be read as bytes
+        LogError("Unsupported volume format " << scaledVolume->getDataFormat()->getString()
+            << ", only UINT8, UINT16 and FLOAT32 volumes can be preprocessed");
+        _volumeIsDirty = false;
+        return;
+    }
+    if (_outOfCore && formatId != DataFormatId::UInt8) {
+        LogWarn("Out-of-core tree computation only supports 8-bit volumes, computing in-core");
+    }
+    if (_outOfCore && formatId == DataFormatId::UInt8) {
+        // Only a few slabs of the volume are held in memory at any time
+        contourtree::StreamingMergeTree ct(
+            static_cast<int>(subSampledSize.x),
+            static_cast<int>(subSampledSize.y),
+            static_cast<int>(subSampledSize.z),
+            _slabDepth
+        );
+        ct.computeTree(QString::fromStdString(baseFile + ".raw"), tree);
+        ct.output(QString::fromStdString(baseFile), tree);
+    }
+    else if (formatId == DataFormatId::UInt16) {
+        computeGridTree<uint16_t>(subSampledSize, baseFile, tree);
+    }
+    else if (formatId == DataFormatId::Float32) {
+        computeGridTree<float>(subSampledSize, baseFile, tree);
+    }
+    else {
+        computeGridTree<unsigned char>(subSampledSize, baseFile, tree);
+    }
 
 
     contourtree::ContourTreeData ctdata;
@@ -166,17 +222,30 @@ void DataPreprocessor::process() {
     sim.outputOrder(QString::fromStdString(baseFile));
 
     // Step 6
-    // Write the missing dat file for the part volume
-    std::ofstream file(baseFile + ".part.dat");
-    file << "Rawfile: " << filesystem::getFileNameWithoutExtension(subSampleVolumeFile) + ".part.raw" << '\n';
-    file << "Resolution: " << subSampledSize.x << " " << subSampledSize.y << " " << subSampledSize.z << '\n';
-    file << "Format: UINT32\n";
-
-    const glm::size_t minSize = glm::compMin(subSampledSize);
-    file << "BasisVector1: " << float(subSampledSize.x) / float(minSize) << " 0.0 0.0\n";
-    file << "BasisVector2: " << "0.0 " << float(subSampledSize.y) / float(minSize) << " 0.0\n";
-    file << "BasisVector3: " << "0.0 0.0 " << float(subSampledSize.z) / float(minSize) << "\n";
-    file << '\n';
+    // Replace the segmentation by its compressed form, which is read by PartitionVolumeReader,
+    // or write the missing dat file for the part volume
+    const bool compressed = _compressSegmentation && contourtree::PartitionWriter::compress(
+        QString::fromStdString(baseFile + ".part.raw"),
+        QString::fromStdString(baseFile + ".part.brk"),
+        static_cast<int>(subSampledSize.x),
+        static_cast<int>(subSampledSize.y),
+        static_cast<int>(subSampledSize.z)
+    );
+    if (compressed) {
+        std::remove((baseFile + ".part.raw").c_str());
+    }
+    else {
+        std::ofstream file(baseFile + ".part.dat");
+        file << "Rawfile: " << filesystem::getFileNameWithoutExtension(subSampleVolumeFile) + ".part.raw" << '\n';
+        file << "Resolution: " << subSampledSize.x << " " << subSampledSize.y << " " << subSampledSize.z << '\n';
+        file << "Format: UINT32\n";
+
+        const glm::size_t minSize = glm::compMin(subSampledSize);
+        file << "BasisVector1: " << float(subSampledSize.x) / float(minSize) << " 0.0 0.0\n";
+        file << "BasisVector2: " << "0.0 " << float(subSampledSize.y) / float(minSize) << " 0.0\n";
+        file << "BasisVector3: " << "0.0 0.0 " << float(subSampledSize.z) / float(minSize) << "\n";
+        file << '\n';
+    }
     //}
     
     _fullVolumeFile = baseVolumeFile;
@@ -189,7 +258,7 @@ void DataPreprocessor::process() {
 
     _partVolumeFile =
         filesystem::getFileDirectory(baseVolumeFile) + '/' +
-        filesystem::getFileNameWithoutExtension(subSampleVolumeFile) + ".part.dat";
+        filesystem::getFileNameWithoutExtension(subSampleVolumeFile) + (compressed ? ".part.brk" : ".part.dat");
 
     _contourTreeFile = 
         filesystem::getFileDirectory(baseVolumeFile) + '/' + 
@@ -6,6 +6,8 @@
 #include <inviwo/core/processors/processor.h>
 #include <inviwo/core/properties/stringproperty.h>
 #include <inviwo/core/properties/buttonproperty.h>
+#include <inviwo/core/properties/boolproperty.h>
+#include <inviwo/core/properties/ordinalproperty.h>
 #include <modules/segmentangling/common.h>
 
 namespace inviwo {
@@ -28,6 +30,10 @@ protected:
     FileProperty _partVolumeFile;
     StringProperty _contourTreeFile;
 
+    BoolProperty _outOfCore;
+    IntProperty _slabDepth;
+    BoolProperty _compressSegmentation;
+
     ButtonProperty _loadButton;
 
     bool _volumeIsDirty;
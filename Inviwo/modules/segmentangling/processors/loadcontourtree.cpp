@@ -14,6 +14,8 @@
 #include <inviwo/core/common/inviwoapplication.h>
 #include <inviwo/core/util/rendercontext.h>
 
+#include <modules/segmentangling/util/dirtyblocks.h>
+
 #include "../../ContourTree/TopologicalFeatures.hpp"
 
 #include <algorithm>
@@ -21,6 +23,9 @@
 namespace {
     const int ModeFeatures = 0;
     const int ModeThreshold = 1;
+
+    // Deltas that change more than this fraction of the arcs are uploaded as a whole
+    const size_t FullUploadFraction = 4;
 } // namespace
 
 namespace inviwo {
@@ -42,6 +47,9 @@ LoadContourTree::LoadContourTree()
     , _nFeatures("nFeatures", "Number of Features", 0, 0, 10000)
     , _quasiSimplificationFactor("_quasiSimplificationFactor", "Quasi Simplification Factor", 0.f, 0.f, 1.f)
     , _contourTreeFile("contourTreeFile", "Contour Tree File")
+    , _ssbo(0)
+    , _bufferData(std::make_shared<std::vector<uint32_t>>())
+    , _bufferIsValid(false)
     , _fileIsDirty(false)
     , _dataIsDirty(false)
 {
@@ -80,7 +88,8 @@ void LoadContourTree::process() {
         std::string file = _contourTreeFile;
         try {
             _topologicalFeatures = contourtree::TopologicalFeatures();
-            _topologicalFeatures.loadData(QString::fromStdString(file), true);
+            _topologicalFeatures.loadData(QString::fromStdString(file));
+            _bufferIsValid = false;
             _dataIsDirty = true;
             _fileIsDirty = false;
         }
@@ -91,53 +100,97 @@ void LoadContourTree::process() {
 
 
     if (_dataIsDirty) {
-        ContourInformation* info = new ContourInformation;
-        glGenBuffers(1, &info->ssbo);
-        LogInfo("Created buffer " << info->ssbo);
-
-        std::vector<contourtree::Feature> features = [m = _mode.get(), this]() {
+        const contourtree::FeatureQuery query = [m = _mode.get(), this]() {
             switch (m) {
                 case ModeFeatures:
-                    return _topologicalFeatures.getFeatures(_nFeatures, 0.f, _quasiSimplificationFactor);
+                    return contourtree::FeatureQuery(_nFeatures, 0.f, _quasiSimplificationFactor);
                 case ModeThreshold:
-                    return _topologicalFeatures.getFeatures(-1, _contourTreeLevel);
+                    return contourtree::FeatureQuery(-1, _contourTreeLevel);
                 default:
                     assert(false);
-                    return std::vector<contourtree::Feature>();
+                    return contourtree::FeatureQuery();
             }
         }();
-        LogInfo("Number of features: " << features.size());
-        info->nFeatures = static_cast<uint32_t>(features.size());
 
         uint32_t size = _topologicalFeatures.ctdata.noArcs;
 
         // Buffer contents:
         // [0]: number of features
         // [...]: A linearized map from voxel identifier -> feature number
-        std::vector<uint32_t> bufferData(size + 1 + 1, static_cast<uint32_t>(-1));
-        bufferData[0] = static_cast<uint32_t>(features.size());
-        for (size_t i = 0; i < features.size(); ++i) {
-            for (uint32_t j : features[i].arcs) {
-                bufferData[j + 1] = static_cast<uint32_t>(i);
+        if (_ssbo == 0) {
+            glGenBuffers(1, &_ssbo);
+            LogInfo("Created buffer " << _ssbo);
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _ssbo);
+
+        contourtree::FeatureDelta delta;
+        if (_bufferIsValid) {
+            delta = _topologicalFeatures.getFeatureDelta(_bufferQuery, query);
+            if (delta.arcs.size() > size / FullUploadFraction) {
+                _bufferIsValid = false;
+            }
+        }
+
+        // The features of query are cached by getFeatureDelta, so this only copies their arcs
+        std::vector<contourtree::Feature> features = _topologicalFeatures.getFeatures(query);
+        LogInfo("Number of features: " << features.size());
+
+        // Earlier FeatureInformation may still hold the buffer data, and has to keep the
+        // mapping that matches its features. Only the in place update needs the old contents
+        if (_bufferData.use_count() > 1) {
+            _bufferData = _bufferIsValid ?
+                std::make_shared<std::vector<uint32_t>>(*_bufferData) :
+                std::make_shared<std::vector<uint32_t>>();
+        }
+        std::vector<uint32_t>& bufferData = *_bufferData;
+        if (_bufferIsValid) {
+            // Only upload the blocks of the buffer that contain a changed arc
+            DirtyBlocks dirty;
+            dirty.reset(bufferData.size());
+            bufferData[0] = static_cast<uint32_t>(features.size());
+            dirty.mark(0);
+            for (size_t i = 0; i < delta.arcs.size(); ++i) {
+                bufferData[delta.arcs[i] + 1] = delta.features[i];
+                dirty.mark(delta.arcs[i] + 1);
             }
+            const size_t nUploads = dirty.upload(GL_SHADER_STORAGE_BUFFER, bufferData);
+            LogInfo("Updated " << delta.arcs.size() << " arcs in " << nUploads << " ranges (" <<
+                delta.split.size() << " features split off, " << delta.merged.size() << " merged)");
         }
+        else {
+            bufferData.assign(size + 1 + 1, static_cast<uint32_t>(-1));
+            bufferData[0] = static_cast<uint32_t>(features.size());
+            for (size_t i = 0; i < features.size(); ++i) {
+                for (uint32_t j : features[i].arcs) {
+                    bufferData[j + 1] = static_cast<uint32_t>(i);
+                }
+            }
+
+            glBufferData(
+                GL_SHADER_STORAGE_BUFFER,
+                sizeof(uint32_t) * bufferData.size(),
+                bufferData.data(),
+                GL_DYNAMIC_COPY
+            );
+            _bufferIsValid = true;
+        }
+        _bufferQuery = query;
 
-        glBindBuffer(GL_SHADER_STORAGE_BUFFER, info->ssbo);
-        glBufferData(
-            GL_SHADER_STORAGE_BUFFER,
-            sizeof(uint32_t) * bufferData.size(),
-            bufferData.data(),
-            GL_DYNAMIC_COPY
-        );
+        ContourInformation* info = new ContourInformation;
+        info->ssbo = _ssbo;
+        info->nFeatures = static_cast<uint32_t>(features.size());
         _outportContour.setData(info);
 
 
         FeatureInformation* featureInfo = new FeatureInformation;
-        featureInfo->resize(features.size());
+        featureInfo->features.resize(features.size());
 
         for (size_t i = 0; i < features.size(); ++i) {
-            featureInfo->at(i) = std::move(features[i].arcs);
+            featureInfo->features[i] = std::move(features[i].arcs);
         }
+        // The buffer already maps every arc to its feature
+        featureInfo->arcFeatures = _bufferData;
+        featureInfo->nArcs = size;
 
         _outportFeature.setData(featureInfo);
 
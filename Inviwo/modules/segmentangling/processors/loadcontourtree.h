@@ -36,6 +36,14 @@ protected:
 
     contourtree::TopologicalFeatures _topologicalFeatures;
 
+    // The buffer is kept between changes of the selection, so that only the entries of the
+    // arcs whose feature changed have to be uploaded
+    GLuint _ssbo;
+    // Shared with the FeatureInformation of the outport instead of copied
+    std::shared_ptr<std::vector<uint32_t>> _bufferData;
+    contourtree::FeatureQuery _bufferQuery;
+    bool _bufferIsValid;
+
     bool _fileIsDirty;
     bool _dataIsDirty;
 };
@@ -17,13 +17,15 @@ namespace {
     std::pair<uint32_t, bool> findFeature(
         const glm::vec3& pos,
         const VolumeRAM* data,
-        const std::vector<Feature>& features,
+        const FeatureInformation& features,
         int lastChangedType,
         int lastChangedValue
         )
     {
         if (lastChangedType == LastChangedVolume) {
-            return { uint32_t(lastChangedValue), lastChangedValue != -1 };
+            const bool valid = lastChangedValue >= 0 &&
+                static_cast<size_t>(lastChangedValue) < features.features.size();
+            return { uint32_t(lastChangedValue), valid };
         }
         else {
             const glm::size3_t dim = data->getDimensions();
@@ -38,20 +40,8 @@ namespace {
             glm::u64 idx = VolumeRAM::posToIndex(ip, dim);
             uint32_t index = ptr[idx]; // arcs index
 
-            for (size_t i = 0; i < features.size(); ++i) {
-                const Feature& f = features[i];
-                auto it = std::find(
-                    f.begin(),
-                    f.end(),
-                    index
-                );
-
-                if (it != f.end()) {
-                    return { uint32_t(i), true };
-                }
-            }
-
-            return { uint32_t(-1), false };
+            const uint32_t feature = features.featureOf(index);
+            return { feature, feature != uint32_t(-1) };
         }
     }
 
@@ -159,7 +149,7 @@ VolumeCollectionGenerator::VolumeCollectionGenerator()
 
     auto updateFeature = [this](){
         if (_inportFeatureMapping.hasData() && _inport.hasData()) {
-            const std::vector<Feature>& m = *_inportFeatureMapping.getData();
+            const FeatureInformation& m = *_inportFeatureMapping.getData();
             std::pair<uint32_t, bool> featureFound = findFeature(
                 _lastChangedSlicePosition,
                 _inport.getData()->getRepresentation<VolumeRAM>(),
@@ -206,40 +196,42 @@ void VolumeCollectionGenerator::process() {
         glGenBuffers(1, &(_information->ssbo));
     }
 
-    if (_dirty.removeVolume) {
-        for (uint32_t& m : _mappingData) {
-            if (m == _currentVolume) {
-                m = uint32_t(-1);
-            }
-        }
-        _dirty.removeVolume = false;
-    }
-
-    if (_dirty.clearAllVolumes) {
-        for (uint32_t& m : _mappingData) {
-            m = uint32_t(-1);
-        }
-        _dirty.clearAllVolumes = false;
-    }
-
+    const FeatureInformation& m = *_inportFeatureMapping.getData();
 
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, _information->ssbo);
-    if (_mappingData.empty() || _inport.isChanged()) {
-        glm::size3_t dim = _inport.getData()->getDimensions();
-        _mappingData = std::vector<uint32_t>(dim.x * dim.y * dim.z + 1, uint32_t(-1));
+    const size_t size = m.nArcs + 1;
+    if (_mappingData.size() != size || _inport.isChanged()) {
+        _mappingData = std::vector<uint32_t>(size, uint32_t(-1));
+        _mappingData[0] = _nVolumes + 1;
+        _volumeArcs.clear();
+        _arcPosition.assign(m.nArcs, 0);
+        _dirtyMapping.reset(size);
 
         glBufferData(
             GL_SHADER_STORAGE_BUFFER,
-            sizeof(uint32_t) * (_mappingData.size() + 1),
+            sizeof(uint32_t) * _mappingData.size(),
             _mappingData.data(),
             GL_DYNAMIC_COPY
         );
     }
-    _mappingData[0] = _nVolumes + 1;
+    if (_mappingData[0] != uint32_t(_nVolumes + 1)) {
+        _mappingData[0] = _nVolumes + 1;
+        _dirtyMapping.mark(0);
+    }
 
-    if (_dirty.mapping) {
-        std::vector<Feature> m = *_inportFeatureMapping.getData();
+    if (_dirty.removeVolume) {
+        clearVolume(_currentVolume);
+        _dirty.removeVolume = false;
+    }
 
+    if (_dirty.clearAllVolumes) {
+        for (size_t v = 0; v < _volumeArcs.size(); ++v) {
+            clearVolume(static_cast<uint32_t>(v));
+        }
+        _dirty.clearAllVolumes = false;
+    }
+
+    if (_dirty.mapping) {
         std::pair<uint32_t, bool> featureFound = findFeature(
             _lastChangedSlicePosition,
             _inport.getData()->getRepresentation<VolumeRAM>(),
@@ -251,33 +243,18 @@ void VolumeCollectionGenerator::process() {
             //_featureToModify.setMaxValue(m.size() - 1);
 
             //std::vector<uint32_t> idx = m[_featureToModify];
-            std::vector<uint32_t> idx = m[featureFound.first];
+            const std::vector<uint32_t>& idx = m.features[featureFound.first];
 
             // If we are adding, we want to set the current volume into it, otherwise we replace it with NoVolume := 0
+            const uint32_t volume = _modification.get() == ModificationAdd ?
+                static_cast<uint32_t>(_currentVolume.get()) : uint32_t(-1);
             for (uint32_t i : idx) {
-                if (_modification.get() == ModificationAdd) {
-                    _mappingData[i + 1] = static_cast<uint32_t>(_currentVolume.get());
-                }
-                else {
-                    _mappingData[i + 1] = uint32_t(-1);
-                }
+                setArcVolume(i, volume);
             }
-
-            glBufferData(
-                GL_SHADER_STORAGE_BUFFER,
-                sizeof(uint32_t) * (_mappingData.size() + 1),
-                _mappingData.data(),
-                GL_DYNAMIC_COPY
-            );
         }
         _dirty.mapping = false;
     }
-    glBufferSubData(
-        GL_SHADER_STORAGE_BUFFER,
-        0,
-        sizeof(uint32_t),
-        _mappingData.data()
-    );
+    _dirtyMapping.upload(GL_SHADER_STORAGE_BUFFER, _mappingData);
 
     _information->nFeatures = _nVolumes + 1;
     _information->useConvexHull.resize(_information->nFeatures, true);
@@ -293,6 +270,42 @@ void VolumeCollectionGenerator::process() {
 }
 //#pragma optimize("", on)
 
+void VolumeCollectionGenerator::setArcVolume(uint32_t arc, uint32_t volume) {
+    uint32_t& m = _mappingData[arc + 1];
+    if (m == volume) {
+        return;
+    }
+    if (m != uint32_t(-1)) {
+        // Move the last arc of the previous volume into the place of this one
+        std::vector<uint32_t>& arcs = _volumeArcs[m];
+        const uint32_t pos = _arcPosition[arc];
+        arcs[pos] = arcs.back();
+        _arcPosition[arcs[pos]] = pos;
+        arcs.pop_back();
+    }
+    m = volume;
+    _dirtyMapping.mark(arc + 1);
+
+    if (volume != uint32_t(-1)) {
+        if (volume >= _volumeArcs.size()) {
+            _volumeArcs.resize(volume + 1);
+        }
+        _arcPosition[arc] = static_cast<uint32_t>(_volumeArcs[volume].size());
+        _volumeArcs[volume].push_back(arc);
+    }
+}
+
+void VolumeCollectionGenerator::clearVolume(uint32_t volume) {
+    if (volume >= _volumeArcs.size()) {
+        return;
+    }
+    for (uint32_t arc : _volumeArcs[volume]) {
+        _mappingData[arc + 1] = uint32_t(-1);
+        _dirtyMapping.mark(arc + 1);
+    }
+    _volumeArcs[volume].clear();
+}
+
 void VolumeCollectionGenerator::selectVolume(Event* e, int volume) {
     _currentVolume = volume;
 
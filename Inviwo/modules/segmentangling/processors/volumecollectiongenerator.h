@@ -9,6 +9,7 @@
 #include <inviwo/core/properties/eventproperty.h>
 
 #include <modules/segmentangling/common.h>
+#include <modules/segmentangling/util/dirtyblocks.h>
 
 
 namespace inviwo {
@@ -29,6 +30,9 @@ protected:
     void removeVolumeModification(Event* e);
     void toggleConvexHull(Event* e);
 
+    void setArcVolume(uint32_t arc, uint32_t volume);
+    void clearVolume(uint32_t volume);
+
     VolumeInport _inport;
     FeatureInport _inportFeatureMapping;
     ContourOutport _outportContour;
@@ -79,7 +83,12 @@ protected:
     StringProperty _featureNumberFound;
     StringProperty _usingConvexHull;
 
+    // [0]: number of volumes, [arc + 1]: the volume of every arc
     std::vector<uint32_t> _mappingData;
+    DirtyBlocks _dirtyMapping;
+    // The arcs of every volume, and the position of every arc in the list of its volume
+    std::vector<std::vector<uint32_t>> _volumeArcs;
+    std::vector<uint32_t> _arcPosition;
     
     std::shared_ptr<ContourInformation> _information;
     //ContourInformation* _information;
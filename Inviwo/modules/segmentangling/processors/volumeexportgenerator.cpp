@@ -2,17 +2,175 @@
 
 #include <modules/opengl/shader/shaderutils.h>
 #include <modules/opengl/volume/volumegl.h>
+#include <inviwo/core/datastructures/volume/volumedisk.h>
+#include <inviwo/core/util/filesystem.h>
 
 #include <inviwo/core/interaction/events/keyboardkeys.h>
 
+#include "../../ContourTree/Feathering.hpp"
+
 #include "libqhullcpp/Qhull.h"
 #include "libqhullcpp/QhullFacetList.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <sstream>
+#include <thread>
+
 using namespace orgQhull;
 
 namespace inviwo {
 
 namespace {
+    // Calls func(i) for every i of indices, on no more threads than the hardware provides
+    template <typename Func>
+    void parallelFor(const std::vector<size_t>& indices, Func func) {
+        const size_t nThreads = std::max<size_t>(
+            1,
+            std::min<size_t>(std::thread::hardware_concurrency(), indices.size())
+        );
+
+        std::atomic<size_t> next(0);
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < nThreads; ++t) {
+            threads.emplace_back([&]() {
+                for (size_t i = next++; i < indices.size(); i = next++) {
+                    func(indices[i]);
+                }
+            });
+        }
+        for (std::thread& t : threads) {
+            t.join();
+        }
+    }
+
+    // The raw file of a volume that was read from an uncompressed 8 bit .dat file, so that it
+    // can be streamed instead of loaded completely. Empty if the volume did not come from one
+    std::string rawFileOfVolume(const Volume& volume, size_t& byteOffset) {
+        byteOffset = 0;
+        if (!volume.hasRepresentation<VolumeDisk>()) {
+            return "";
+        }
+        const std::string datFile = volume.getRepresentation<VolumeDisk>()->getSourceFile();
+        std::string extension = filesystem::getFileExtension(datFile);
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return char(::tolower(c)); });
+        if (extension != "dat") {
+            return "";
+        }
+
+        std::ifstream file(datFile);
+        std::string rawFile;
+        std::string format;
+        std::string line;
+        while (std::getline(file, line)) {
+            const size_t colon = line.find(':');
+            if (colon == std::string::npos) {
+                continue;
+            }
+            std::string key = line.substr(0, colon);
+            std::transform(key.begin(), key.end(), key.begin(), [](char c) { return char(::tolower(c)); });
+            std::istringstream value(line.substr(colon + 1));
+            if (key == "rawfile") {
+                value >> rawFile;
+            }
+            else if (key == "format") {
+                value >> format;
+            }
+            else if (key == "byteoffset") {
+                value >> byteOffset;
+            }
+        }
+
+        if (rawFile.empty() || format != "UINT8") {
+            return "";
+        }
+        if (filesystem::isAbsolutePath(rawFile)) {
+            return rawFile;
+        }
+        return filesystem::getFileDirectory(datFile) + '/' + rawFile;
+    }
+
+    // Writes the .dat file describing an 8 bit raw file that holds the dim voxels of source
+    // starting at voxel offset. The basis is cropped to those voxels so that the volume is
+    // placed where it was in source, and the offset is also recorded in voxels
+    void writeDatFile(const std::string& datFile, const std::string& rawFile, const Volume& source,
+                      const glm::size3_t& offset, const glm::size3_t& dim)
+    {
+        const glm::dvec3 sourceDim = glm::dvec3(source.getDimensions());
+        const glm::dmat3 sourceBasis = glm::dmat3(source.getBasis());
+        glm::dmat3 basis;
+        for (int i = 0; i < 3; ++i) {
+            basis[i] = sourceBasis[i] * (double(dim[i]) / sourceDim[i]);
+        }
+        const glm::dvec3 worldOffset = glm::dvec3(source.getOffset()) + sourceBasis * (glm::dvec3(offset) / sourceDim);
+
+        std::ofstream file(datFile);
+        file << "Rawfile: " << filesystem::getFileNameWithExtension(rawFile) << '\n';
+        file << "Resolution: " << dim.x << " " << dim.y << " " << dim.z << '\n';
+        file << "Format: UINT8\n";
+        for (int i = 0; i < 3; ++i) {
+            file << "BasisVector" << i + 1 << ": " << basis[i].x << " " << basis[i].y << " " << basis[i].z << '\n';
+        }
+        file << "Offset: " << worldOffset.x << " " << worldOffset.y << " " << worldOffset.z << '\n';
+        file << "VoxelOffset: " << offset.x << " " << offset.y << " " << offset.z << '\n';
+        file << '\n';
+    }
+
+    // A convex hull as the intersection of the half-spaces n . p + offset <= tolerance. The
+    // coefficients of the planes are kept in separate arrays, so going over all of them is
+    // a simple loop that the compiler can vectorize, and no qhull state is shared between
+    // the threads that test points against the hull
+    struct ConvexHull {
+        std::vector<double> nx;
+        std::vector<double> ny;
+        std::vector<double> nz;
+        std::vector<double> offset;
+        double tolerance = 0.0;
+
+        // points contains the x, y, z coordinates of each point
+        void build(const std::vector<double>& points) {
+            Qhull qhull;
+            const char* f = "";
+            qhull.runQhull(f, 3, int(points.size() / 3), points.data(), f);
+
+            // The same facets that qh_findbestfacet considers
+            for (const QhullFacet& facet : qhull.facetList()) {
+                const facetT* ft = facet.getFacetT();
+                if (ft->flipped || !ft->normal) {
+                    continue;
+                }
+                nx.push_back(ft->normal[0]);
+                ny.push_back(ft->normal[1]);
+                nz.push_back(ft->normal[2]);
+                offset.push_back(ft->offset);
+            }
+            tolerance = qhull.qh()->MINoutside;
+        }
+
+        // The interval of x for which (x, y, z) is inside of the hull; empty if x > y
+        glm::dvec2 span(double y, double z) const {
+            double lo = -std::numeric_limits<double>::infinity();
+            double hi = std::numeric_limits<double>::infinity();
+            int empty = 0;
+            for (size_t i = 0; i < nx.size(); ++i) {
+                // nx * x + c <= 0 bounds x from above for nx > 0 and from below for nx < 0
+                const double c = ny[i] * y + nz[i] * z + offset[i] - tolerance;
+                const double t = -c / nx[i];
+                hi = (nx[i] > 0.0 && t < hi) ? t : hi;
+                lo = (nx[i] < 0.0 && t > lo) ? t : lo;
+                empty |= (nx[i] == 0.0 && c > 0.0);
+            }
+            if (empty) {
+                return { 1.0, 0.0 };
+            }
+            return { lo, hi };
+        }
+    };
 } // namespace
 
 const ProcessorInfo VolumeExportGenerator::processorInfo_{
@@ -30,6 +188,7 @@ VolumeExportGenerator::VolumeExportGenerator()
     , _inportFeatureMapping("inportfeaturemapping")
     , _inportFullData("inportfulldata")
     , _featherDistance("_featherDistance", "Feathering", 0, 0, 100)
+    , _slabDepth("_slabDepth", "Full Resolution Slab Depth", 32, 1, 4096)
     , _shouldOverwriteFiles("_shouldOverwriteFiles", "Should Overwrite files", true)
     , _basePath("_basePath", "Save Base Path")
     , _saveVolumes("_saveVolumes", "Save Volumes")
@@ -42,6 +201,7 @@ VolumeExportGenerator::VolumeExportGenerator()
     addPort(_inportFullData);
 
     addProperty(_featherDistance);
+    addProperty(_slabDepth);
     addProperty(_shouldOverwriteFiles);
     addProperty(_basePath);
     _saveVolumes.onChange([this]() { _saveVolumesFlag = true; });
@@ -75,228 +235,206 @@ void VolumeExportGenerator::process() {
 
     struct InternalFeatureInfo {
         bool isUsed = false;
-        Qhull convexHull;
-        std::mutex convexHullMutex;
-        std::thread thread;
-        Volume* volume = nullptr;
+        ConvexHull convexHull;
+        // The exported voxels within the bounding box
+        std::vector<uint8_t> volume;
         bool usingConvexHull;
+        // The extent of the voxels that belong to the feature
+        glm::size3_t featureMin = glm::size3_t(-1);
+        glm::size3_t featureMax = glm::size3_t(0);
+        // The extent of the voxels that are kept in the exported volume
         glm::size3_t boundingBoxMin = glm::size3_t(-1);
         glm::size3_t boundingBoxMax = glm::size3_t(0);
-    };
 
-    // Some of the features might not contain any information at all, so we filter those
-    // in advance for some more rapid saving
-    const size_t size = identifierVolume.getDimensions().x * identifierVolume.getDimensions().y * identifierVolume.getDimensions().z;
-    std::vector<InternalFeatureInfo> featureInfos(features.nFeatures);
-    for (size_t i = 0; i < size; ++i) {
-        uint32_t feature = idMapping[i];
-        if (feature != uint32_t(-1)) {
-            featureInfos[feature].isUsed = true;
+        glm::size3_t boundingBoxSize() const {
+            return glm::all(glm::lessThanEqual(boundingBoxMin, boundingBoxMax)) ?
+                boundingBoxMax - boundingBoxMin + glm::size3_t(1) : glm::size3_t(0);
         }
-    }
+    };
+
+    const glm::size3_t dim = identifierVolume.getDimensions();
+    const uint32_t nFeatures = features.nFeatures;
+    std::vector<InternalFeatureInfo> featureInfos(nFeatures);
 
     // Populating the data in the feature infos struct
-    for (size_t i = 0; i < features.nFeatures; ++i) {
+    for (size_t i = 0; i < nFeatures; ++i) {
         LogInfo("Using convex hull: " << i << "  " << features.useConvexHull[i] ? "true" : "false");
         featureInfos[i].usingConvexHull = features.useConvexHull[i];
     }
 
+    // A single pass over the identifiers finds the features that contain any voxels, their
+    // extents and the first and last voxel of every feature on each scanline. All other
+    // voxels of a scanline lie between those two, so the convex hull of the scanline end
+    // points is the convex hull of the whole feature
+    LogInfo("Collecting feature voxels");
+    std::vector<std::vector<double>> hullPoints(nFeatures);
+    {
+        auto addHullPoint = [&hullPoints, &dim](uint32_t feature, size_t x, size_t y, size_t z) {
+            hullPoints[feature].push_back(static_cast<double>(x) / static_cast<double>(dim.x));
+            hullPoints[feature].push_back(static_cast<double>(y) / static_cast<double>(dim.y));
+            hullPoints[feature].push_back(static_cast<double>(z) / static_cast<double>(dim.z));
+        };
 
-    // Lambda to wait on used feature threads
-    auto waitOnThreads = [&featureInfos](){
-        for (InternalFeatureInfo& info : featureInfos) {
-            if (info.isUsed) {
-                info.thread.join();
-            }
-        }
-    };
-
-    // Lambda to construct the convex hull
-    auto constructConvexHull = [&featureInfos, &dataVolume, &idMapping, &identifierData, this](size_t iFeature) {
-        LogInfo("Starting volume " << iFeature);
-
-        const VolumeRAM* rep = dataVolume.getRepresentation<VolumeRAM>();
-        const uint8_t* data = reinterpret_cast<const uint8_t*>(rep->getData());
-
-        std::vector<double> points;
-
-        LogInfo("Creating convex hull " << iFeature);
-        for (size_t x = 0; x < rep->getDimensions().x; ++x) {
-            for (size_t y = 0; y < rep->getDimensions().y; ++y) {
-                for (size_t z = 0; z < rep->getDimensions().z; ++z) {
-                    const uint64_t idx = VolumeRAM::posToIndex({ x, y, z }, rep->getDimensions());
+        std::vector<size_t> rowMin(nFeatures);
+        std::vector<size_t> rowMax(nFeatures);
+        std::vector<size_t> rowStamp(nFeatures, size_t(-1));
+        std::vector<uint32_t> rowFeatures;
+        for (size_t z = 0; z < dim.z; ++z) {
+            for (size_t y = 0; y < dim.y; ++y) {
+                const size_t row = z * dim.y + y;
+                const uint32_t* rowIdentifiers = identifierData + VolumeRAM::posToIndex({ 0, y, z }, dim);
+
+                rowFeatures.clear();
+                for (size_t x = 0; x < dim.x; ++x) {
+                    const uint32_t feature = idMapping[rowIdentifiers[x]];
+                    if (feature >= nFeatures) {
+                        continue;
+                    }
+                    if (rowStamp[feature] != row) {
+                        rowStamp[feature] = row;
+                        rowMin[feature] = x;
+                        rowFeatures.push_back(feature);
+                    }
+                    rowMax[feature] = x;
+                }
 
-                    const uint32_t id = identifierData[idx];
+                for (uint32_t feature : rowFeatures) {
+                    InternalFeatureInfo& info = featureInfos[feature];
+                    info.isUsed = true;
+                    info.featureMin = glm::min(info.featureMin, { rowMin[feature], y, z });
+                    info.featureMax = glm::max(info.featureMax, { rowMax[feature], y, z });
 
-                    if (idMapping[id] == iFeature) {
-                        // If it belongs to the feature, we want to throw it into the QHull computation later
-                        points.push_back(static_cast<double>(x) / static_cast<double>(rep->getDimensions().x));
-                        points.push_back(static_cast<double>(y) / static_cast<double>(rep->getDimensions().y));
-                        points.push_back(static_cast<double>(z) / static_cast<double>(rep->getDimensions().z));
+                    if (info.usingConvexHull) {
+                        addHullPoint(feature, rowMin[feature], y, z);
+                        if (rowMax[feature] != rowMin[feature]) {
+                            addHullPoint(feature, rowMax[feature], y, z);
+                        }
                     }
                 }
             }
         }
+    }
 
-        const char* f = "";
-        featureInfos[iFeature].convexHull.runQhull(f, 3, int(points.size() / 3), points.data(), f);
-    };
-    
-
-
-
-    // Construct the convex hulls
-    LogInfo("Saving " << features.nFeatures << " volumes");
-    for (size_t iFeature = 0; iFeature < features.nFeatures; ++iFeature) {
-        if (featureInfos[iFeature].isUsed) {
-            featureInfos[iFeature].thread = std::thread(constructConvexHull, iFeature);
+    // Some of the features might not contain any information at all, so we filter those
+    // in advance for some more rapid saving
+    std::vector<size_t> usedFeatures;
+    for (size_t i = 0; i < nFeatures; ++i) {
+        if (featureInfos[i].isUsed) {
+            usedFeatures.push_back(i);
         }
     }
 
 
-
-
-    // We need to wait for all threads to finish before we can continue
-    waitOnThreads();
-
-
-    auto neighboringVoxelOffsets = [](int distance) {
-        std::vector<glm::ivec3> offsets;
-        offsets.reserve(pow(2 * distance + 1, 3));
-
-        offsets.push_back({ 0, 0, 0 });
-
-        for (int x = -distance; x <= distance; ++x) {
-            for (int y = -distance; y <= distance; ++y) {
-                for (int z = -distance; z <= distance; ++z) {
-                    if (x == 0 && y == 0 && z == 0) {
-                        // We put (0,0,0) at the top to speed up things later
-                        continue;
-                    }
-
-                    offsets.push_back({ x, y, z });
+    // Construct the convex hulls
+    LogInfo("Saving " << usedFeatures.size() << " volumes");
+    parallelFor(usedFeatures, [&featureInfos, &hullPoints, this](size_t iFeature) {
+        if (featureInfos[iFeature].usingConvexHull) {
+            LogInfo("Creating convex hull " << iFeature);
+            featureInfos[iFeature].convexHull.build(hullPoints[iFeature]);
+        }
+    });
+    std::vector<std::vector<double>>().swap(hullPoints);
+
+
+    // Lambda expression to create the volumes from the convex hulls. Only the bounding box
+    // of the kept voxels is stored, everything outside of it would be zero
+    const VolumeRAM& dataRep = *dataVolume.getRepresentation<VolumeRAM>();
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(dataRep.getData());
+    const int featherDistance = _featherDistance;
+    auto createVolumes = [&featureInfos, &identifierData, &idMapping, data, dim, featherDistance](uint32_t iFeature) {
+        InternalFeatureInfo& info = featureInfos[iFeature];
+
+        // The voxels of every scanline that are inside of the convex hull, as [first, last].
+        // The predicate is only evaluated within the extent of the feature, so only the
+        // scanlines of that extent are needed, indexed relative to featureMin
+        const size_t spanDimY = info.featureMax.y - info.featureMin.y + 1;
+        std::vector<glm::ivec2> hullSpans;
+        if (info.usingConvexHull) {
+            hullSpans.resize(spanDimY * (info.featureMax.z - info.featureMin.z + 1));
+            for (size_t z = info.featureMin.z; z <= info.featureMax.z; ++z) {
+                for (size_t y = info.featureMin.y; y <= info.featureMax.y; ++y) {
+                    const glm::dvec2 span = info.convexHull.span(
+                        static_cast<double>(y) / static_cast<double>(dim.y),
+                        static_cast<double>(z) / static_cast<double>(dim.z)
+                    );
+                    // Voxel x is at x / dim.x
+                    const double first = std::ceil(glm::clamp(span.x * dim.x, -1.0, double(dim.x)));
+                    const double last = std::floor(glm::clamp(span.y * dim.x, -1.0, double(dim.x)));
+                    hullSpans[(z - info.featureMin.z) * spanDimY + (y - info.featureMin.y)] = glm::ivec2(
+                        std::max(first, 0.0),
+                        std::min(last, double(dim.x) - 1.0)
+                    );
                 }
             }
         }
 
-        return offsets;
-    };
-
-    const std::vector<glm::ivec3> offsets = neighboringVoxelOffsets(_featherDistance);
-
-
-    // Lambda expression to create the volumes from the convex hulls
-    auto createVolumes = [&featureInfos, &identifierData, &idMapping, &offsets](uint32_t iFeature, Volume* volume) {
-        VolumeRAM* rep = volume->getEditableRepresentation<VolumeRAM>();
-        uint8_t* data = reinterpret_cast<uint8_t*>(rep->getData());
-
-
-
-        // Predicate that tests the position against the convex hull
-        auto voxelPredicateCH = [&featureInfos, iFeature, &data, &identifierData, &idMapping](const glm::size3_t& pos, const glm::size3_t& dim) {
-            const glm::size3_t p = glm::clamp(
-                pos,
-                glm::size3_t(0),
-                dim
-            );
-
-
+        // Predicate that tests whether a voxel is kept before feathering
+        auto voxelPredicate = [&info, iFeature, &hullSpans, spanDimY, &identifierData, &idMapping](const glm::size3_t& p, const glm::size3_t& dim) {
             const uint64_t idx = VolumeRAM::posToIndex(p, dim);
-            double pt[3] = {
-                static_cast<double>(p.x) / static_cast<double>(dim.x),
-                static_cast<double>(p.y) / static_cast<double>(dim.y),
-                static_cast<double>(p.z) / static_cast<double>(dim.z)
-            };
-
-            double dist;
-            boolT isOutside;
-
-            featureInfos[iFeature].convexHullMutex.lock();
-            qh_findbestfacet(featureInfos[iFeature].convexHull.qh(), pt, qh_False, &dist, &isOutside);
-            featureInfos[iFeature].convexHullMutex.unlock();
-
-            if (isOutside) {
-                // Remove all the voxels that are outside of the convex hull
-                return true;
-            }
-            else {
-                const uint32_t id = identifierData[idx];
-                const uint32_t feature = idMapping[id];
-                if (feature != iFeature && feature != uint32_t(-1)) {
-                    // If the voxel is not a feature, we can remove it
-                    return true;
-                }
-            }
-            return false;
-        };
+            const uint32_t feature = idMapping[identifierData[idx]];
 
-        auto voxelPredicateCHNeighbor = [&voxelPredicateCH, &offsets](const glm::size3_t& pos, const glm::size3_t& dim) {
-            for (const glm::size3_t& offset : offsets) {
-                if (!voxelPredicateCH(pos + offset, dim)) {
+            if (info.usingConvexHull) {
+                const glm::ivec2& span = hullSpans[(p.z - info.featureMin.z) * spanDimY + (p.y - info.featureMin.y)];
+                const int x = static_cast<int>(p.x);
+                if (x < span.x || x > span.y) {
+                    // Remove all the voxels that are outside of the convex hull
                     return false;
                 }
-            }
-            return true;
-        };
-
-        // Predicate that tests the position against the feature list
-        auto voxelPredicate = [&identifierData, &idMapping, iFeature, &data](const glm::size3_t& pos, const glm::size3_t& dim) {
-            // We are not using the convex hull, so we just filter out the
-            // feature indentifiers
-            const glm::size3_t p = glm::clamp(
-                pos,
-                glm::size3_t(0),
-                dim - glm::size3_t(1)
-            );
-
-            const uint64_t idx = VolumeRAM::posToIndex(p, dim);
-            const uint32_t id = identifierData[idx];
-            const uint32_t feature = idMapping[id];
-
-            if (feature == iFeature) {
-                return false;
+                // Inside of the hull, only the voxels of other features are removed
+                return feature == iFeature || feature == uint32_t(-1);
             }
             else {
-                return true;
+                // We are not using the convex hull, so we just filter out the
+                // feature indentifiers
+                return feature == iFeature;
             }
         };
 
-        auto voxelPredicateNeighbor = [&voxelPredicate, &offsets](const glm::size3_t& pos, const glm::size3_t& dim) {
-            for (const glm::size3_t& offset : offsets) {
-                if (!voxelPredicate(pos + offset, dim)) {
-                    return false;
+        // Both the feature and its convex hull lie within the extent of the feature, so
+        // nothing outside of that extent grown by the feathering distance is kept
+        const glm::size3_t keepMin = glm::size3_t(glm::max(
+            glm::ivec3(info.featureMin) - featherDistance,
+            glm::ivec3(0)
+        ));
+        const glm::size3_t keepMax = glm::size3_t(glm::min(
+            glm::ivec3(info.featureMax) + featherDistance,
+            glm::ivec3(dim) - 1
+        ));
+        const glm::size3_t keepDim = keepMax - keepMin + glm::size3_t(1);
+
+        // A voxel is kept if any voxel within the feathering distance passes the predicate,
+        // which is a dilation of the voxels that pass it by a cube
+        std::vector<uint8_t> mask(keepDim.x * keepDim.y * keepDim.z, 0);
+        for (size_t z = info.featureMin.z; z <= info.featureMax.z; ++z) {
+            for (size_t y = info.featureMin.y; y <= info.featureMax.y; ++y) {
+                for (size_t x = info.featureMin.x; x <= info.featureMax.x; ++x) {
+                    mask[VolumeRAM::posToIndex(glm::size3_t(x, y, z) - keepMin, keepDim)] =
+                        voxelPredicate({ x, y, z }, dim);
                 }
             }
-            return true;
-        };
-
-
-        for (size_t x = 0; x < rep->getDimensions().x; ++x) {
-            for (size_t y = 0; y < rep->getDimensions().y; ++y) {
-                for (size_t z = 0; z < rep->getDimensions().z; ++z) {
-                    const uint64_t idx = VolumeRAM::posToIndex({ x, y, z }, rep->getDimensions());
-
-                    bool removeValue;
-                    if (featureInfos[iFeature].usingConvexHull) {
-                        removeValue = voxelPredicateCHNeighbor({ x, y, z }, rep->getDimensions());
-                    }
-                    else {
-                        removeValue = voxelPredicateNeighbor({ x, y, z }, rep->getDimensions());
+        }
+        contourtree::featherMask(mask, keepDim.x, keepDim.y, keepDim.z, featherDistance);
+
+        for (size_t z = 0; z < keepDim.z; ++z) {
+            for (size_t y = 0; y < keepDim.y; ++y) {
+                for (size_t x = 0; x < keepDim.x; ++x) {
+                    if (mask[VolumeRAM::posToIndex({ x, y, z }, keepDim)]) {
+                        const glm::size3_t p = keepMin + glm::size3_t(x, y, z);
+                        info.boundingBoxMin = glm::min(info.boundingBoxMin, p);
+                        info.boundingBoxMax = glm::max(info.boundingBoxMax, p);
                     }
+                }
+            }
+        }
 
-                    if (removeValue) {
-                        data[idx] = 0;
-                    }
-                    else {
-                        featureInfos[iFeature].boundingBoxMin = glm::min(
-                            featureInfos[iFeature].boundingBoxMin,
-                            { x, y, z }
-                        );
-
-                        featureInfos[iFeature].boundingBoxMax = glm::max(
-                            featureInfos[iFeature].boundingBoxMax,
-                            { x, y, z }
-                        );
+        const glm::size3_t size = info.boundingBoxSize();
+        info.volume.assign(size.x * size.y * size.z, 0);
+        for (size_t z = 0; z < size.z; ++z) {
+            for (size_t y = 0; y < size.y; ++y) {
+                for (size_t x = 0; x < size.x; ++x) {
+                    const glm::size3_t p = info.boundingBoxMin + glm::size3_t(x, y, z);
+                    if (mask[VolumeRAM::posToIndex(p - keepMin, keepDim)]) {
+                        info.volume[VolumeRAM::posToIndex({ x, y, z }, size)] = data[VolumeRAM::posToIndex(p, dim)];
                     }
                 }
             }
@@ -306,130 +444,190 @@ void VolumeExportGenerator::process() {
 
 
 
-    // Construct the volumes from the convex hulls
-    for (size_t iFeature = 0; iFeature < features.nFeatures; ++iFeature) {
-        if (featureInfos[iFeature].isUsed) {
-            featureInfos[iFeature].volume = dataVolume.clone();
-            featureInfos[iFeature].thread = std::thread(createVolumes, iFeature, featureInfos[iFeature].volume);
-        }
-    }
-    
-
-
-
-    // Lambda expression to save the volumes
-    auto saveVolumes = [&featureInfos, this](size_t iFeature) {
+    // Lambda expression to save the volumes, cropped to their bounding box
+    auto saveVolumes = [&featureInfos, &dataVolume, this](size_t iFeature) {
         const std::string fileName = _basePath.get() + "__small__" + std::to_string(iFeature) + ".dat";
+        const std::string rawName = _basePath.get() + "__small__" + std::to_string(iFeature) + ".raw";
+        if (!_shouldOverwriteFiles && filesystem::fileExists(fileName)) {
+            LogWarn("Not overwriting " << fileName);
+            return;
+        }
         LogInfo("Saving volume " << iFeature << ": " << fileName);
 
-        auto factory = getNetwork()->getApplication()->getDataWriterFactory();
-        auto writer = factory->template getWriterForTypeAndExtension<Volume>("dat");
-        writer->setOverwrite(_shouldOverwriteFiles);
-        writer->writeData(featureInfos[iFeature].volume, fileName);
+        const InternalFeatureInfo& info = featureInfos[iFeature];
+        const glm::size3_t size = info.boundingBoxSize();
+        writeDatFile(fileName, rawName, dataVolume, size.x > 0 ? info.boundingBoxMin : glm::size3_t(0), size);
+        std::ofstream file(rawName, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(info.volume.data()), info.volume.size());
     };
 
 
 
 
-    // Save the volumes
-    for (size_t iFeature = 0; iFeature < features.nFeatures; ++iFeature) {
-        if (featureInfos[iFeature].isUsed) {
-            featureInfos[iFeature].thread.join();
-            featureInfos[iFeature].thread = std::thread(
-                saveVolumes, iFeature
-            );
-        }
-    }
-
-    waitOnThreads();
+    // Construct the volumes from the convex hulls and save them
+    parallelFor(usedFeatures, [&createVolumes, &saveVolumes](size_t iFeature) {
+        createVolumes(uint32_t(iFeature));
+        saveVolumes(iFeature);
+    });
 
 
-    // Save the volumes;  can't do this multithreaded as we would probably run out of memory
+    // The full resolution volumes are written while going through the full resolution data
+    // once, a slab of slices at a time. Every slab is scattered into all features that
+    // overlap it, so only a slab and one scanline per feature are held in memory
     if (_inportFullData.hasData()) {
-        //const VolumeRAM& fullRep = *_inportFullData.getData()->getRepresentation<VolumeRAM>();
-        for (size_t iFeature = 0; iFeature < features.nFeatures; ++iFeature) {
-            if (!featureInfos[iFeature].isUsed) {
-                continue;
-            }
-
-            const VolumeRAM& fullRep = *_inportFullData.getData()->getRepresentation<VolumeRAM>();
+        const Volume& fullVolume = *_inportFullData.getData();
+        const glm::size3_t fullDim = fullVolume.getDimensions();
+        const glm::size3_t smallDim = dim;
+        const size_t sliceSize = fullDim.x * fullDim.y;
+
+        // Reads the slices [z0, z1) of the full resolution data into slab, false if that failed
+        using SlabReader = std::function<bool(size_t, size_t, uint8_t*)>;
+        auto readFromMemory = [&fullVolume, sliceSize]() -> SlabReader {
+            const VolumeRAM& fullRep = *fullVolume.getRepresentation<VolumeRAM>();
             const uint8_t* fullData = reinterpret_cast<const uint8_t*>(fullRep.getData());
+            return [fullData, sliceSize](size_t z0, size_t z1, uint8_t* slab) {
+                std::memcpy(slab, fullData + z0 * sliceSize, (z1 - z0) * sliceSize);
+                return true;
+            };
+        };
+        SlabReader readSlab;
+        size_t byteOffset;
+        const std::string rawFileName = rawFileOfVolume(fullVolume, byteOffset);
+        std::ifstream rawFile;
+        if (!rawFileName.empty()) {
+            rawFile.open(rawFileName, std::ios::binary);
+        }
+        if (rawFile) {
+            LogInfo("Streaming full resolution data from " << rawFileName);
+            readSlab = [&rawFile, byteOffset, sliceSize](size_t z0, size_t z1, uint8_t* slab) {
+                const std::streamsize size = std::streamsize((z1 - z0) * sliceSize);
+                rawFile.seekg(byteOffset + z0 * sliceSize);
+                rawFile.read(reinterpret_cast<char*>(slab), size);
+                return rawFile.good() && rawFile.gcount() == size;
+            };
+        }
+        else {
+            LogWarn("Full resolution data is not an 8 bit .dat file, loading it completely");
+            readSlab = readFromMemory();
+        }
 
-            const VolumeRAM& smallRep = *featureInfos[iFeature].volume->getRepresentation<VolumeRAM>();
-            const uint8_t* smallData = reinterpret_cast<const uint8_t*>(smallRep.getData());
+        // The small voxel that covers every full resolution coordinate, for each axis
+        auto smallCoordinates = [](size_t full, size_t small) {
+            std::vector<size_t> coords(full);
+            for (size_t i = 0; i < full; ++i) {
+                coords[i] = size_t((double(i) / full) * small);
+            }
+            return coords;
+        };
+        const std::vector<size_t> smallX = smallCoordinates(fullDim.x, smallDim.x);
+        const std::vector<size_t> smallY = smallCoordinates(fullDim.y, smallDim.y);
+        const std::vector<size_t> smallZ = smallCoordinates(fullDim.z, smallDim.z);
+
+        struct FullResolutionOutput {
+            size_t iFeature;
+            glm::size3_t min;
+            glm::size3_t size;
+            std::ofstream file;
+        };
+        std::vector<FullResolutionOutput> outputs(usedFeatures.size());
+        std::vector<size_t> openOutputs;
+        for (size_t i = 0; i < usedFeatures.size(); ++i) {
+            const size_t iFeature = usedFeatures[i];
+            FullResolutionOutput& out = outputs[i];
+            out.iFeature = iFeature;
+            if (featureInfos[iFeature].boundingBoxSize().x == 0) {
+                continue;
+            }
 
+            // The bounding box is inclusive, so the full resolution box ends where the small
+            // voxel after it begins
+            const glm::size3_t boundingBoxEnd = featureInfos[iFeature].boundingBoxMax + glm::size3_t(1);
             const glm::ivec3 fullBoundingBoxMin = {
-                int(floor((double(featureInfos[iFeature].boundingBoxMin.x) / smallRep.getDimensions().x) * fullRep.getDimensions().x)),
-                int(floor((double(featureInfos[iFeature].boundingBoxMin.y) / smallRep.getDimensions().y) * fullRep.getDimensions().y)),
-                int(floor((double(featureInfos[iFeature].boundingBoxMin.z) / smallRep.getDimensions().z) * fullRep.getDimensions().z))
+                int(floor((double(featureInfos[iFeature].boundingBoxMin.x) / smallDim.x) * fullDim.x)),
+                int(floor((double(featureInfos[iFeature].boundingBoxMin.y) / smallDim.y) * fullDim.y)),
+                int(floor((double(featureInfos[iFeature].boundingBoxMin.z) / smallDim.z) * fullDim.z))
             };
 
             const glm::ivec3 fullBoundingBoxMax = {
-                int(ceil((double(featureInfos[iFeature].boundingBoxMax.x) / smallRep.getDimensions().x) * fullRep.getDimensions().x)),
-                int(ceil((double(featureInfos[iFeature].boundingBoxMax.y) / smallRep.getDimensions().y) * fullRep.getDimensions().y)),
-                int(ceil((double(featureInfos[iFeature].boundingBoxMax.z) / smallRep.getDimensions().z) * fullRep.getDimensions().z))
+                int(ceil((double(boundingBoxEnd.x) / smallDim.x) * fullDim.x)),
+                int(ceil((double(boundingBoxEnd.y) / smallDim.y) * fullDim.y)),
+                int(ceil((double(boundingBoxEnd.z) / smallDim.z) * fullDim.z))
             };
-            const glm::ivec3 newSize = fullBoundingBoxMax - fullBoundingBoxMin;
-
-
-
-            Volume* newVolume = new Volume(newSize);
-            VolumeRAM& newRep = *newVolume->getEditableRepresentation<VolumeRAM>();
-            uint8_t* newData = reinterpret_cast<uint8_t*>(newRep.getData());
-
-            std::memset(newData, uint8_t(0), newRep.getNumberOfBytes());
-
+            const glm::ivec3 fullMin = glm::clamp(fullBoundingBoxMin, glm::ivec3(0), glm::ivec3(fullDim));
+            const glm::ivec3 fullMax = glm::clamp(fullBoundingBoxMax, fullMin, glm::ivec3(fullDim));
+            out.min = glm::size3_t(fullMin);
+            out.size = glm::size3_t(fullMax - fullMin);
 
+            const std::string fileName = _basePath.get() + "__" + std::to_string(iFeature) + ".dat";
+            const std::string rawName = _basePath.get() + "__" + std::to_string(iFeature) + ".raw";
+            if (!_shouldOverwriteFiles && filesystem::fileExists(fileName)) {
+                LogWarn("Not overwriting " << fileName);
+                continue;
+            }
+            LogInfo("Saving volume " << iFeature << ": " << fileName);
+            writeDatFile(fileName, rawName, fullVolume, out.min, out.size);
+            out.file.open(rawName, std::ios::binary);
+            openOutputs.push_back(i);
+        }
 
-            // For each full voxel, find the covering small voxel
-            for (int x = 0; x < newSize.x; ++x) {
-#pragma omp parallel for num_threads(10)
-                for (int y = 0; y < newSize.y; ++y) {
-                    for (int z = 0; z < newSize.z; ++z) {
-                        const size3_t fullPos = {
-                            x + fullBoundingBoxMin.x,
-                            y + fullBoundingBoxMin.y,
-                            z + fullBoundingBoxMin.z
-                        };
-
-                        const glm::dvec3 p = {
-                            double(fullPos.x) / fullRep.getDimensions().x,
-                            double(fullPos.y) / fullRep.getDimensions().y,
-                            double(fullPos.z) / fullRep.getDimensions().z
-                        };
-
-                        const size3_t smallPos = {
-                            size_t(p.x * smallRep.getDimensions().x),
-                            size_t(p.y * smallRep.getDimensions().y),
-                            size_t(p.z * smallRep.getDimensions().z)
-                        };
+        std::vector<uint8_t> slab;
+        for (size_t z0 = 0; z0 < fullDim.z; z0 += _slabDepth) {
+            const size_t z1 = std::min<size_t>(z0 + _slabDepth, fullDim.z);
 
+            std::vector<size_t> overlapping;
+            for (size_t i : openOutputs) {
+                if (outputs[i].min.z < z1 && outputs[i].min.z + outputs[i].size.z > z0) {
+                    overlapping.push_back(i);
+                }
+            }
+            if (overlapping.empty()) {
+                continue;
+            }
 
-                        const uint64_t smallIdx = VolumeRAM::posToIndex(smallPos, smallRep.getDimensions());
-                        if (smallData[smallIdx] != 0) {
-                            const uint64_t fullIdx = VolumeRAM::posToIndex(fullPos, fullRep.getDimensions());
+            slab.resize((z1 - z0) * sliceSize);
+            if (!readSlab(z0, z1, slab.data())) {
+                // A truncated or unreadable file would silently write garbage into the exports
+                LogError("Could not read slices " << z0 << " to " << z1 << " from " << rawFileName <<
+                    ", loading the full resolution data completely");
+                readSlab = readFromMemory();
+                readSlab(z0, z1, slab.data());
+            }
 
-                            const uint64_t newIdx = VolumeRAM::posToIndex({x, y, z}, newRep.getDimensions());
-                            newData[newIdx] = fullData[fullIdx];
+            // Every feature writes its own file, so they can be filled in parallel
+            parallelFor(overlapping, [&](size_t i) {
+                FullResolutionOutput& out = outputs[i];
+                // The small volume only covers its bounding box, the full resolution box
+                // can reach up to one small voxel beyond it where everything is zero
+                const InternalFeatureInfo& info = featureInfos[out.iFeature];
+                const glm::size3_t boxMin = info.boundingBoxMin;
+                const glm::size3_t boxSize = info.boundingBoxSize();
+                auto inBox = [](size_t p, size_t min, size_t size) { return p >= min && p - min < size; };
+
+                std::vector<uint8_t> row(out.size.x);
+                const size_t zBegin = std::max(z0, out.min.z);
+                const size_t zEnd = std::min(z1, out.min.z + out.size.z);
+                for (size_t z = zBegin; z < zEnd; ++z) {
+                    for (size_t y = out.min.y; y < out.min.y + out.size.y; ++y) {
+                        std::fill(row.begin(), row.end(), uint8_t(0));
+                        if (inBox(smallY[y], boxMin.y, boxSize.y) && inBox(smallZ[z], boxMin.z, boxSize.z)) {
+                            const uint8_t* fullRow = slab.data() + (z - z0) * sliceSize + y * fullDim.x;
+                            const uint8_t* smallRow = info.volume.data() + VolumeRAM::posToIndex(
+                                { 0, smallY[y] - boxMin.y, smallZ[z] - boxMin.z }, boxSize
+                            );
+                            for (size_t x = 0; x < out.size.x; ++x) {
+                                const size_t fullX = out.min.x + x;
+                                if (inBox(smallX[fullX], boxMin.x, boxSize.x) && smallRow[smallX[fullX] - boxMin.x] != 0) {
+                                    row[x] = fullRow[fullX];
+                                }
+                            }
                         }
+                        out.file.write(reinterpret_cast<const char*>(row.data()), row.size());
                     }
                 }
-            }
-
-            const std::string fileName = _basePath.get() + "__" + std::to_string(iFeature) + ".dat";
-            LogInfo("Saving volume " << iFeature << ": " << fileName);
-
-            auto factory = getNetwork()->getApplication()->getDataWriterFactory();
-            auto writer = factory->template getWriterForTypeAndExtension<Volume>("dat");
-            writer->setOverwrite(_shouldOverwriteFiles);
-            writer->writeData(newVolume, fileName);
-
-            delete newVolume;
+            });
         }
     }
 
-    // @LEAK:  The volumes are not deleted
-
     glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
 }
 
@@ -31,6 +31,7 @@ protected:
     VolumeInport _inportFullData;
 
     IntProperty _featherDistance;
+    IntProperty _slabDepth;
 
     BoolProperty _shouldOverwriteFiles;
     StringProperty _basePath;
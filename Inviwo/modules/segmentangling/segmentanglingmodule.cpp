@@ -14,6 +14,7 @@
 #include <modules/segmentangling/processors/topoppparameterer.h>
 #include <modules/segmentangling/processors/selector.h>
 #include <modules/segmentangling/processors/volumestopper.h>
+#include <modules/segmentangling/io/partitionvolumereader.h>
 
 namespace inviwo {
 
@@ -41,6 +42,8 @@ SegmentanglingModule::SegmentanglingModule(InviwoApplication* app)
     registerProcessor<YixinLoader>();
     registerProcessor<Selector>();
     registerProcessor<VolumeStopper>();
+
+    registerDataReader(util::make_unique<PartitionVolumeReader>());
 }
 
 }  // namespace
@@ -0,0 +1,75 @@
+#ifndef __AB_DIRTYBLOCKS_H__
+#define __AB_DIRTYBLOCKS_H__
+
+#include <modules/opengl/inviwoopengl.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace inviwo {
+
+// Keeps track of the blocks of a CPU side copy of a buffer that changed since the last
+// upload, so that only those have to be sent with glBufferSubData. Neighbouring dirty
+// blocks are sent in a single call
+class DirtyBlocks {
+public:
+    // Number of entries that are uploaded together if any of them changed
+    static const size_t BlockSize = 1024;
+
+    // Tracks a buffer of size entries, with nothing marked
+    void reset(size_t size) {
+        _size = size;
+        _dirty.assign((size + BlockSize - 1) / BlockSize, false);
+        _nDirty = 0;
+    }
+
+    void mark(size_t i) {
+        const size_t block = i / BlockSize;
+        if (!_dirty[block]) {
+            _dirty[block] = true;
+            ++_nDirty;
+        }
+    }
+
+    bool empty() const {
+        return _nDirty == 0;
+    }
+
+    // Uploads the dirty parts of data to the buffer bound to target and marks everything
+    // clean again. Returns the number of glBufferSubData calls
+    size_t upload(GLenum target, const std::vector<uint32_t>& data) {
+        size_t nUploads = 0;
+        for (size_t block = 0; block < _dirty.size() && _nDirty > 0; ) {
+            if (!_dirty[block]) {
+                ++block;
+                continue;
+            }
+            size_t end = block;
+            while (end < _dirty.size() && _dirty[end]) {
+                _dirty[end] = false;
+                --_nDirty;
+                ++end;
+            }
+            const size_t first = block * BlockSize;
+            const size_t last = std::min(end * BlockSize, _size);
+            glBufferSubData(
+                target,
+                sizeof(uint32_t) * first,
+                sizeof(uint32_t) * (last - first),
+                data.data() + first
+            );
+            ++nUploads;
+            block = end;
+        }
+        return nUploads;
+    }
+
+private:
+    size_t _size = 0;
+    std::vector<bool> _dirty;
+    size_t _nDirty = 0;
+};
+
+} // namespace inviwo
+
+#endif // __AB_DIRTYBLOCKS_H__